@@ -0,0 +1,362 @@
+#include "Benchmark.h"
+#include "Builder.h"
+#include "ChunkUpdater.h"
+#include "MapRenderer.h"
+#include "MapGenerator.h"
+#include "Lighting.h"
+#include "World.h"
+#include "Block.h"
+#include "TerrainAtlas.h"
+#include "GraphicsAPI.h"
+#include "Event.h"
+#include "Platform.h"
+#include "ErrorHandler.h"
+#include "Funcs.h"
+#include "Deflate.h"
+#include "Stream.h"
+#include "ServerConnection.h"
+#include "Entity.h"
+#include "Chat.h"
+#include "Inventory.h"
+#include "Drawer2D.h"
+#include "ModelCache.h"
+#include "Gui.h"
+#include "Game.h"
+
+#if CC_BUILD_BENCHMARK
+#define BENCHMARK_WIDTH 256
+#define BENCHMARK_HEIGHT 64
+#define BENCHMARK_LENGTH 256
+#define BENCHMARK_RUNS 3
+Int32 bench_seeds[BENCHMARK_RUNS] = { 1234, 5678, 91011 };
+#define BENCHMARK_LEVELS 3
+Int32 bench_levels[BENCHMARK_LEVELS] = { DEFLATE_LEVEL_FASTEST, DEFLATE_LEVEL_DEFAULT, DEFLATE_LEVEL_BEST };
+
+IGameComponent bench_lighting;
+/* Time taken in microseconds to build each chunk that has a mesh. */
+Int32* bench_latencies;
+Int32 bench_latenciesCount;
+
+static void Benchmark_SetupAtlas(void) {
+	/* Contents of textures are irrelevant, only the dimensions of the atlas matter for mesh building */
+	Bitmap atlas; Bitmap_Allocate(&atlas, 256, 256);
+	Platform_MemSet(atlas.Scan0, 0xFF, Bitmap_DataSize(256, 256));
+
+	Atlas2D_UpdateState(&atlas);
+	Atlas1D_UpdateState();
+	Event_RaiseVoid(&TextureEvents_AtlasChanged);
+}
+
+static void Benchmark_LoadMap(bool vanilla, Int32 seed) {
+	World_Reset();
+	Event_RaiseVoid(&WorldEvents_NewMap);
+	bench_lighting.OnNewMap();
+
+	Gen_Width = BENCHMARK_WIDTH; Gen_Height = BENCHMARK_HEIGHT; Gen_Length = BENCHMARK_LENGTH;
+	Gen_Seed = seed;
+	if (vanilla) {
+		NotchyGen_Generate();
+	} else {
+		FlatgrassGen_Generate();
+	}
+	if (Gen_Blocks == NULL) ErrorHandler_Fail("Benchmark - failed to generate map");
+
+	World_SetNewMap(Gen_Blocks, Gen_Width * Gen_Height * Gen_Length, Gen_Width, Gen_Height, Gen_Length);
+	Gen_Blocks = NULL;
+	bench_lighting.OnNewMapLoaded();
+	Event_RaiseVoid(&WorldEvents_MapLoaded);
+}
+
+/* Returns number of non-empty parts (i.e. draw calls), and adds up the number of vertices in them. */
+static Int32 Benchmark_CountParts(ChunkPartInfo* parts, Int32* vertices) {
+	if (parts == NULL) return 0;
+	Int32 i, j, count = 0;
+
+	for (i = 0; i < MapRenderer_1DUsedCount; i++, parts += MapRenderer_ChunksCount) {
+		if (parts->Offset < 0) continue;
+		count++;
+		*vertices += parts->SpriteCount;
+		for (j = 0; j < FACE_COUNT; j++) { *vertices += parts->Counts[j]; }
+	}
+	return count;
+}
+
+static void Benchmark_SortLatencies(Int32 left, Int32 right) {
+	Int32* keys = bench_latencies; Int32 key;
+	while (left < right) {
+		Int32 i = left, j = right;
+		Int32 pivot = keys[(i + j) / 2];
+
+		/* partition the list */
+		while (i <= j) {
+			while (pivot > keys[i]) i++;
+			while (pivot < keys[j]) j--;
+			QuickSort_Swap_Maybe();
+		}
+		/* recurse into the smaller subset */
+		QuickSort_Recurse(Benchmark_SortLatencies)
+	}
+}
+
+static Int32 Benchmark_Percentile(Int32 percent) {
+	if (bench_latenciesCount == 0) return 0;
+	Int32 i = (bench_latenciesCount - 1) * percent / 100;
+	return bench_latencies[i];
+}
+
+/* Builds every chunk in the world one at a time on the main thread, timing each chunk. */
+static void Benchmark_BuildSerial(const UInt8* name) {
+	Int32 i, vertices = 0, parts = 0;
+	Int64 totalTime = 0;
+	bench_latenciesCount = 0;
+
+	for (i = 0; i < MapRenderer_ChunksCount; i++) {
+		ChunkInfo* info = &MapRenderer_Chunks[i];
+		Stopwatch timer; Stopwatch_Start(&timer);
+		Builder_MakeChunk(info);
+		Int32 elapsed = Stopwatch_ElapsedMicroseconds(&timer);
+
+		totalTime += elapsed;
+		if (info->NormalParts == NULL && info->TranslucentParts == NULL) continue;
+		bench_latencies[bench_latenciesCount++] = elapsed;
+		parts += Benchmark_CountParts(info->NormalParts,      &vertices);
+		parts += Benchmark_CountParts(info->TranslucentParts, &vertices);
+	}
+	if (totalTime == 0) totalTime = 1;
+
+	Int32 chunksPerSec   = (Int32)((Int64)MapRenderer_ChunksCount * 1000000 / totalTime);
+	Int32 verticesPerSec = (Int32)((Int64)vertices * 1000000 / totalTime);
+	Platform_Log3("%c serial: %i chunks/s, %i vertices/s", name, &chunksPerSec, &verticesPerSec);
+	/* Every non-empty part is a separate draw call when the whole map is in view */
+	Int32 partsKB = (Int32)((Int64)MapRenderer_ChunksCount * MapRenderer_1DUsedCount * 2 * sizeof(ChunkPartInfo) / 1024);
+	Platform_Log4("  mesh: %i vertices, %i draw calls, %i atlases, %i KB parts buffer",
+		&vertices, &parts, &MapRenderer_1DUsedCount, &partsKB);
+
+	Benchmark_SortLatencies(0, bench_latenciesCount - 1);
+	Int32 p50 = Benchmark_Percentile(50), p90 = Benchmark_Percentile(90), p99 = Benchmark_Percentile(99);
+	Int32 max = Benchmark_Percentile(100);
+	Platform_Log4("  latency (us): p50 %i, p90 %i, p99 %i, max %i", &p50, &p90, &p99, &max);
+}
+
+/* Builds every chunk in the world using the background mesh building threads. */
+static void Benchmark_BuildParallel(const UInt8* name) {
+	Int32 next = 0, finished = 0;
+	Stopwatch timer; Stopwatch_Start(&timer);
+
+	while (finished < MapRenderer_ChunksCount) {
+		while (next < MapRenderer_ChunksCount && Builder_CanQueue()) {
+			if (!Builder_QueueChunk(&MapRenderer_Chunks[next])) finished++;
+			next++;
+		}
+
+		ChunkInfo* info = Builder_FinishChunk();
+		if (info == NULL) {
+			Platform_ThreadSleep(0);
+		} else {
+			finished++;
+		}
+	}
+
+	Int32 elapsed = Stopwatch_ElapsedMicroseconds(&timer);
+	if (elapsed == 0) elapsed = 1;
+	Int32 chunksPerSec = (Int32)((Int64)MapRenderer_ChunksCount * 1000000 / elapsed);
+	Platform_Log2("%c parallel: %i chunks/s", name, &chunksPerSec);
+}
+
+/* Compresses the world's blocks like Cw_Save does, at a few different compression levels. */
+static void Benchmark_Compress(const UInt8* name) {
+	/* Generated maps always compress well, so this is plenty of room */
+	UInt32 capacity = World_BlocksSize + 1024;
+	UInt8* dst = Platform_MemAlloc(capacity, sizeof(UInt8));
+	if (dst == NULL) ErrorHandler_Fail("Benchmark - failed to allocate compression buffer");
+	String path = String_FromConst("benchmark.cw");
+	Int32 i;
+
+	for (i = 0; i < BENCHMARK_LEVELS; i++) {
+		Stream stream; Stream_WriteonlyMemory(&stream, dst, capacity, &path);
+		Stream compStream;
+		GZipState state;
+
+		Stopwatch timer; Stopwatch_Start(&timer);
+		GZip_MakeStream(&compStream, &state, &stream, bench_levels[i]);
+		Stream_Write(&compStream, World_Blocks, World_BlocksSize);
+		ReturnCode result = compStream.Close(&compStream);
+		ErrorHandler_CheckOrFail(result, "Benchmark - compressing map");
+		Int32 elapsed = Stopwatch_ElapsedMicroseconds(&timer);
+		if (elapsed == 0) elapsed = 1;
+
+		Int32 size = (Int32)(capacity - stream.Meta_Mem_Left);
+		Int32 kbPerSec = (Int32)((Int64)World_BlocksSize * 1000000 / 1024 / elapsed);
+		Platform_Log4("%c gzip level %i: %i bytes, %i KB/s", name, &bench_levels[i], &size, &kbPerSec);
+	}
+	Platform_MemFree(&dst);
+}
+
+static void Benchmark_RunBuilder(const UInt8* name) {
+	Benchmark_BuildSerial(name);
+	ChunkUpdater_ClearChunkCache();
+	ChunkUpdater_ResetChunkCache();
+	/* Otherwise meshes from serial pass would just be restored from mesh cache */
+	Builder_ClearCache();
+	Benchmark_BuildParallel(name);
+	ChunkUpdater_ClearChunkCache();
+	ChunkUpdater_ResetChunkCache();
+}
+
+/* Greedy meshing trades fewer vertices for more draw calls and a larger parts buffer, so both builders are measured on the same map. */
+static void Benchmark_RunMap(const UInt8* name, const UInt8* greedyName) {
+	Benchmark_Compress(name);
+	Game_SetGreedyMeshing(false);
+	Benchmark_RunBuilder(name);
+	Game_SetGreedyMeshing(true);
+	Benchmark_RunBuilder(greedyName);
+	Game_SetGreedyMeshing(false);
+}
+
+void Benchmark_Run(void) {
+	Gfx_Init();
+	Block_Init();
+	bench_lighting = Lighting_MakeComponent();
+	bench_lighting.Init();
+	ChunkUpdater_Init();
+	Benchmark_SetupAtlas();
+
+	Int32 i;
+	for (i = 0; i < BENCHMARK_RUNS; i++) {
+		Benchmark_LoadMap(true, bench_seeds[i]);
+		bench_latencies = Platform_MemAlloc(MapRenderer_ChunksCount, sizeof(Int32));
+		if (bench_latencies == NULL) ErrorHandler_Fail("Benchmark - failed to allocate latencies");
+
+		Platform_Log1("Vanilla map, seed %i", &bench_seeds[i]);
+		Benchmark_RunMap("Vanilla", "Vanilla greedy");
+		Platform_MemFree(&bench_latencies);
+	}
+
+	Benchmark_LoadMap(false, 0);
+	bench_latencies = Platform_MemAlloc(MapRenderer_ChunksCount, sizeof(Int32));
+	if (bench_latencies == NULL) ErrorHandler_Fail("Benchmark - failed to allocate latencies");
+	Benchmark_RunMap("Flatgrass", "Flatgrass greedy");
+	Platform_MemFree(&bench_latencies);
+
+	World_Reset();
+	Event_RaiseVoid(&WorldEvents_NewMap);
+	ChunkUpdater_Free();
+	bench_lighting.Free();
+	Atlas1D_Free();
+	Atlas2D_Free();
+	Gfx_Free();
+}
+
+
+/*########################################################################################################################*
+*-----------------------------------------------------Packet replay-------------------------------------------------------*
+*#########################################################################################################################*/
+typedef struct ReplayStats_ { Int32 Count, Time, Allocs; } ReplayStats;
+/* Number of packets, total time in microseconds, and number of allocations, for each opcode */
+ReplayStats bench_replayStats[256];
+IGameComponent bench_replayComps[8];
+Int32 bench_replayCompsCount;
+
+static void Benchmark_AddReplayComponent(IGameComponent comp) {
+	bench_replayComps[bench_replayCompsCount++] = comp;
+}
+
+/* Sets up just the parts of the game that packet handlers depend on. */
+static void Benchmark_InitReplay(void) {
+	Gfx_Init();
+	Drawer2D_Init();
+	Entities_Init();
+	Block_Init();
+	ModelCache_Init();
+	Benchmark_SetupAtlas();
+	Game_Width = 854; Game_Height = 480;
+
+	Game_UseCPE = true;
+	Game_AllowCustomBlocks = true;
+	/* Otherwise replaying would prompt for (or download) the server's texture pack */
+	Game_AllowServerTextures = false;
+
+	Benchmark_AddReplayComponent(TabList_MakeComponent());
+	Benchmark_AddReplayComponent(Chat_MakeComponent());
+	Benchmark_AddReplayComponent(Lighting_MakeComponent());
+	Benchmark_AddReplayComponent(Inventory_MakeComponent());
+	Block_SetDefaultPerms();
+	WorldEnv_Reset();
+
+	LocalPlayer_Init();
+	Benchmark_AddReplayComponent(LocalPlayer_MakeComponent());
+	Entities_List[ENTITIES_SELF_ID] = &LocalPlayer_Instance.Base;
+	ChunkUpdater_Init();
+
+	ServerConnection_InitReplay();
+	Benchmark_AddReplayComponent(ServerConnection_MakeComponent());
+	Benchmark_AddReplayComponent(Gui_MakeComponent());
+
+	Int32 i;
+	for (i = 0; i < bench_replayCompsCount; i++) { bench_replayComps[i].Init(); }
+}
+
+static void Benchmark_FreeReplay(void) {
+	Int32 i;
+	for (i = bench_replayCompsCount - 1; i >= 0; i--) { bench_replayComps[i].Free(); }
+	bench_replayCompsCount = 0;
+
+	ChunkUpdater_Free();
+	Atlas1D_Free();
+	Atlas2D_Free();
+	Gfx_Free();
+}
+
+static void Benchmark_LogReplay(Int32 elapsed, Int32 backgroundAllocs) {
+	Int32 i, packets = 0, allocs = 0;
+	for (i = 0; i < Array_Elems(bench_replayStats); i++) {
+		packets += bench_replayStats[i].Count;
+		allocs  += bench_replayStats[i].Allocs;
+	}
+
+	if (elapsed == 0) elapsed = 1;
+	Int32 packetsPerSec = (Int32)((Int64)packets * 1000000 / elapsed);
+	Platform_Log4("Replayed %i packets in %i us: %i packets/s, %i allocations on main thread", &packets, &elapsed, &packetsPerSec, &allocs);
+
+	for (i = 0; i < Array_Elems(bench_replayStats); i++) {
+		ReplayStats* stats = &bench_replayStats[i];
+		if (stats->Count == 0) continue;
+		Int32 nsPerPacket = (Int32)((Int64)stats->Time * 1000 / stats->Count);
+		Platform_Log4("  opcode %i: %i packets, %i ns/packet, %i allocations", &i, &stats->Count, &nsPerPacket, &stats->Allocs);
+	}
+	/* Can't be attributed to a single packet, as the decoder thread runs alongside the main thread */
+	Platform_Log1("  %i allocations on background threads (map decoding for LevelDataChunk/LevelFinalise)", &backgroundAllocs);
+}
+
+void Benchmark_Replay(STRING_PURE String* path) {
+	Stream stream;
+	ReturnCode result = Stream_MapFile(&stream, path);
+	ErrorHandler_CheckOrFail(result, "Benchmark - mapping network capture file");
+	Benchmark_InitReplay();
+
+	/* Timer is only read after each packet, so that time below the timer's resolution isn't lost */
+	Stopwatch timer; Stopwatch_Start(&timer);
+	Int32 last = 0;
+	UInt32 backgroundAllocs = Platform_BackgroundAllocCount;
+	while (stream.Meta_Mem_Left > 0) {
+		UInt8 opcode  = stream.Meta_Mem_Cur[0];
+		UInt32 allocs = Platform_AllocCount;
+		if (!Net_HandlePacket(&stream)) {
+			Platform_LogConst("Capture ends with a partial packet");
+			break;
+		}
+
+		Int32 now = Stopwatch_ElapsedMicroseconds(&timer);
+		ReplayStats* stats = &bench_replayStats[opcode];
+		stats->Count++;
+		stats->Time   += now - last;
+		stats->Allocs += (Int32)(Platform_AllocCount - allocs);
+		last = now;
+	}
+
+	Benchmark_LogReplay(last, (Int32)(Platform_BackgroundAllocCount - backgroundAllocs));
+	result = stream.Close(&stream);
+	ErrorHandler_CheckOrFail(result, "Benchmark - unmapping network capture file");
+	Benchmark_FreeReplay();
+}
+#endif
@@ -0,0 +1,13 @@
+#ifndef CC_BENCHMARK_H
+#define CC_BENCHMARK_H
+#include "String.h"
+/* Measures performance of building chunk meshes, compressing maps and handling packets,
+   without needing a window or graphics context.
+   Copyright 2017 ClassicalSharp | Licensed under BSD-3
+*/
+
+/* Generates fixed seed maps, compresses and builds meshes for every chunk of them, and logs the timings. */
+void Benchmark_Run(void);
+/* Handles all packets in a capture recorded from a server (see OPT_NET_CAPTURE_FILE), and logs the timings. */
+void Benchmark_Replay(STRING_PURE String* path);
+#endif
@@ -5,6 +5,8 @@
 #include "Deflate.h"
 #include "ErrorHandler.h"
 #include "Stream.h"
+#include "Funcs.h"
+#include "Utils.h"
 
 void Bitmap_Create(Bitmap* bmp, Int32 width, Int32 height, UInt8* scan0) {
 	bmp->Width = width; bmp->Height = height;
@@ -72,25 +74,63 @@ static void Png_CheckHeader(Stream* stream) {
 	}
 }
 
+/* Filters operate on whole pixels (4 bytes) at a time when possible, treating each byte of a UInt32 as a separate lane.
+   These add/average each byte of two words, without carrying into the neighbouring bytes. */
+#define Png_AddBytes(a, b) ((((a) & 0x7F7F7F7FUL) + ((b) & 0x7F7F7F7FUL)) ^ (((a) ^ (b)) & 0x80808080UL))
+#define Png_AvgBytes(a, b) (((a) & (b)) + ((((a) ^ (b)) & 0xFEFEFEFEUL) >> 1))
+
+static UInt8 Png_Paeth(UInt8 a, UInt8 b, UInt8 c) {
+	Int32 pa = b - c, pb = a - c, pc = pa + pb;
+	if (pa < 0) pa = -pa;
+	if (pb < 0) pb = -pb;
+	if (pc < 0) pc = -pc;
+
+	if (pa <= pb && pa <= pc) return a;
+	return pb <= pc ? b : c;
+}
+
 static void Png_Reconstruct(UInt8 type, UInt8 bytesPerPixel, UInt8* line, UInt8* prior, UInt32 lineLen) {
 	UInt32 i, j;
+	UInt32* line32  = (UInt32*)line;
+	UInt32* prior32 = (UInt32*)prior;
+	UInt32 cur;
+
 	switch (type) {
 	case PNG_FILTER_NONE:
 		return;
 
 	case PNG_FILTER_SUB:
+		if (bytesPerPixel == 4) {
+			for (i = 1, cur = line32[0]; i < (lineLen >> 2); i++) {
+				cur = Png_AddBytes(line32[i], cur); line32[i] = cur;
+			}
+			return;
+		}
 		for (i = bytesPerPixel, j = 0; i < lineLen; i++, j++) {
 			line[i] += line[j];
 		}
 		return;
 
 	case PNG_FILTER_UP:
-		for (i = 0; i < lineLen; i++) {
+		for (i = 0; i < (lineLen >> 2); i++) {
+			line32[i] = Png_AddBytes(line32[i], prior32[i]);
+		}
+		for (i <<= 2; i < lineLen; i++) {
 			line[i] += prior[i];
 		}
 		return;
 
 	case PNG_FILTER_AVERAGE:
+		if (bytesPerPixel == 4) {
+			UInt32 avg = (prior32[0] >> 1) & 0x7F7F7F7FUL;
+			cur = Png_AddBytes(line32[0], avg); line32[0] = cur;
+
+			for (i = 1; i < (lineLen >> 2); i++) {
+				avg = Png_AvgBytes(prior32[i], cur);
+				cur = Png_AddBytes(line32[i], avg); line32[i] = cur;
+			}
+			return;
+		}
 		for (i = 0; i < bytesPerPixel; i++) {
 			line[i] += (prior[i] >> 1);
 		}
@@ -100,20 +140,11 @@ static void Png_Reconstruct(UInt8 type, UInt8 bytesPerPixel, UInt8* line, UInt8*
 		return;
 
 	case PNG_FILTER_PAETH:
-		/* TODO: verify this is right */
 		for (i = 0; i < bytesPerPixel; i++) {
 			line[i] += prior[i];
 		}
 		for (j = 0; i < lineLen; i++, j++) {
-			UInt8 a = line[j], b = prior[i], c = prior[j];
-			Int32 p = a + b - c;
-			Int32 pa = Math_AbsI(p - a);
-			Int32 pb = Math_AbsI(p - b);
-			Int32 pc = Math_AbsI(p - c);
-
-			if (pa <= pb && pa <= pc) { line[i] += a; } 
-			else if (pb <= pc) {        line[i] += b; } 
-			else {                      line[i] += c; }
+			line[i] += Png_Paeth(line[j], prior[i], prior[j]);
 		}
 		return;
 
@@ -183,9 +214,15 @@ static void Png_Expand_RGB(UInt8 bitsPerSample, Int32 width, UInt32* palette, UI
 #define PNG_Do_RGB_16(dstI, srcI) dst[dstI] = PackedCol_ARGB(src[srcI], src[srcI + 3], src[srcI + 5], 255);
 
 	if (bitsPerSample == 8) {
+		/* 4 pixels are stored in 3 words as R0 G0 B0 R1 | G1 B1 R2 G2 | B2 R3 G3 B3 */
 		for (i = 0, j = 0; i < (width & ~0x03); i += 4, j += 12) {
-			PNG_Do_RGB__8(i    , j    ); PNG_Do_RGB__8(i + 1, j + 3);
-			PNG_Do_RGB__8(i + 2, j + 6); PNG_Do_RGB__8(i + 3, j + 9);
+			UInt32* src32 = (UInt32*)&src[j];
+			UInt32 w0 = src32[0], w1 = src32[1], w2 = src32[2];
+
+			dst[i    ] = 0xFF000000UL | ((w0 & 0xFF) << 16) | (w0 & 0xFF00) | ((w0 >> 16) & 0xFF);
+			dst[i + 1] = 0xFF000000UL | ((w0 >> 24) << 16) | ((w1 & 0xFF) << 8) | ((w1 >> 8) & 0xFF);
+			dst[i + 2] = 0xFF000000UL | (w1 & 0xFF0000) | ((w1 >> 24) << 8) | (w2 & 0xFF);
+			dst[i + 3] = 0xFF000000UL | ((w2 & 0xFF00) << 8) | ((w2 >> 8) & 0xFF00) | (w2 >> 24);
 		}
 		for (; i < width; i++, j += 3) { PNG_Do_RGB__8(i, j); }
 	} else {
@@ -266,11 +303,12 @@ static void Png_Expand_RGB_A(UInt8 bitsPerSample, Int32 width, UInt32* palette,
 #define PNG_Do_RGB_A_16(dstI, srcI) dst[dstI] = PackedCol_ARGB(src[srcI], src[srcI + 3], src[srcI + 5], src[srcI + 7]);
 
 	if (bitsPerSample == 8) {
-		for (i = 0, j = 0; i < (width & ~0x3); i += 4, j += 16) {
-			PNG_Do_RGB_A__8(i    , j    ); PNG_Do_RGB_A__8(i + 1, j + 4 );
-			PNG_Do_RGB_A__8(i + 2, j + 8); PNG_Do_RGB_A__8(i + 3, j + 12);
+		/* R G B A in memory is only a swap of R and B away from the bitmap's B G R A */
+		UInt32* src32 = (UInt32*)src;
+		for (i = 0; i < width; i++) {
+			UInt32 w = src32[i];
+			dst[i] = (w & 0xFF00FF00UL) | ((w & 0xFF) << 16) | ((w >> 16) & 0xFF);
 		}
-		for (; i < width; i++, j += 4) { PNG_Do_RGB_A__8(i, j); }
 	} else {
 		for (i = 0, j = 0; i < width; i++, j += 8) { PNG_Do_RGB_A_16(i, j); }
 	}
@@ -289,10 +327,10 @@ static void Png_ComputeTransparency(Bitmap* bmp, UInt32 transparentCol) {
 	}
 }
 
-/* Most bits per sample is 16. Most samples per pixel is 4. Add 1 for filter byte. */
-#define PNG_BUFFER_SIZE ((PNG_MAX_DIMS * 2 * 4 + 1) * 2)
+/* Scanlines are reconstructed after every this many bytes decompressed, while they are still in the CPU cache */
+#define PNG_DECODE_CHUNK_SIZE (64 * 1024)
 /* TODO: Test a lot of .png files and ensure output is right */
-void Bitmap_DecodePng(Bitmap* bmp, Stream* stream) {
+static void Png_Decode(Bitmap* bmp, Stream* stream) {
 	Png_CheckHeader(stream);
 	Bitmap_Create(bmp, 0, 0, NULL);
 	UInt32 transparentCol = PackedCol_ARGB(0, 0, 0, 255);
@@ -313,8 +351,9 @@ void Bitmap_DecodePng(Bitmap* bmp, Stream* stream) {
 	ZLibHeader_Init(&zlibHeader);
 
 	UInt32 scanlineSize, scanlineBytes, curY = 0;
-	UInt8 buffer[PNG_BUFFER_SIZE];
-	UInt32 bufferIdx, bufferRows;
+	/* Filtered scanlines of the whole image, preceded by an empty scanline (prior to first scanline) */
+	UInt8* data = NULL;
+	UInt32 imageSize = 0, dataIdx = 0;
 
 	while (readingChunks) {
 		UInt32 dataSize = Stream_ReadU32_BE(stream);
@@ -350,9 +389,12 @@ void Bitmap_DecodePng(Bitmap* bmp, Stream* stream) {
 			scanlineSize = ((samplesPerPixel[col] * bitsPerSample * bmp->Width) + 7) >> 3;
 			scanlineBytes = scanlineSize + 1; /* Add 1 byte for filter byte of each scanline */			
 
-			Platform_MemSet(buffer, 0, scanlineBytes); /* Prior row should be 0 per PNG spec */
-			bufferIdx = scanlineBytes;
-			bufferRows = PNG_BUFFER_SIZE / scanlineBytes;
+			/* Decompressing straight into the scanlines avoids copying the output through the inflater's window */
+			imageSize = scanlineBytes * bmp->Height;
+			data = Platform_MemAlloc(scanlineBytes + imageSize, sizeof(UInt8));
+			if (data == NULL) ErrorHandler_Fail("Failed to allocate memory for PNG scanlines");
+			Platform_MemSet(data, 0, scanlineBytes); /* Prior row should be 0 per PNG spec */
+			Inflate_SetFlatOutput(&inflate, &data[scanlineBytes]);
 
 			switch (col) {
 			case PNG_COL_GRAYSCALE: rowExpander = Png_Expand_GRAYSCALE; break;
@@ -406,39 +448,32 @@ void Bitmap_DecodePng(Bitmap* bmp, Stream* stream) {
 			/* TODO: This assumes zlib header will be in 1 IDAT chunk */
 			while (!zlibHeader.Done) { ZLibHeader_Read(&datStream, &zlibHeader); }
 
-			UInt32 bufferLen = bufferRows * scanlineBytes, bufferMax = bufferLen - scanlineBytes;
+			if (data == NULL) ErrorHandler_Fail("PNG image data before header");
 			while (curY < bmp->Height) {
-				/* Need to leave one row in buffer untouched for storing prior scanline. Illustrated example of process:
-				*          |=====|        #-----|        |-----|        #-----|        |-----|
-				* initial  #-----| read 3 |-----| read 3 |-----| read 1 |-----| read 3 |-----| etc
-				*  state   |-----| -----> |-----| -----> |=====| -----> |-----| -----> |=====|
-				*          |-----|        |=====|        #-----|        |=====|        #-----|
-				*
-				* (==== is prior scanline, # is current index in buffer)
-				* Having initial state this way allows doing two 'read 3' first time (assuming large idat chunks)
-				*/
-				UInt32 bufferLeft = bufferLen - bufferIdx, read;
-				if (bufferLeft > bufferMax) bufferLeft = bufferMax;
-
-				ReturnCode code = compStream.Read(&compStream, &buffer[bufferIdx], bufferLeft, &read);
+				UInt32 read, count = min(imageSize - dataIdx, PNG_DECODE_CHUNK_SIZE);
+				ReturnCode code = compStream.Read(&compStream, &data[scanlineBytes + dataIdx], count, &read);
 				ErrorHandler_CheckOrFail(code, "PNG - reading image bulk data");
-				if (read == 0) break;			
+				if (read == 0) break;
 
-				UInt32 startY = bufferIdx / scanlineBytes, rowY;
-				bufferIdx += read;
-				UInt32 endY = bufferIdx / scanlineBytes;
-				/* reached end of buffer, cycle back to start */
-				if (bufferIdx == bufferLen) bufferIdx = 0;
+				/* Inflater may still copy matches from the last window of decompressed data, */
+				/* so scanlines can't be reconstructed in place until they are outside that window */
+				dataIdx += read;
+				UInt32 safeIdx = dataIdx;
+				if (dataIdx < imageSize) safeIdx = dataIdx > INFLATE_WINDOW_SIZE ? dataIdx - INFLATE_WINDOW_SIZE : 0;
 
-				for (rowY = startY; rowY < endY; rowY++, curY++) {
-					UInt32 priorY = rowY == 0 ? bufferRows : rowY;
-					UInt8* prior    = &buffer[(priorY - 1) * scanlineBytes];
-					UInt8* scanline = &buffer[rowY         * scanlineBytes];
+				UInt32 endY = safeIdx / scanlineBytes;
+				for (; curY < endY; curY++) {
+					UInt8* prior    = &data[curY * scanlineBytes];
+					UInt8* scanline = prior + scanlineBytes;
 
 					Png_Reconstruct(scanline[0], bytesPerPixel, &scanline[1], &prior[1], scanlineSize);
 					rowExpander(bitsPerSample, bmp->Width, palette, &scanline[1], Bitmap_GetRow(bmp, curY));
-				}			
+				}
 			}
+
+			/* Skip any leftover data, e.g. the zlib checksum */
+			ReturnCode code = Stream_Skip(&datStream, datStream.Meta_Mem_Left);
+			ErrorHandler_CheckOrFail(code, "PNG - skipping image data end");
 		} break;
 
 		case PNG_FourCC('I', 'E', 'N', 'D'): {
@@ -454,6 +489,7 @@ void Bitmap_DecodePng(Bitmap* bmp, Stream* stream) {
 
 		Stream_ReadU32_BE(stream); /* Skip CRC32 */
 	}
+	Platform_MemFree(&data);
 
 	if (transparentCol <= PNG_RGB_MASK) {
 		Png_ComputeTransparency(bmp, transparentCol);
@@ -463,15 +499,97 @@ void Bitmap_DecodePng(Bitmap* bmp, Stream* stream) {
 
 
 /*########################################################################################################################*
-*------------------------------------------------------PNG encoder--------------------------------------------------------*
+*--------------------------------------------------Parallel PNG decoding--------------------------------------------------*
 *#########################################################################################################################*/
-static ReturnCode Bitmap_Crc32StreamWrite(Stream* stream, UInt8* data, UInt32 count, UInt32* modified) {
-	UInt32 i, crc32 = stream->Meta_CRC32;
-	/* TODO: Optimise this calculation */
+#define PNG_MAX_WORKERS 16
+typedef struct PngPredecoded_ {
+	UInt8* Data; UInt32 Size; /* Encoded PNG image */
+	Bitmap Bmp;               /* Decoded image, Scan0 is NULL once returned from Bitmap_DecodePng */
+} PngPredecoded;
+
+PngPredecoded* png_predecoded;
+Int32 png_predecodedCount, png_nextPredecode;
+void* png_predecodeMutex;
+
+static void Png_PredecodeWorkerFunc(void) {
+	for (;;) {
+		Platform_MutexLock(png_predecodeMutex);
+		Int32 i = png_nextPredecode++;
+		Platform_MutexUnlock(png_predecodeMutex);
+		if (i >= png_predecodedCount) return;
+
+		PngPredecoded* png = &png_predecoded[i];
+		String name = String_FromConst("PNG image");
+		Stream stream; Stream_ReadonlyMemory(&stream, png->Data, png->Size, &name);
+		Png_Decode(&png->Bmp, &stream);
+	}
+}
+
+void Bitmap_PredecodePngs(UInt8** data, UInt32* sizes, Int32 count) {
+	Bitmap_FreePredecodedPngs();
+	if (count == 0) return;
+	png_predecoded = Platform_MemAlloc(count, sizeof(PngPredecoded));
+	if (png_predecoded == NULL) ErrorHandler_Fail("Failed to allocate predecoded PNGs");
+
+	Int32 i;
 	for (i = 0; i < count; i++) {
-		crc32 = Utils_Crc32Table[(crc32 ^ data[i]) & 0xFF] ^ (crc32 >> 8);
+		png_predecoded[i].Data = data[i]; png_predecoded[i].Size = sizes[i];
+	}
+	png_predecodedCount = count;
+	png_nextPredecode   = 0;
+	if (png_predecodeMutex == NULL) png_predecodeMutex = Platform_MutexCreate();
+
+	/* Main thread decodes images too */
+	void* workers[PNG_MAX_WORKERS];
+	Int32 workersCount = Platform_ProcessorsCount() - 1;
+	Math_Clamp(workersCount, 0, PNG_MAX_WORKERS);
+	workersCount = min(workersCount, count - 1);
+
+	for (i = 0; i < workersCount; i++) {
+		workers[i] = Platform_ThreadStart(Png_PredecodeWorkerFunc);
+	}
+	Png_PredecodeWorkerFunc();
+
+	for (i = 0; i < workersCount; i++) {
+		Platform_ThreadJoin(workers[i]);
+		Platform_ThreadFreeHandle(workers[i]);
 	}
-	stream->Meta_CRC32 = crc32;
+}
+
+void Bitmap_FreePredecodedPngs(void) {
+	Int32 i;
+	for (i = 0; i < png_predecodedCount; i++) {
+		Platform_MemFree(&png_predecoded[i].Bmp.Scan0);
+	}
+	Platform_MemFree(&png_predecoded);
+	png_predecodedCount = 0;
+}
+
+void Bitmap_DecodePng(Bitmap* bmp, Stream* stream) {
+	UInt32 left;
+	UInt8* mem = Stream_UNSAFE_GetMemory(stream, &left);
+	Int32 i;
+
+	for (i = 0; mem != NULL && i < png_predecodedCount; i++) {
+		PngPredecoded* png = &png_predecoded[i];
+		if (png->Data != mem || png->Bmp.Scan0 == NULL) continue;
+
+		/* Caller is now responsible for freeing the image */
+		*bmp = png->Bmp;
+		png->Bmp.Scan0 = NULL;
+		ReturnCode result = Stream_Skip(stream, left);
+		ErrorHandler_CheckOrFail(result, "PNG - skipping predecoded image");
+		return;
+	}
+	Png_Decode(bmp, stream);
+}
+
+
+/*########################################################################################################################*
+*------------------------------------------------------PNG encoder--------------------------------------------------------*
+*#########################################################################################################################*/
+static ReturnCode Bitmap_Crc32StreamWrite(Stream* stream, UInt8* data, UInt32 count, UInt32* modified) {
+	stream->Meta_CRC32 = Utils_Crc32Update(stream->Meta_CRC32, data, count);
 
 	Stream* underlying = stream->Meta_CRC32_Source;
 	return underlying->Write(underlying, data, count, modified);
@@ -546,30 +664,33 @@ static void Png_EncodeRow(UInt8* src, UInt8* cur, UInt8* prior, UInt8* best, Int
 		src += 4; dst += 3;
 	}
 
+	/* Estimate how well each filtered line will compress, based on */
+	/* smallest sum of magnitude of each byte (signed) in the line */
+	/* (see note in PNG specification, 12.8 "Filter selection" ) */
+	/* All filters are estimated in one pass, so the line only has to be actually filtered once */
 	/* Waste of time checking the PNG_NONE filter */
-	Int32 filter, bestFilter = PNG_FILTER_SUB, bestEstimate = Int32_MaxValue;
-	dst = best + 1;
-
-	for (filter = PNG_FILTER_SUB; filter <= PNG_FILTER_PAETH; filter++) {
-		Png_Filter(filter, cur, prior, dst, lineLen);
-
-		/* Estimate how well this filtered line will compress, based on */
-		/* smallest sum of magnitude of each byte (signed) in the line */
-		/* (see note in PNG specification, 12.8 "Filter selection" ) */
-		Int32 estimate = 0;
-		for (x = 0; x < lineLen; x++) {
-			estimate += Math_AbsI((Int8)dst[x]);
-		}
-
-		if (estimate > bestEstimate) continue;
-		bestEstimate = estimate;
-		bestFilter   = filter;
+	Int32 estimates[PNG_FILTER_PAETH + 1] = { 0 };
+	for (x = 0; x < 3; x++) {
+		UInt8 b = prior[x];
+		estimates[PNG_FILTER_SUB]     += Math_AbsI((Int8)cur[x]);
+		estimates[PNG_FILTER_UP]      += Math_AbsI((Int8)(cur[x] - b));
+		estimates[PNG_FILTER_AVERAGE] += Math_AbsI((Int8)(cur[x] - (b >> 1)));
+		estimates[PNG_FILTER_PAETH]   += Math_AbsI((Int8)(cur[x] - b));
+	}
+	for (; x < lineLen; x++) {
+		UInt8 a = cur[x - 3], b = prior[x], c = prior[x - 3];
+		estimates[PNG_FILTER_SUB]     += Math_AbsI((Int8)(cur[x] - a));
+		estimates[PNG_FILTER_UP]      += Math_AbsI((Int8)(cur[x] - b));
+		estimates[PNG_FILTER_AVERAGE] += Math_AbsI((Int8)(cur[x] - ((a + b) >> 1)));
+		estimates[PNG_FILTER_PAETH]   += Math_AbsI((Int8)(cur[x] - Png_Paeth(a, b, c)));
 	}
 
-	/* Since this filter is last checked, can avoid running it twice */
-	if (bestFilter != PNG_FILTER_PAETH) {
-		Png_Filter(bestFilter, cur, prior, dst, lineLen);
+	Int32 filter, bestFilter = PNG_FILTER_SUB;
+	for (filter = PNG_FILTER_UP; filter <= PNG_FILTER_PAETH; filter++) {
+		if (estimates[filter] <= estimates[bestFilter]) bestFilter = filter;
 	}
+
+	Png_Filter(bestFilter, cur, prior, best + 1, lineLen);
 	best[0] = bestFilter;
 }
 
@@ -609,7 +730,7 @@ void Bitmap_EncodePng(Bitmap* bmp, Stream* stream) {
 		Int32 y, lineSize = bmp->Width * 3;
 		ZLibState zlState;
 		Stream zlStream;
-		ZLib_MakeStream(&zlStream, &zlState, stream);
+		ZLib_MakeStream(&zlStream, &zlState, stream, DEFLATE_LEVEL_DEFAULT);
 
 		for (y = 0; y < bmp->Height; y++) {
 			UInt8* src  = (UInt8*)Bitmap_GetRow(bmp, y);
@@ -634,4 +755,78 @@ void Bitmap_EncodePng(Bitmap* bmp, Stream* stream) {
 	result = stream->Seek(stream, 33, STREAM_SEEKFROM_BEGIN);
 	ErrorHandler_CheckOrFail(result, "PNG - seeking to write data size");
 	Stream_WriteU32_BE(stream, dataEnd - 41);
+}
+
+
+/*########################################################################################################################*
+*------------------------------------------------Background PNG encoding--------------------------------------------------*
+*#########################################################################################################################*/
+#define PNG_MAX_QUEUED_ENCODES 8
+typedef struct PngEncode_ {
+	Bitmap Bmp;    /* Image to encode, freed once encoded */
+	Stream Output; /* File the image is written to, closed once encoded */
+} PngEncode;
+
+/* Queue is a fixed ring of slots, as a stream can't be moved after creation (its name points into itself) */
+PngEncode png_encodes[PNG_MAX_QUEUED_ENCODES];
+Int32 png_encodesHead, png_encodesCount;
+bool png_encodeRunning;
+void* png_encodeMutex;
+void* png_encodeThread;
+
+static void Png_EncodeWorkerFunc(void) {
+	for (;;) {
+		Platform_MutexLock(png_encodeMutex);
+		if (png_encodesCount == 0) {
+			png_encodeRunning = false;
+			Platform_MutexUnlock(png_encodeMutex);
+			return;
+		}
+		PngEncode* job = &png_encodes[png_encodesHead];
+		Platform_MutexUnlock(png_encodeMutex);
+
+		Bitmap_EncodePng(&job->Bmp, &job->Output);
+		ReturnCode result = job->Output.Close(&job->Output);
+		ErrorHandler_CheckOrFail(result, "PNG - closing encoded file");
+		Platform_MemFree(&job->Bmp.Scan0);
+
+		/* Slot can only be reused once the image has been fully written */
+		Platform_MutexLock(png_encodeMutex);
+		png_encodesHead = (png_encodesHead + 1) % PNG_MAX_QUEUED_ENCODES;
+		png_encodesCount--;
+		Platform_MutexUnlock(png_encodeMutex);
+	}
+}
+
+void Bitmap_EncodePngAsync(Bitmap* bmp, void* file, STRING_PURE String* path) {
+	if (png_encodeMutex == NULL) png_encodeMutex = Platform_MutexCreate();
+	Platform_MutexLock(png_encodeMutex);
+	bool full = png_encodesCount == PNG_MAX_QUEUED_ENCODES;
+	Platform_MutexUnlock(png_encodeMutex);
+	if (full) Bitmap_WaitEncodePngs();
+
+	Platform_MutexLock(png_encodeMutex);
+	PngEncode* job = &png_encodes[(png_encodesHead + png_encodesCount) % PNG_MAX_QUEUED_ENCODES];
+	job->Bmp = *bmp;
+	Stream_FromFile(&job->Output, file, path);
+	png_encodesCount++;
+
+	bool running = png_encodeRunning;
+	png_encodeRunning = true;
+	Platform_MutexUnlock(png_encodeMutex);
+	if (running) return;
+
+	/* Previous worker already finished all its images, so joining it doesn't block */
+	if (png_encodeThread != NULL) {
+		Platform_ThreadJoin(png_encodeThread);
+		Platform_ThreadFreeHandle(png_encodeThread);
+	}
+	png_encodeThread = Platform_ThreadStart(Png_EncodeWorkerFunc);
+}
+
+void Bitmap_WaitEncodePngs(void) {
+	if (png_encodeThread == NULL) return;
+	Platform_ThreadJoin(png_encodeThread);
+	Platform_ThreadFreeHandle(png_encodeThread);
+	png_encodeThread = NULL;
 }
\ No newline at end of file
@@ -1,6 +1,6 @@
 #ifndef CC_BITMAP_H
 #define CC_BITMAP_H
-#include "Typedefs.h"
+#include "String.h"
 /* Represents a 2D array of pixels.
    Copyright 2014-2017 ClassicalSharp | Licensed under BSD-3
 */
@@ -32,5 +32,15 @@ void Bitmap_AllocateClearedPow2(Bitmap* bmp, Int32 width, Int32 height);
      https://github.com/nothings/stb/blob/master/stb_image.h
 */
 void Bitmap_DecodePng(Bitmap* bmp, Stream* stream);
+/* Decodes the given PNG images at the same time, spread across all cores.
+   Bitmap_DecodePng on a readonly memory stream over one of these images afterwards just returns the decoded image. */
+void Bitmap_PredecodePngs(UInt8** data, UInt32* sizes, Int32 count);
+/* Frees the predecoded images that were never returned from Bitmap_DecodePng. */
+void Bitmap_FreePredecodedPngs(void);
 void Bitmap_EncodePng(Bitmap* bmp, Stream* stream);
+/* Encodes the bitmap as a .png to the given file on a background thread, then closes the file.
+   The bitmap's pixels are freed afterwards, so the caller must not use or free them itself. */
+void Bitmap_EncodePngAsync(Bitmap* bmp, void* file, STRING_PURE String* path);
+/* Waits until all images passed to Bitmap_EncodePngAsync have been written out. */
+void Bitmap_WaitEncodePngs(void);
 #endif
\ No newline at end of file
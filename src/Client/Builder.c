@@ -15,26 +15,10 @@
 #include "PackedCol.h"
 #include "TerrainAtlas.h"
 #include "VertexStructs.h"
+#include "ExtMath.h"
 
-BlockID* Builder_Chunk;
-UInt8* Builder_Counts;
-Int32* Builder_BitFlags;
-bool Builder_UseBitFlags;
-Int32 Builder_X, Builder_Y, Builder_Z;
-BlockID Builder_Block;
-Int32 Builder_ChunkIndex;
-bool Builder_FullBright;
-bool Builder_Tinted;
-Int32 Builder_ChunkEndX, Builder_ChunkEndZ;
 Int32 Builder_Offsets[FACE_COUNT];
 
-Int32 (*Builder_StretchXLiquid)(Int32 countIndex, Int32 x, Int32 y, Int32 z, Int32 chunkIndex, BlockID block);
-Int32 (*Builder_StretchX)(Int32 countIndex, Int32 x, Int32 y, Int32 z, Int32 chunkIndex, BlockID block, Face face);
-Int32 (*Builder_StretchZ)(Int32 countIndex, Int32 x, Int32 y, Int32 z, Int32 chunkIndex, BlockID block, Face face);
-void (*Builder_RenderBlock)(Int32 countsIndex);
-void (*Builder_PreStretchTiles)(Int32 x1, Int32 y1, Int32 z1);
-void (*Builder_PostStretchTiles)(Int32 x1, Int32 y1, Int32 z1);
-
 /* Contains state for vertices for a portion of a chunk mesh (vertices that are in a 1D atlas) */
 typedef struct Builder1DPart_ {
 	VertexP3fT2fC4b* fVertices[FACE_COUNT];
@@ -42,11 +26,73 @@ typedef struct Builder1DPart_ {
 	Int32 sCount, sOffset, sAdvance;
 } Builder1DPart;
 
-/* Part builder data, for both normal and translucent parts.
-The first ATLAS1D_MAX_ATLASES parts are for normal parts, remainder are for translucent parts. */
-Builder1DPart Builder_Parts[ATLAS1D_MAX_ATLASES * 2];
-VertexP3fT2fC4b* Builder_Vertices;
-Int32 Builder_VerticesElems;
+/* Contains all the state needed to build the mesh of a single chunk.
+Each job has its own state, so multiple chunks can be meshed on different threads at once. */
+typedef struct BuilderState_ {
+	BlockID Chunk[EXTCHUNK_SIZE_3];
+	UInt8 Counts[CHUNK_SIZE_3 * FACE_COUNT];
+	/* Number of rows of faces merged along texture V axis. (only used by greedy builder) */
+	UInt8 RowCounts[CHUNK_SIZE_3 * FACE_COUNT];
+	/* Light heights of the 18x18 columns around the chunk. (snapshot of lighting heightmap) */
+	Int16 Heights[EXTCHUNK_SIZE_2];
+	/* Bit per X of blocks that are opaque full cubes, for each row along X axis of the 18x18x18 blocks. */
+	UInt32 OpaqueRows[EXTCHUNK_SIZE_2];
+	/* Bit per X of blocks that are not gas, for each row along X axis of the 18x18x18 blocks. */
+	UInt32 SolidRows[EXTCHUNK_SIZE_2];
+	/* Bit per X of blocks in the chunk that may have visible faces, for each row along X axis. */
+	UInt16 DrawRows[CHUNK_SIZE_2];
+	/* Bit per X of blocks in the chunk that have all faces hidden by neighbours, for each row along X axis. */
+	UInt16 HiddenRows[CHUNK_SIZE_2];
+	Int32 X1, Y1, Z1;
+	Int32 X, Y, Z;
+	BlockID Block;
+	Int32 ChunkIndex;
+	bool FullBright, Tinted;
+	Int32 ChunkEndX, ChunkEndZ;
+	Drawer Drawer;
+	/* Part builder data, for both normal and translucent parts.
+	The first ATLAS1D_MAX_ATLASES parts are for normal parts, remainder are for translucent parts. */
+	Builder1DPart Parts[ATLAS1D_MAX_ATLASES * 2];
+	VertexP3fT2fC4b* Vertices;
+	Int32 VerticesElems;
+	/* Block and whether in sunlight of each quad in Vertices, so colours can be changed without rebuilding the mesh. */
+	UInt16* Lights;
+	/* Flood fill state for calculating which faces of the chunk are connected. */
+	bool OcclusionVisited[CHUNK_SIZE_3];
+	UInt16 OcclusionQueue[CHUNK_SIZE_3];
+	UInt32 OcclusionFlags;
+} BuilderState;
+
+Int32 (*Builder_StretchXLiquid)(BuilderState* s, Int32 countIndex, Int32 x, Int32 y, Int32 z, Int32 chunkIndex, BlockID block);
+Int32 (*Builder_StretchX)(BuilderState* s, Int32 countIndex, Int32 x, Int32 y, Int32 z, Int32 chunkIndex, BlockID block, Face face);
+Int32 (*Builder_StretchZ)(BuilderState* s, Int32 countIndex, Int32 x, Int32 y, Int32 z, Int32 chunkIndex, BlockID block, Face face);
+void (*Builder_RenderBlock)(BuilderState* s, Int32 countsIndex);
+void (*Builder_PreStretchTiles)(BuilderState* s, Int32 x1, Int32 y1, Int32 z1);
+void (*Builder_PostStretchTiles)(BuilderState* s, Int32 x1, Int32 y1, Int32 z1);
+
+#define Builder_LightHeight(s, x, z) (s)->Heights[((z) - (s)->Z1 + 1) * EXTCHUNK_SIZE + ((x) - (s)->X1 + 1)]
+/* Whether the block at the given coordinates is fully in sunlight. Coordinates must be within chunk or its neighbours. */
+#define Builder_IsLit(s, x, y, z) ((y) > Builder_LightHeight(s, x, z))
+/* Set in light of a quad when the quad is in sunlight. Remaining bits are the block the quad belongs to. */
+#define BUILDER_QUAD_LIT 0x8000
+#define Builder_QuadLight(block, lit) (UInt16)((block) | ((lit) ? BUILDER_QUAD_LIT : 0))
+/* Records the light of the quad about to be drawn at the given vertices pointer. */
+#define Builder_SetQuadLight(s, vertices, block, lit) (s)->Lights[((vertices) - (s)->Vertices) >> 2] = Builder_QuadLight(block, lit)
+
+/* Colour of the given face of a block that is in sunlight or in shadow. (before tinting) */
+static PackedCol Builder_LightCol(Face face, bool lit) {
+	switch (face) {
+	case FACE_XMIN:
+	case FACE_XMAX:
+		return lit ? Lighting_OutsideXSide : Lighting_ShadowXSide;
+	case FACE_ZMIN:
+	case FACE_ZMAX:
+		return lit ? Lighting_OutsideZSide : Lighting_ShadowZSide;
+	case FACE_YMIN:
+		return lit ? Lighting_OutsideYBottom : Lighting_ShadowYBottom;
+	}
+	return lit ? Lighting_Outside : Lighting_Shadow;
+}
 
 static Int32 Builder1DPart_VerticesCount(Builder1DPart* part) {
 	Int32 i, count = part->sCount;
@@ -54,42 +100,94 @@ static Int32 Builder1DPart_VerticesCount(Builder1DPart* part) {
 	return count;
 }
 
-static void Builder1DPart_CalcOffsets(Builder1DPart* part, Int32* offset) {
+static void Builder1DPart_CalcOffsets(BuilderState* s, Builder1DPart* part, Int32* offset) {
 	Int32 pos = *offset, i;
 	part->sOffset = pos;
 	part->sAdvance = part->sCount >> 2;
 
 	pos += part->sCount;
 	for (i = 0; i < FACE_COUNT; i++) {
-		part->fVertices[i] = &Builder_Vertices[pos];
+		part->fVertices[i] = &s->Vertices[pos];
 		pos += part->fCount[i];
 	}
 	*offset = pos;
 }
 
-static Int32 Builder_TotalVerticesCount(void) {
+static Int32 Builder_TotalVerticesCount(BuilderState* s) {
 	Int32 i, count = 0;
 	for (i = 0; i < ATLAS1D_MAX_ATLASES * 2; i++) {
-		count += Builder1DPart_VerticesCount(&Builder_Parts[i]);
+		count += Builder1DPart_VerticesCount(&s->Parts[i]);
 	}
 	return count;
 }
 
 
-static void Builder_AddSpriteVertices(BlockID block) {
+static void Builder_AllocVertices(BuilderState* s, Int32 vertsCount) {
+	if (vertsCount <= s->VerticesElems) return;
+	Platform_MemFree(&s->Vertices);
+	Platform_MemFree(&s->Lights);
+	/* ensure buffer can be accessed with 64 bytes alignment by putting 2 extra vertices at end. */
+	s->Vertices = Platform_MemAlloc(vertsCount + 2, sizeof(VertexP3fT2fC4b));
+	s->Lights   = Platform_MemAlloc((vertsCount >> 2) + 1, sizeof(UInt16));
+	s->VerticesElems = vertsCount;
+
+	if (s->Vertices == NULL || s->Lights == NULL) {
+		ErrorHandler_Fail("Builder1DPart_Prepare - failed to allocate memory");
+	}
+}
+
+
+static void Builder_AddSpriteVertices(BuilderState* s, BlockID block) {
 	Int32 i = Atlas1D_Index(Block_GetTexLoc(block, FACE_XMIN));
-	Builder1DPart* part = &Builder_Parts[i];
+	Builder1DPart* part = &s->Parts[i];
 	part->sCount += 4 * 4;
 }
 
-static void Builder_AddVertices(BlockID block, Face face) {
+static void Builder_AddVertices(BuilderState* s, BlockID block, Face face) {
 	Int32 baseOffset = (Block_Draw[block] == DRAW_TRANSLUCENT) * ATLAS1D_MAX_ATLASES;
 	Int32 i = Atlas1D_Index(Block_GetTexLoc(block, face));
-	Builder1DPart* part = &Builder_Parts[baseOffset + i];
+	Builder1DPart* part = &s->Parts[baseOffset + i];
 	part->fCount[face] += 4;
 }
 
-static void Builder_SetPartInfo(Builder1DPart* part, Int32* offset, ChunkPartInfo* info, bool* hasParts) {
+#if CC_BUILD_COMPACTVERTEX
+#define BUILDER_VERTEX_FORMAT VERTEX_FORMAT_P3ST2FC4B
+#define Builder_UploadVertices(s) builder_compactVertices
+#define Builder_Compact(value, scale) (Int16)Math_Floor((value) * (scale) + 0.5f)
+/* Vertices of the mesh being uploaded, converted to compact format. Only used on the main thread. */
+VertexP3sT2fC4b* builder_compactVertices;
+Int32 builder_compactElems;
+
+/* Converts the vertices of the mesh to compact format, with positions relative to the chunk's origin. */
+static void Builder_CompactVertices(BuilderState* s, Int32 count) {
+	if (count > builder_compactElems) {
+		Platform_MemFree(&builder_compactVertices);
+		builder_compactVertices = Platform_MemAlloc(count + 1, sizeof(VertexP3sT2fC4b));
+		if (builder_compactVertices == NULL) ErrorHandler_Fail("Builder - failed to allocate compact vertices");
+		builder_compactElems = count;
+	}
+
+	Real32 x1 = (Real32)s->X1, y1 = (Real32)s->Y1, z1 = (Real32)s->Z1;
+	VertexP3fT2fC4b* src = s->Vertices;
+	VertexP3sT2fC4b* dst = builder_compactVertices;
+	Int32 i;
+
+	for (i = 0; i < count; i++, src++, dst++) {
+		dst->X = Builder_Compact(src->X - x1, VERTEXP3ST2FC4B_POS_SCALE);
+		dst->Y = Builder_Compact(src->Y - y1, VERTEXP3ST2FC4B_POS_SCALE);
+		dst->Z = Builder_Compact(src->Z - z1, VERTEXP3ST2FC4B_POS_SCALE);
+		dst->Pad = 0; dst->Col = src->Col;
+		dst->U = src->U; dst->V = src->V;
+	}
+	/* extra element, see Builder_UploadMesh */
+	Platform_MemSet(dst, 0, sizeof(VertexP3sT2fC4b));
+}
+#else
+#define BUILDER_VERTEX_FORMAT VERTEX_FORMAT_P3FT2FC4B
+#define Builder_UploadVertices(s) (s)->Vertices
+#endif
+
+static void Builder_SetPartInfo(BuilderState* s, Builder1DPart* part, Int32* offset, ChunkPartInfo* info, bool* hasParts) {
 	Int32 vCount = Builder1DPart_VerticesCount(part);
 	info->Offset = -1;
 	if (vCount == 0) return;
@@ -99,7 +197,7 @@ static void Builder_SetPartInfo(Builder1DPart* part, Int32* offset, ChunkPartInf
 	*hasParts = true;
 
 #if CC_BUILD_GL11
-	info->Vb = Gfx_CreateVb(&Builder_Vertices[info->Offset], VERTEX_FORMAT_P3FT2FC4B, vCount);
+	info->Vb = Gfx_CreateVb(&Builder_UploadVertices(s)[info->Offset], BUILDER_VERTEX_FORMAT, vCount);
 #endif
 
 	info->Counts[FACE_XMIN] = part->fCount[FACE_XMIN];
@@ -112,123 +210,123 @@ static void Builder_SetPartInfo(Builder1DPart* part, Int32* offset, ChunkPartInf
 }
 
 
-static void Builder_Stretch(Int32 x1, Int32 y1, Int32 z1) {
+static void Builder_Stretch(BuilderState* s, Int32 x1, Int32 y1, Int32 z1) {
 	Int32 xMax = min(World_Width,  x1 + CHUNK_SIZE);
 	Int32 yMax = min(World_Height, y1 + CHUNK_SIZE);
 	Int32 zMax = min(World_Length, z1 + CHUNK_SIZE);
-#if OCCLUSION
-	Int32 flags = ComputeOcclusion();
-#endif
-#if DEBUG_OCCLUSION
-	FastColour col = new FastColour(60, 60, 60, 255);
-	if (flags & 1) col.R = 255; // x
-	if (flags & 4) col.G = 255; // y
-	if (flags & 2) col.B = 255; // z
-	map.Sunlight = map.Shadowlight = col;
-	map.SunlightXSide = map.ShadowlightXSide = col;
-	map.SunlightZSide = map.ShadowlightZSide = col;
-	map.SunlightYBottom = map.ShadowlightYBottom = col;
-#endif
+	BlockID* chunk = s->Chunk;
+	UInt8* counts  = s->Counts;
 
 	Int32 x, y, z, xx, yy, zz;
 	for (y = y1, yy = 0; y < yMax; y++, yy++) {
 		for (z = z1, zz = 0; z < zMax; z++, zz++) {
+			Int32 row = (yy << 4) | zz;
+			UInt32 bits = s->HiddenRows[row];
+			/* Faces of hidden blocks must never be drawn or merged with */
+			for (xx = 0; bits != 0; xx++, bits >>= 1) {
+				if (!(bits & 1)) continue;
+				UInt8* faces = &counts[((row << 4) | xx) * FACE_COUNT];
+				faces[FACE_XMIN] = 0; faces[FACE_XMAX] = 0; faces[FACE_ZMIN] = 0;
+				faces[FACE_ZMAX] = 0; faces[FACE_YMIN] = 0; faces[FACE_YMAX] = 0;
+			}
+
+			bits = s->DrawRows[row];
 			Int32 cIndex = (yy + 1) * EXTCHUNK_SIZE_2 + (zz + 1) * EXTCHUNK_SIZE + (-1 + 1);
-			for (x = x1, xx = 0; x < xMax; x++, xx++) {
+			for (x = x1, xx = 0; bits != 0 && x < xMax; x++, xx++, bits >>= 1) {
 				cIndex++;
-				BlockID b = Builder_Chunk[cIndex];
-				if (Block_Draw[b] == DRAW_GAS) continue;
+				if (!(bits & 1)) continue;
+				BlockID b = chunk[cIndex];
 				Int32 index = ((yy << 8) | (zz << 4) | xx) * FACE_COUNT;
 
 				/* Sprites only use one face to indicate stretching count, so we can take a shortcut here.
 				Note that sprites are not drawn with any of the DrawXFace, they are drawn using DrawSprite. */
 				if (Block_Draw[b] == DRAW_SPRITE) {
 					index += FACE_YMAX;
-					if (Builder_Counts[index]) {
-						Builder_X = x; Builder_Y = y; Builder_Z = z;
-						Builder_AddSpriteVertices(b);
-						Builder_Counts[index] = 1;
+					if (counts[index]) {
+						s->X = x; s->Y = y; s->Z = z;
+						Builder_AddSpriteVertices(s, b);
+						counts[index] = 1;
 					}
 					continue;
 				}
 
-				Builder_X = x; Builder_Y = y; Builder_Z = z;
-				Builder_FullBright = Block_FullBright[b];
+				s->X = x; s->Y = y; s->Z = z;
+				s->FullBright = Block_FullBright[b];
 				UInt32 tileIdx = b * BLOCK_COUNT;
 				/* All of these function calls are inlined as they can be called tens of millions to hundreds of millions of times. */
 
-				if (Builder_Counts[index] == 0 ||
+				if (counts[index] == 0 ||
 					(x == 0 && (y < Builder_SidesLevel || (b >= BLOCK_WATER && b <= BLOCK_STILL_LAVA && y < Builder_EdgeLevel))) ||
-					(x != 0 && (Block_Hidden[tileIdx + Builder_Chunk[cIndex - 1]] & (1 << FACE_XMIN)) != 0)) {
-					Builder_Counts[index] = 0;
+					(x != 0 && (Block_Hidden[tileIdx + chunk[cIndex - 1]] & (1 << FACE_XMIN)) != 0)) {
+					counts[index] = 0;
 				} else {
-					Int32 count = Builder_StretchZ(index, x, y, z, cIndex, b, FACE_XMIN);
-					Builder_AddVertices(b, FACE_XMIN);
-					Builder_Counts[index] = (UInt8)count;
+					Int32 count = Builder_StretchZ(s, index, x, y, z, cIndex, b, FACE_XMIN);
+					Builder_AddVertices(s, b, FACE_XMIN);
+					counts[index] = (UInt8)count;
 				}
 
 				index++;
-				if (Builder_Counts[index] == 0 ||
+				if (counts[index] == 0 ||
 					(x == World_MaxX && (y < Builder_SidesLevel || (b >= BLOCK_WATER && b <= BLOCK_STILL_LAVA && y < Builder_EdgeLevel))) ||
-					(x != World_MaxX && (Block_Hidden[tileIdx + Builder_Chunk[cIndex + 1]] & (1 << FACE_XMAX)) != 0)) {
-					Builder_Counts[index] = 0;
+					(x != World_MaxX && (Block_Hidden[tileIdx + chunk[cIndex + 1]] & (1 << FACE_XMAX)) != 0)) {
+					counts[index] = 0;
 				} else {
-					Int32 count = Builder_StretchZ(index, x, y, z, cIndex, b, FACE_XMAX);
-					Builder_AddVertices(b, FACE_XMAX);
-					Builder_Counts[index] = (UInt8)count;
+					Int32 count = Builder_StretchZ(s, index, x, y, z, cIndex, b, FACE_XMAX);
+					Builder_AddVertices(s, b, FACE_XMAX);
+					counts[index] = (UInt8)count;
 				}
 
 				index++;
-				if (Builder_Counts[index] == 0 ||
+				if (counts[index] == 0 ||
 					(z == 0 && (y < Builder_SidesLevel || (b >= BLOCK_WATER && b <= BLOCK_STILL_LAVA && y < Builder_EdgeLevel))) ||
-					(z != 0 && (Block_Hidden[tileIdx + Builder_Chunk[cIndex - EXTCHUNK_SIZE]] & (1 << FACE_ZMIN)) != 0)) {
-					Builder_Counts[index] = 0;
+					(z != 0 && (Block_Hidden[tileIdx + chunk[cIndex - EXTCHUNK_SIZE]] & (1 << FACE_ZMIN)) != 0)) {
+					counts[index] = 0;
 				} else {
-					Int32 count = Builder_StretchX(index, Builder_X, Builder_Y, Builder_Z, cIndex, b, FACE_ZMIN);
-					Builder_AddVertices(b, FACE_ZMIN);
-					Builder_Counts[index] = (UInt8)count;
+					Int32 count = Builder_StretchX(s, index, s->X, s->Y, s->Z, cIndex, b, FACE_ZMIN);
+					Builder_AddVertices(s, b, FACE_ZMIN);
+					counts[index] = (UInt8)count;
 				}
 
 				index++;
-				if (Builder_Counts[index] == 0 ||
+				if (counts[index] == 0 ||
 					(z == World_MaxZ && (y < Builder_SidesLevel || (b >= BLOCK_WATER && b <= BLOCK_STILL_LAVA && y < Builder_EdgeLevel))) ||
-					(z != World_MaxZ && (Block_Hidden[tileIdx + Builder_Chunk[cIndex + EXTCHUNK_SIZE]] & (1 << FACE_ZMAX)) != 0)) {
-					Builder_Counts[index] = 0;
+					(z != World_MaxZ && (Block_Hidden[tileIdx + chunk[cIndex + EXTCHUNK_SIZE]] & (1 << FACE_ZMAX)) != 0)) {
+					counts[index] = 0;
 				} else {
-					Int32 count = Builder_StretchX(index, x, y, z, cIndex, b, FACE_ZMAX);
-					Builder_AddVertices(b, FACE_ZMAX);
-					Builder_Counts[index] = (UInt8)count;
+					Int32 count = Builder_StretchX(s, index, x, y, z, cIndex, b, FACE_ZMAX);
+					Builder_AddVertices(s, b, FACE_ZMAX);
+					counts[index] = (UInt8)count;
 				}
 
 				index++;
-				if (Builder_Counts[index] == 0 || y == 0 ||
-					(Block_Hidden[tileIdx + Builder_Chunk[cIndex - EXTCHUNK_SIZE_2]] & (1 << FACE_YMIN)) != 0) {
-					Builder_Counts[index] = 0;
+				if (counts[index] == 0 || y == 0 ||
+					(Block_Hidden[tileIdx + chunk[cIndex - EXTCHUNK_SIZE_2]] & (1 << FACE_YMIN)) != 0) {
+					counts[index] = 0;
 				} else {
-					Int32 count = Builder_StretchX(index, x, y, z, cIndex, b, FACE_YMIN);
-					Builder_AddVertices(b, FACE_YMIN);
-					Builder_Counts[index] = (UInt8)count;
+					Int32 count = Builder_StretchX(s, index, x, y, z, cIndex, b, FACE_YMIN);
+					Builder_AddVertices(s, b, FACE_YMIN);
+					counts[index] = (UInt8)count;
 				}
 
 				index++;
-				if (Builder_Counts[index] == 0 ||
-					(Block_Hidden[tileIdx + Builder_Chunk[cIndex + EXTCHUNK_SIZE_2]] & (1 << FACE_YMAX)) != 0) {
-					Builder_Counts[index] = 0;
+				if (counts[index] == 0 ||
+					(Block_Hidden[tileIdx + chunk[cIndex + EXTCHUNK_SIZE_2]] & (1 << FACE_YMAX)) != 0) {
+					counts[index] = 0;
 				} else if (b < BLOCK_WATER || b > BLOCK_STILL_LAVA) {
-					Int32 count = Builder_StretchX(index, x, y, z, cIndex, b, FACE_YMAX);
-					Builder_AddVertices(b, FACE_YMAX);
-					Builder_Counts[index] = (UInt8)count;
+					Int32 count = Builder_StretchX(s, index, x, y, z, cIndex, b, FACE_YMAX);
+					Builder_AddVertices(s, b, FACE_YMAX);
+					counts[index] = (UInt8)count;
 				} else {
-					Int32 count = Builder_StretchXLiquid(index, x, y, z, cIndex, b);
-					if (count > 0) Builder_AddVertices(b, FACE_YMAX);
-					Builder_Counts[index] = (UInt8)count;
+					Int32 count = Builder_StretchXLiquid(s, index, x, y, z, cIndex, b);
+					if (count > 0) Builder_AddVertices(s, b, FACE_YMAX);
+					counts[index] = (UInt8)count;
 				}
 			}
 		}
 	}
 }
 
-static void Builder_ReadChunkData(Int32 x1, Int32 y1, Int32 z1, bool* outAllAir, bool* outAllSolid) {
+static void Builder_ReadChunkData(BuilderState* s, Int32 x1, Int32 y1, Int32 z1, bool* outAllAir, bool* outAllSolid) {
 	bool allAir = true, allSolid = true;
 	Int32 xx, yy, zz;
 
@@ -257,7 +355,7 @@ static void Builder_ReadChunkData(Int32 x1, Int32 y1, Int32 z1, bool* outAllAir,
 
 				allAir = allAir && Block_Draw[rawBlock] == DRAW_GAS;
 				allSolid = allSolid && Block_FullOpaque[rawBlock];
-				Builder_Chunk[chunkIndex] = rawBlock;
+				s->Chunk[chunkIndex] = rawBlock;
 			}
 		}
 	}
@@ -266,74 +364,164 @@ static void Builder_ReadChunkData(Int32 x1, Int32 y1, Int32 z1, bool* outAllAir,
 	*outAllSolid = allSolid;
 }
 
-static bool Builder_BuildChunk(Int32 x1, Int32 y1, Int32 z1, bool* allAir) {
-	Builder_PreStretchTiles(x1, y1, z1);
-	BlockID chunk[EXTCHUNK_SIZE_3]; Builder_Chunk = chunk;
-	UInt8 counts[CHUNK_SIZE_3 * FACE_COUNT]; Builder_Counts = counts;
-	Int32 bitFlags[EXTCHUNK_SIZE_3]; Builder_BitFlags = bitFlags;
+#define Builder_FloodNeighbour(inChunk, next, face)\
+if (!(inChunk)) {\
+	faces |= 1 << (face);\
+} else if (!visited[next]) {\
+	visited[next] = true; queue[tail++] = (UInt16)(next);\
+}
+
+/* Flood fills through the non-opaque blocks of the chunk, to find which faces of the chunk can be seen from each other. */
+static UInt32 Builder_ComputeOcclusion(BuilderState* s) {
+	bool* visited = s->OcclusionVisited;
+	UInt16* queue = s->OcclusionQueue;
+	UInt32 flags = 0;
+	Int32 i, xx, yy, zz, a, b;
+
+	for (i = 0; i < CHUNK_SIZE_3; i++) {
+		xx = i & 0x0F; zz = (i >> 4) & 0x0F; yy = i >> 8;
+		BlockID block = s->Chunk[(yy + 1) * EXTCHUNK_SIZE_2 + (zz + 1) * EXTCHUNK_SIZE + (xx + 1)];
+		visited[i] = Block_FullOpaque[block];
+	}
+
+	for (i = 0; i < CHUNK_SIZE_3; i++) {
+		if (visited[i]) continue;
+		Int32 head = 0, tail = 0, faces = 0;
+		visited[i] = true; queue[tail++] = (UInt16)i;
+
+		while (head < tail) {
+			Int32 cur = queue[head++];
+			xx = cur & 0x0F; zz = (cur >> 4) & 0x0F; yy = cur >> 8;
+
+			Builder_FloodNeighbour(xx > 0,         cur - 1,            FACE_XMIN);
+			Builder_FloodNeighbour(xx < CHUNK_MAX, cur + 1,            FACE_XMAX);
+			Builder_FloodNeighbour(zz > 0,         cur - CHUNK_SIZE,   FACE_ZMIN);
+			Builder_FloodNeighbour(zz < CHUNK_MAX, cur + CHUNK_SIZE,   FACE_ZMAX);
+			Builder_FloodNeighbour(yy > 0,         cur - CHUNK_SIZE_2, FACE_YMIN);
+			Builder_FloodNeighbour(yy < CHUNK_MAX, cur + CHUNK_SIZE_2, FACE_YMAX);
+		}
+
+		/* All faces touched by this region of blocks can be seen from each other */
+		for (a = 0; a < FACE_COUNT; a++) {
+			if (!(faces & (1 << a))) continue;
+			for (b = a + 1; b < FACE_COUNT; b++) {
+				if (faces & (1 << b)) flags |= OCCLUSION_PAIR(a, b);
+			}
+		}
+	}
+	return flags;
+}
+
+/* Calculates bit masks of which blocks are opaque full cubes, and which blocks are not gas, for each row
+of blocks along the X axis. An opaque full cube entirely surrounded by opaque full cubes has all of its
+faces hidden, so these blocks can be found with a few bitwise operations per row and skipped entirely. */
+static void Builder_CalcRowMasks(BuilderState* s) {
+	UInt32* opaque = s->OpaqueRows;
+	UInt32* solid  = s->SolidRows;
+	Int32 xx, yy, zz, row, cIndex = 0;
+
+	for (row = 0; row < EXTCHUNK_SIZE_2; row++) {
+		UInt32 opaqueBits = 0, solidBits = 0;
+		for (xx = 0; xx < EXTCHUNK_SIZE; xx++, cIndex++) {
+			BlockID b = s->Chunk[cIndex];
+			/* Liquids are treated differently by Block_Hidden, so are not included */
+			if (Block_FullOpaque[b] && !Block_IsLiquid[b]) opaqueBits |= 1UL << xx;
+			if (Block_Draw[b] != DRAW_GAS) solidBits |= 1UL << xx;
+		}
+		opaque[row] = opaqueBits; solid[row] = solidBits;
+	}
+
+	for (yy = 0; yy < CHUNK_SIZE; yy++) {
+		for (zz = 0; zz < CHUNK_SIZE; zz++) {
+			row = (yy + 1) * EXTCHUNK_SIZE + (zz + 1);
+			UInt32 cur = opaque[row];
+			UInt32 hidden = cur & (cur << 1) & (cur >> 1)
+				& opaque[row - 1] & opaque[row + 1] & opaque[row - EXTCHUNK_SIZE] & opaque[row + EXTCHUNK_SIZE];
+
+			/* Shift by 1 as first bit in each row is for the block just outside the chunk */
+			UInt32 drawn = solid[row] >> 1;
+			hidden >>= 1;
+			s->DrawRows[(yy << 4) | zz]   = (UInt16)(drawn & ~hidden);
+			s->HiddenRows[(yy << 4) | zz] = (UInt16)(drawn & hidden);
+		}
+	}
+}
 
-	Platform_MemSet(chunk, BLOCK_AIR, EXTCHUNK_SIZE_3 * sizeof(BlockID));
+/* Copies the blocks and lighting of the chunk into the given state. Must be called on the main thread.
+Returns false if the chunk does not need a mesh. (i.e. it is entirely air, or entirely hidden solid blocks) */
+static bool Builder_PrepareChunk(BuilderState* s, Int32 x1, Int32 y1, Int32 z1, bool* allAir) {
+	s->X1 = x1; s->Y1 = y1; s->Z1 = z1;
+	Platform_MemSet(s->Chunk, BLOCK_AIR, EXTCHUNK_SIZE_3 * sizeof(BlockID));
 	bool allSolid;
-	Builder_ReadChunkData(x1, y1, z1, allAir, &allSolid);
+	Builder_ReadChunkData(s, x1, y1, z1, allAir, &allSolid);
 
 	if (x1 == 0 || y1 == 0 || z1 == 0 || x1 + CHUNK_SIZE >= World_Width ||
 		y1 + CHUNK_SIZE >= World_Height || z1 + CHUNK_SIZE >= World_Length) allSolid = false;
 
 	if (*allAir || allSolid) return false;
 	Lighting_LightHint(x1 - 1, z1 - 1);
+	Lighting_CopyHeights(x1 - 1, z1 - 1, s->Heights);
+	return true;
+}
 
-	Platform_MemSet(counts, 1, CHUNK_SIZE_3 * FACE_COUNT);
+/* Builds the mesh of a chunk previously prepared by Builder_PrepareChunk. Safe to call on any thread. */
+static void Builder_BuildMesh(BuilderState* s) {
+	Int32 x1 = s->X1, y1 = s->Y1, z1 = s->Z1;
+	s->OcclusionFlags = Builder_ComputeOcclusion(s);
+	Builder_CalcRowMasks(s);
+	Builder_PreStretchTiles(s, x1, y1, z1);
+
+	Platform_MemSet(s->Counts, 1, CHUNK_SIZE_3 * FACE_COUNT);
 	Int32 xMax = min(World_Width, x1 + CHUNK_SIZE);
 	Int32 yMax = min(World_Height, y1 + CHUNK_SIZE);
 	Int32 zMax = min(World_Length, z1 + CHUNK_SIZE);
 
-	Builder_ChunkEndX = xMax; Builder_ChunkEndZ = zMax;
-	Builder_Stretch(x1, y1, z1);
-	Builder_PostStretchTiles(x1, y1, z1);
+	s->ChunkEndX = xMax; s->ChunkEndZ = zMax;
+	Builder_Stretch(s, x1, y1, z1);
+	Builder_PostStretchTiles(s, x1, y1, z1);
 	Int32 x, y, z, xx, yy, zz;
 
 	for (y = y1, yy = 0; y < yMax; y++, yy++) {
 		for (z = z1, zz = 0; z < zMax; z++, zz++) {
 
+			UInt32 bits = s->DrawRows[(yy << 4) | zz];
 			Int32 chunkIndex = (yy + 1) * EXTCHUNK_SIZE_2 + (zz + 1) * EXTCHUNK_SIZE + (0 + 1);
-			for (x = x1, xx = 0; x < xMax; x++, xx++) {
-				Builder_Block = chunk[chunkIndex];
-				if (Block_Draw[Builder_Block] != DRAW_GAS) {
+			for (x = x1, xx = 0; bits != 0 && x < xMax; x++, xx++, bits >>= 1) {
+				if (bits & 1) {
+					s->Block = s->Chunk[chunkIndex];
 					Int32 index = ((yy << 8) | (zz << 4) | xx) * FACE_COUNT;
-					Builder_X = x; Builder_Y = y; Builder_Z = z;
-					Builder_ChunkIndex = chunkIndex;
-					Builder_RenderBlock(index);
+					s->X = x; s->Y = y; s->Z = z;
+					s->ChunkIndex = chunkIndex;
+					Builder_RenderBlock(s, index);
 				}
 				chunkIndex++;
 			}
 		}
 	}
-	return true;
 }
 
-void Builder_MakeChunk(ChunkInfo* info) {
-	Int32 x = info->CentreX - 8, y = info->CentreY - 8, z = info->CentreZ - 8;
-	bool allAir = false, hasMesh;
-	hasMesh = Builder_BuildChunk(x, y, z, &allAir);
-	info->AllAir = allAir;
-	if (!hasMesh) return;
-
-	Int32 totalVerts = Builder_TotalVerticesCount();
+/* Uploads the built mesh to the GPU, and assigns it to the given chunk. Must be called on the main thread. */
+static void Builder_UploadMesh(BuilderState* s, ChunkInfo* info) {
+	info->OcclusionFlags = s->OcclusionFlags;
+	Int32 totalVerts = Builder_TotalVerticesCount(s);
 	if (totalVerts == 0) return;
+#if CC_BUILD_COMPACTVERTEX
+	Builder_CompactVertices(s, totalVerts);
+#endif
 #if !CC_BUILD_GL11
 	/* add an extra element to fix crashing on some GPUs */
-	info->Vb = Gfx_CreateVb(Builder_Vertices, VERTEX_FORMAT_P3FT2FC4B, totalVerts + 1);
+	info->Vb = Gfx_CreateVb(Builder_UploadVertices(s), BUILDER_VERTEX_FORMAT, totalVerts + 1);
 #endif
 
-	Int32 i, offset = 0, partsIndex = MapRenderer_Pack(x >> CHUNK_SHIFT, y >> CHUNK_SHIFT, z >> CHUNK_SHIFT);
+	Int32 i, offset = 0, partsIndex = MapRenderer_Pack(s->X1 >> CHUNK_SHIFT, s->Y1 >> CHUNK_SHIFT, s->Z1 >> CHUNK_SHIFT);
 	bool hasNormal = false, hasTranslucent = false;
 
 	for (i = 0; i < MapRenderer_1DUsedCount; i++) {
 		Int32 j = i + ATLAS1D_MAX_ATLASES;
 		Int32 curIdx = partsIndex + i * MapRenderer_ChunksCount;
 
-		Builder_SetPartInfo(&Builder_Parts[i], &offset, &MapRenderer_PartsNormal[curIdx],      &hasNormal);
-		Builder_SetPartInfo(&Builder_Parts[j], &offset, &MapRenderer_PartsTranslucent[curIdx], &hasTranslucent);
+		Builder_SetPartInfo(s, &s->Parts[i], &offset, &MapRenderer_PartsNormal[curIdx],      &hasNormal);
+		Builder_SetPartInfo(s, &s->Parts[j], &offset, &MapRenderer_PartsTranslucent[curIdx], &hasTranslucent);
 	}
 
 	if (hasNormal) {
@@ -342,54 +530,388 @@ void Builder_MakeChunk(ChunkInfo* info) {
 	if (hasTranslucent) {
 		info->TranslucentParts = &MapRenderer_PartsTranslucent[partsIndex];
 	}
+}
 
-#if OCCLUSION
-	if (info.NormalParts != null || info.TranslucentParts != null)
-		info.occlusionFlags = (UInt8)ComputeOcclusion();
-#endif
+BuilderState builder_mainState;
+
+
+/*########################################################################################################################*
+*-------------------------------------------------------Mesh cache--------------------------------------------------------*
+*#########################################################################################################################*/
+/* Vertex counts of a cached part, see Builder1DPart */
+typedef struct BuilderCachedPart_ {
+	Int32 fCount[FACE_COUNT];
+	Int32 sCount;
+} BuilderCachedPart;
+
+/* Copy of the built mesh of a chunk. Allocated as a single block of memory, which is followed by
+PartsCount normal parts, then PartsCount translucent parts, then VerticesCount vertices, then the light of each quad. */
+typedef struct BuilderCacheEntry_ {
+	struct BuilderCacheEntry_* Prev; /* More recently used entry */
+	struct BuilderCacheEntry_* Next; /* Less recently used entry */
+	Int32 ChunkIndex;
+	UInt32 Version; /* Mesh version of the chunk when this mesh was built */
+	UInt32 Colours; /* Value of builder_coloursVersion when this mesh was last coloured */
+	UInt32 OcclusionFlags;
+	Int32 PartsCount, VerticesCount;
+} BuilderCacheEntry;
+
+typedef struct BuilderCacheSlot_ {
+	BuilderCacheEntry* Entry;
+	/* Incremented whenever the chunk's mesh becomes outdated, so meshes built from older data are not cached. */
+	UInt32 Version;
+} BuilderCacheSlot;
+
+/* Cached mesh and mesh version of each chunk in the world. */
+BuilderCacheSlot* builder_cache;
+/* Most and least recently used cache entries. */
+BuilderCacheEntry* builder_cacheHead;
+BuilderCacheEntry* builder_cacheTail;
+Int32 builder_cacheVertices;
+/* Incremented whenever sun or shadow colour changes. Cached meshes are only recoloured when next uploaded. */
+UInt32 builder_coloursVersion;
+
+#define Builder_ChunkIndex(info) MapRenderer_Pack((info)->CentreX >> CHUNK_SHIFT, (info)->CentreY >> CHUNK_SHIFT, (info)->CentreZ >> CHUNK_SHIFT)
+#define Builder_ChunkVersion(index) (builder_cache == NULL ? 0 : builder_cache[index].Version)
+#define BuilderCacheEntry_Parts(entry) ((BuilderCachedPart*)((entry) + 1))
+#define BuilderCacheEntry_Vertices(entry) ((VertexP3fT2fC4b*)(BuilderCacheEntry_Parts(entry) + (entry)->PartsCount * 2))
+#define BuilderCacheEntry_Lights(entry) ((UInt16*)(BuilderCacheEntry_Vertices(entry) + (entry)->VerticesCount))
+
+static void Builder_CacheUnlink(BuilderCacheEntry* entry) {
+	if (entry->Prev != NULL) { entry->Prev->Next = entry->Next; } else { builder_cacheHead = entry->Next; }
+	if (entry->Next != NULL) { entry->Next->Prev = entry->Prev; } else { builder_cacheTail = entry->Prev; }
 }
 
-static bool Builder_OccludedLiquid(Int32 chunkIndex) {
-	chunkIndex += EXTCHUNK_SIZE_2; /* Checking y above */
-	return
-		Block_FullOpaque[Builder_Chunk[chunkIndex]]
-		&& Block_Draw[Builder_Chunk[chunkIndex - EXTCHUNK_SIZE]] != DRAW_GAS
-		&& Block_Draw[Builder_Chunk[chunkIndex - 1]] != DRAW_GAS
-		&& Block_Draw[Builder_Chunk[chunkIndex + 1]] != DRAW_GAS
-		&& Block_Draw[Builder_Chunk[chunkIndex + EXTCHUNK_SIZE]] != DRAW_GAS;
+static void Builder_CacheLinkFront(BuilderCacheEntry* entry) {
+	entry->Prev = NULL;
+	entry->Next = builder_cacheHead;
+	if (builder_cacheHead != NULL) { builder_cacheHead->Prev = entry; } else { builder_cacheTail = entry; }
+	builder_cacheHead = entry;
 }
 
-static void Builder_DefaultPreStretchTiles(Int32 x1, Int32 y1, Int32 z1) {
-	Platform_MemSet(Builder_Parts, 0, sizeof(Builder_Parts));
+static void Builder_CacheRemove(BuilderCacheEntry* entry) {
+	Builder_CacheUnlink(entry);
+	builder_cache[entry->ChunkIndex].Entry = NULL;
+	builder_cacheVertices -= entry->VerticesCount;
+	Platform_MemFree(&entry);
+}
+
+/* Stores a copy of the mesh just built for the given chunk, evicting least recently used meshes if necessary. */
+static void Builder_CacheStore(BuilderState* s, Int32 index, UInt32 version) {
+	if (builder_cache == NULL || builder_cache[index].Version != version) return;
+	Int32 i, vertsCount = Builder_TotalVerticesCount(s);
+	if (vertsCount == 0 || vertsCount > BUILDER_CACHE_MAX_VERTICES) return;
+
+	if (builder_cache[index].Entry != NULL) Builder_CacheRemove(builder_cache[index].Entry);
+	while (builder_cacheVertices + vertsCount > BUILDER_CACHE_MAX_VERTICES) {
+		Builder_CacheRemove(builder_cacheTail);
+	}
+
+	Int32 partsCount = MapRenderer_1DUsedCount;
+	UInt32 size = sizeof(BuilderCacheEntry) + partsCount * 2 * sizeof(BuilderCachedPart)
+		+ vertsCount * sizeof(VertexP3fT2fC4b) + (vertsCount >> 2) * sizeof(UInt16);
+	/* Cache is only an optimisation, so just rebuild the chunk later if out of memory */
+	BuilderCacheEntry* entry = Platform_MemAlloc(size, 1);
+	if (entry == NULL) return;
+
+	entry->ChunkIndex = index; entry->Version = version;
+	entry->Colours = builder_coloursVersion;
+	entry->OcclusionFlags = s->OcclusionFlags;
+	entry->PartsCount = partsCount; entry->VerticesCount = vertsCount;
+
+	BuilderCachedPart* parts = BuilderCacheEntry_Parts(entry);
+	for (i = 0; i < partsCount * 2; i++) {
+		Builder1DPart* part = &s->Parts[i < partsCount ? i : (i - partsCount) + ATLAS1D_MAX_ATLASES];
+		Platform_MemCpy(parts[i].fCount, part->fCount, sizeof(part->fCount));
+		parts[i].sCount = part->sCount;
+	}
+	Platform_MemCpy(BuilderCacheEntry_Vertices(entry), s->Vertices, vertsCount * sizeof(VertexP3fT2fC4b));
+	Platform_MemCpy(BuilderCacheEntry_Lights(entry), s->Lights, (vertsCount >> 2) * sizeof(UInt16));
+
+	builder_cache[index].Entry = entry;
+	builder_cacheVertices += vertsCount;
+	Builder_CacheLinkFront(entry);
 }
 
-static void Builder_DefaultPostStretchTiles(Int32 x1, Int32 y1, Int32 z1) {
-	Int32 i, vertsCount = Builder_TotalVerticesCount();
-	if (vertsCount > Builder_VerticesElems) {
-		Platform_MemFree(&Builder_Vertices);
-		/* ensure buffer can be accessed with 64 bytes alignment by putting 2 extra vertices at end. */
-		Builder_Vertices = Platform_MemAlloc(vertsCount + 2, sizeof(VertexP3fT2fC4b));
-		Builder_VerticesElems = vertsCount;
+/* Sets the colour of each of the given quads, based on their face, light and block. */
+static void Builder_RecolourQuads(VertexP3fT2fC4b** vertices, UInt16** lights, Int32 count, Face face) {
+	VertexP3fT2fC4b* v = *vertices;
+	UInt16* light = *lights;
+	PackedCol white = PACKEDCOL_WHITE;
+	Int32 i;
 
-		if (Builder_Vertices == NULL) {
-			ErrorHandler_Fail("Builder1DPart_Prepare - failed to allocate memory");
+	for (i = 0; i < count; i += 4, v += 4, light++) {
+		BlockID block = (BlockID)(*light & ~BUILDER_QUAD_LIT);
+		PackedCol col = Block_FullBright[block] ? white : Builder_LightCol(face, (*light & BUILDER_QUAD_LIT) != 0);
+		Block_Tint(col, block);
+		v[0].Col = col; v[1].Col = col; v[2].Col = col; v[3].Col = col;
+	}
+	*vertices = v; *lights = light;
+}
+
+static void Builder_RecolourEntry(BuilderCacheEntry* entry) {
+	BuilderCachedPart* parts = BuilderCacheEntry_Parts(entry);
+	VertexP3fT2fC4b* vertices = BuilderCacheEntry_Vertices(entry);
+	UInt16* lights = BuilderCacheEntry_Lights(entry);
+	Int32 i, j, partsCount = entry->PartsCount;
+	Face face;
+
+	for (i = 0; i < partsCount; i++) {
+		/* Vertices of normal and translucent parts are interleaved, see Builder_DefaultPostStretchTiles */
+		for (j = i; j < partsCount * 2; j += partsCount) {
+			/* Sprites are lit like top faces */
+			Builder_RecolourQuads(&vertices, &lights, parts[j].sCount, FACE_YMAX);
+			for (face = 0; face < FACE_COUNT; face++) {
+				Builder_RecolourQuads(&vertices, &lights, parts[j].fCount[face], face);
+			}
 		}
 	}
+}
 
-	vertsCount = 0;
-	for (i = 0; i < ATLAS1D_MAX_ATLASES; i++) {
-		Int32 j = i + ATLAS1D_MAX_ATLASES;
-		Builder1DPart_CalcOffsets(&Builder_Parts[i], &vertsCount);
-		Builder1DPart_CalcOffsets(&Builder_Parts[j], &vertsCount);
+void Builder_RecolourCache(void) {
+	builder_coloursVersion++;
+}
+
+/* Uploads the cached mesh of the given chunk to the GPU. Returns false if the chunk has no cached mesh. */
+static bool Builder_UploadCached(ChunkInfo* info, Int32 index) {
+	if (builder_cache == NULL) return false;
+	BuilderCacheEntry* entry = builder_cache[index].Entry;
+	if (entry == NULL) return false;
+	/* Parts layout of the cached mesh is no longer valid */
+	if (entry->PartsCount != MapRenderer_1DUsedCount) { Builder_CacheRemove(entry); return false; }
+	if (entry->Colours != builder_coloursVersion) {
+		Builder_RecolourEntry(entry);
+		entry->Colours = builder_coloursVersion;
+	}
+
+	BuilderState* s = &builder_mainState;
+	BuilderCachedPart* parts = BuilderCacheEntry_Parts(entry);
+	Int32 i, partsCount = entry->PartsCount;
+	Platform_MemSet(s->Parts, 0, sizeof(s->Parts));
+
+	for (i = 0; i < partsCount * 2; i++) {
+		Builder1DPart* part = &s->Parts[i < partsCount ? i : (i - partsCount) + ATLAS1D_MAX_ATLASES];
+		Platform_MemCpy(part->fCount, parts[i].fCount, sizeof(part->fCount));
+		part->sCount = parts[i].sCount;
 	}
+
+	Builder_AllocVertices(s, entry->VerticesCount);
+	Platform_MemCpy(s->Vertices, BuilderCacheEntry_Vertices(entry), entry->VerticesCount * sizeof(VertexP3fT2fC4b));
+	s->X1 = info->CentreX - 8; s->Y1 = info->CentreY - 8; s->Z1 = info->CentreZ - 8;
+	s->OcclusionFlags = entry->OcclusionFlags;
+
+	ChunkUpdater_DeleteChunk(info);
+	Builder_UploadMesh(s, info);
+	Builder_CacheUnlink(entry);
+	Builder_CacheLinkFront(entry);
+	return true;
+}
+
+void Builder_InvalidateChunk(Int32 index) {
+	if (builder_cache == NULL) return;
+	builder_cache[index].Version++;
+	if (builder_cache[index].Entry != NULL) Builder_CacheRemove(builder_cache[index].Entry);
+}
+
+void Builder_ClearCache(void) {
+	while (builder_cacheTail != NULL) {
+		Builder_CacheRemove(builder_cacheTail);
+	}
+}
+
+void Builder_MakeChunk(ChunkInfo* info) {
+	Int32 index = Builder_ChunkIndex(info);
+	if (Builder_UploadCached(info, index)) return;
+	ChunkUpdater_DeleteChunk(info);
+
+	Int32 x = info->CentreX - 8, y = info->CentreY - 8, z = info->CentreZ - 8;
+	bool allAir = false, hasMesh;
+	hasMesh = Builder_PrepareChunk(&builder_mainState, x, y, z, &allAir);
+	info->AllAir = allAir;
+	if (!hasMesh) {
+		/* Can see through all faces of an air chunk, but none of a chunk completely filled with solid blocks */
+		if (!allAir) info->OcclusionFlags = 0;
+		return;
+	}
+
+	Builder_BuildMesh(&builder_mainState);
+	Builder_UploadMesh(&builder_mainState, info);
+	Builder_CacheStore(&builder_mainState, index, Builder_ChunkVersion(index));
 }
 
-Random spriteRng;
-static void Builder_DrawSprite(Int32 count) {
-	TextureLoc texLoc = Block_GetTexLoc(Builder_Block, FACE_XMAX);
+
+/*########################################################################################################################*
+*---------------------------------------------------Background building---------------------------------------------------*
+*#########################################################################################################################*/
+typedef struct BuilderJob_ {
+	BuilderState State;
+	ChunkInfo* Info;
+	UInt32 Version; /* Mesh version of the chunk when job was queued */
+} BuilderJob;
+
+typedef struct BuilderJobQueue_ {
+	BuilderJob* Jobs[BUILDER_MAX_JOBS];
+	Int32 Head, Count;
+} BuilderJobQueue;
+
+static void BuilderJobQueue_Enqueue(BuilderJobQueue* queue, BuilderJob* job) {
+	if (queue->Count == BUILDER_MAX_JOBS) ErrorHandler_Fail("Builder - job queue overflow");
+	queue->Jobs[(queue->Head + queue->Count) % BUILDER_MAX_JOBS] = job;
+	queue->Count++;
+}
+
+static BuilderJob* BuilderJobQueue_Dequeue(BuilderJobQueue* queue) {
+	if (queue->Count == 0) return NULL;
+	BuilderJob* job = queue->Jobs[queue->Head];
+	queue->Head = (queue->Head + 1) % BUILDER_MAX_JOBS;
+	queue->Count--;
+	return job;
+}
+
+BuilderJob* builder_jobs;
+/* Jobs that are not in use, jobs waiting for a worker thread, and jobs whose mesh has been built. */
+BuilderJobQueue builder_free, builder_pending, builder_done;
+void* builder_workers[BUILDER_MAX_WORKERS];
+Int32 builder_workersCount;
+void* builder_jobsMutex;
+void* builder_pendingEvent;
+volatile bool builder_terminate;
+/* Number of jobs currently being built on a worker thread. */
+Int32 builder_buildingCount;
+
+static void Builder_WorkerFunc(void) {
+	while (true) {
+		BuilderJob* job;
+		bool moreJobs;
+
+		Platform_MutexLock(builder_jobsMutex);
+		{
+			job = builder_terminate ? NULL : BuilderJobQueue_Dequeue(&builder_pending);
+			moreJobs = builder_pending.Count > 0;
+			if (job != NULL) builder_buildingCount++;
+		}
+		Platform_MutexUnlock(builder_jobsMutex);
+
+		/* Wake up another worker, so that queued jobs are processed in parallel */
+		if (moreJobs || builder_terminate) Platform_EventSet(builder_pendingEvent);
+		if (builder_terminate) return;
+
+		if (job != NULL) {
+			Builder_BuildMesh(&job->State);
+			Platform_MutexLock(builder_jobsMutex);
+			{
+				BuilderJobQueue_Enqueue(&builder_done, job);
+				builder_buildingCount--;
+			}
+			Platform_MutexUnlock(builder_jobsMutex);
+		} else {
+			Platform_EventWait(builder_pendingEvent);
+		}
+	}
+}
+
+bool Builder_CanQueue(void) {
+	return builder_free.Count > 0;
+}
+
+bool Builder_QueueChunk(ChunkInfo* info) {
+	/* Only the main thread removes jobs from the free list, so no need to lock here */
+	BuilderJob* job = builder_free.Jobs[builder_free.Head];
+	Int32 index = Builder_ChunkIndex(info);
+	if (Builder_UploadCached(info, index)) return false;
+
+	Int32 x = info->CentreX - 8, y = info->CentreY - 8, z = info->CentreZ - 8;
+	bool allAir = false, hasMesh;
+
+	hasMesh = Builder_PrepareChunk(&job->State, x, y, z, &allAir);
+	if (!hasMesh) {
+		ChunkUpdater_DeleteChunk(info);
+		info->AllAir = allAir;
+		/* Can see through all faces of an air chunk, but none of a chunk completely filled with solid blocks */
+		if (!allAir) info->OcclusionFlags = 0;
+		return false;
+	}
+
+	/* Old mesh keeps being drawn until Builder_FinishChunk uploads the new mesh. Its occlusion flags
+	may be outdated though, so treat all faces as connected until then. */
+	info->AllAir = false;
+	info->OcclusionFlags = OCCLUSION_ALL;
+
+	job->Info = info;
+	job->Version = Builder_ChunkVersion(index);
+	info->Building = true;
+
+	Platform_MutexLock(builder_jobsMutex);
+	{
+		BuilderJobQueue_Dequeue(&builder_free);
+		BuilderJobQueue_Enqueue(&builder_pending, job);
+	}
+	Platform_MutexUnlock(builder_jobsMutex);
+	Platform_EventSet(builder_pendingEvent);
+	return true;
+}
+
+ChunkInfo* Builder_FinishChunk(void) {
+	BuilderJob* job;
+	while (true) {
+		Platform_MutexLock(builder_jobsMutex);
+		{
+			job = BuilderJobQueue_Dequeue(&builder_done);
+		}
+		Platform_MutexUnlock(builder_jobsMutex);
+		if (job == NULL) return NULL;
+
+		ChunkInfo* info = job->Info;
+		info->Building = false;
+		ChunkUpdater_DeleteChunk(info);
+		Builder_UploadMesh(&job->State, info);
+		Builder_CacheStore(&job->State, Builder_ChunkIndex(info), job->Version);
+
+		Platform_MutexLock(builder_jobsMutex);
+		{
+			BuilderJobQueue_Enqueue(&builder_free, job);
+		}
+		Platform_MutexUnlock(builder_jobsMutex);
+		return info;
+	}
+}
+
+/* Discards the job's mesh, and makes sure its chunk is built again later. */
+static void Builder_CancelJob(BuilderJob* job) {
+	job->Info->Building      = false;
+	job->Info->PendingDelete = true;
+	ChunkUpdater_QueueChunk(job->Info);
+	BuilderJobQueue_Enqueue(&builder_free, job);
+}
+
+void Builder_CancelAll(void) {
+	if (builder_jobs == NULL) return;
+	Int32 building;
+
+	/* Worker threads read block and atlas state while building, so wait for them to finish */
+	do {
+		Platform_MutexLock(builder_jobsMutex);
+		{
+			BuilderJob* job;
+			while ((job = BuilderJobQueue_Dequeue(&builder_pending)) != NULL) {
+				Builder_CancelJob(job);
+			}
+			while ((job = BuilderJobQueue_Dequeue(&builder_done)) != NULL) {
+				Builder_CancelJob(job);
+			}
+			building = builder_buildingCount;
+		}
+		Platform_MutexUnlock(builder_jobsMutex);
+		if (building > 0) Platform_ThreadSleep(1);
+	} while (building > 0);
+}
+
+
+static void Builder_DrawSprite(BuilderState* s, Int32 count) {
+	TextureLoc texLoc = Block_GetTexLoc(s->Block, FACE_XMAX);
 	Int32 i = Atlas1D_Index(texLoc);
 	Real32 vOrigin = Atlas1D_RowId(texLoc) * Atlas1D_InvTileSize;
-	Real32 X = (Real32)Builder_X, Y = (Real32)Builder_Y, Z = (Real32)Builder_Z;
+	Real32 X = (Real32)s->X, Y = (Real32)s->Y, Z = (Real32)s->Z;
 
 #define u1 0.0f
 #define u2 UV2_Scale
@@ -397,9 +919,10 @@ static void Builder_DrawSprite(Int32 count) {
 	Real32 x2 = (Real32)X + 13.5f / 16.0f, y2 = (Real32)Y + 1.0f, z2 = (Real32)Z + 13.5f / 16.0f;
 	Real32 v1 = vOrigin, v2 = vOrigin + Atlas1D_InvTileSize * UV2_Scale;
 
-	UInt8 offsetType = Block_SpriteOffset[Builder_Block];
+	UInt8 offsetType = Block_SpriteOffset[s->Block];
 	if (offsetType >= 6 && offsetType <= 7) {
-		Random_SetSeed(&spriteRng, (Builder_X + 1217 * Builder_Z) & 0x7fffffff);
+		Random spriteRng;
+		Random_SetSeed(&spriteRng, (s->X + 1217 * s->Z) & 0x7fffffff);
 		Real32 valX = Random_Range(&spriteRng, -3, 3 + 1) / 16.0f;
 		Real32 valY = Random_Range(&spriteRng, 0,  3 + 1) / 16.0f;
 		Real32 valZ = Random_Range(&spriteRng, -3, 3 + 1) / 16.0f;
@@ -409,44 +932,78 @@ static void Builder_DrawSprite(Int32 count) {
 		z1 += valZ - stretch; z2 += valZ + stretch;
 		if (offsetType == 7) { y1 -= valY; y2 -= valY; }
 	}
-	
-	Builder1DPart* part = &Builder_Parts[i];
+
+	Builder1DPart* part = &s->Parts[i];
 	PackedCol white = PACKEDCOL_WHITE;
-	PackedCol col = Builder_FullBright ? white : Lighting_Col_Sprite_Fast(Builder_X, Builder_Y, Builder_Z);
-	Block_Tint(col, Builder_Block);
+	bool lit = Builder_IsLit(s, s->X, s->Y, s->Z);
+	PackedCol col = s->FullBright ? white : Builder_LightCol(FACE_YMAX, lit);
+	Block_Tint(col, s->Block);
 	VertexP3fT2fC4b v; v.Col = col;
+	VertexP3fT2fC4b* vertices = s->Vertices;
+	UInt16 light = Builder_QuadLight(s->Block, lit);
 
 	/* Draw Z axis */
 	Int32 index = part->sOffset;
-	v.X = x1; v.Y = y1; v.Z = z1; v.U = u2; v.V = v2; Builder_Vertices[index + 0] = v;
-	          v.Y = y2;                     v.V = v1; Builder_Vertices[index + 1] = v;
-	v.X = x2;           v.Z = z2; v.U = u1;           Builder_Vertices[index + 2] = v;
-	          v.Y = y1;                     v.V = v2; Builder_Vertices[index + 3] = v;
+	s->Lights[index >> 2] = light;
+	v.X = x1; v.Y = y1; v.Z = z1; v.U = u2; v.V = v2; vertices[index + 0] = v;
+	          v.Y = y2;                     v.V = v1; vertices[index + 1] = v;
+	v.X = x2;           v.Z = z2; v.U = u1;           vertices[index + 2] = v;
+	          v.Y = y1;                     v.V = v2; vertices[index + 3] = v;
 
 	/* Draw Z axis mirrored */
 	index += part->sAdvance;
-	v.X = x2; v.Y = y1; v.Z = z2; v.U = u2;           Builder_Vertices[index + 0] = v;
-	          v.Y = y2;                     v.V = v1; Builder_Vertices[index + 1] = v;
-	v.X = x1;           v.Z = z1; v.U = u1;           Builder_Vertices[index + 2] = v;
-	          v.Y = y1;                     v.V = v2; Builder_Vertices[index + 3] = v;
+	s->Lights[index >> 2] = light;
+	v.X = x2; v.Y = y1; v.Z = z2; v.U = u2;           vertices[index + 0] = v;
+	          v.Y = y2;                     v.V = v1; vertices[index + 1] = v;
+	v.X = x1;           v.Z = z1; v.U = u1;           vertices[index + 2] = v;
+	          v.Y = y1;                     v.V = v2; vertices[index + 3] = v;
 
 	/* Draw X axis */
 	index += part->sAdvance;
-	v.X = x1; v.Y = y1; v.Z = z2; v.U = u2;           Builder_Vertices[index + 0] = v;
-	          v.Y = y2;                     v.V = v1; Builder_Vertices[index + 1] = v;
-	v.X = x2;           v.Z = z1; v.U = u1;           Builder_Vertices[index + 2] = v;
-	          v.Y = y1;                     v.V = v2; Builder_Vertices[index + 3] = v;
+	s->Lights[index >> 2] = light;
+	v.X = x1; v.Y = y1; v.Z = z2; v.U = u2;           vertices[index + 0] = v;
+	          v.Y = y2;                     v.V = v1; vertices[index + 1] = v;
+	v.X = x2;           v.Z = z1; v.U = u1;           vertices[index + 2] = v;
+	          v.Y = y1;                     v.V = v2; vertices[index + 3] = v;
 
 	/* Draw X axis mirrored */
 	index += part->sAdvance;
-	v.X = x2; v.Y = y1; v.Z = z1; v.U = u2;           Builder_Vertices[index + 0] = v;
-	          v.Y = y2;                     v.V = v1; Builder_Vertices[index + 1] = v;
-	v.X = x1;           v.Z = z2; v.U = u1;           Builder_Vertices[index + 2] = v;
-	          v.Y = y1;                     v.V = v2; Builder_Vertices[index + 3] = v;
+	s->Lights[index >> 2] = light;
+	v.X = x2; v.Y = y1; v.Z = z1; v.U = u2;           vertices[index + 0] = v;
+	          v.Y = y2;                     v.V = v1; vertices[index + 1] = v;
+	v.X = x1;           v.Z = z2; v.U = u1;           vertices[index + 2] = v;
+	          v.Y = y1;                     v.V = v2; vertices[index + 3] = v;
 
 	part->sOffset += 4;
 }
 
+static bool Builder_OccludedLiquid(BuilderState* s, Int32 chunkIndex) {
+	BlockID* chunk = s->Chunk;
+	chunkIndex += EXTCHUNK_SIZE_2; /* Checking y above */
+	return
+		Block_FullOpaque[chunk[chunkIndex]]
+		&& Block_Draw[chunk[chunkIndex - EXTCHUNK_SIZE]] != DRAW_GAS
+		&& Block_Draw[chunk[chunkIndex - 1]] != DRAW_GAS
+		&& Block_Draw[chunk[chunkIndex + 1]] != DRAW_GAS
+		&& Block_Draw[chunk[chunkIndex + EXTCHUNK_SIZE]] != DRAW_GAS;
+}
+
+static void Builder_DefaultPreStretchTiles(BuilderState* s, Int32 x1, Int32 y1, Int32 z1) {
+	Platform_MemSet(s->Parts, 0, sizeof(s->Parts));
+}
+
+static void Builder_DefaultPostStretchTiles(BuilderState* s, Int32 x1, Int32 y1, Int32 z1) {
+	Int32 i, vertsCount = Builder_TotalVerticesCount(s);
+	Builder_AllocVertices(s, vertsCount);
+
+	vertsCount = 0;
+	for (i = 0; i < ATLAS1D_MAX_ATLASES; i++) {
+		Int32 j = i + ATLAS1D_MAX_ATLASES;
+		Builder1DPart_CalcOffsets(s, &s->Parts[i], &vertsCount);
+		Builder1DPart_CalcOffsets(s, &s->Parts[j], &vertsCount);
+	}
+}
+
 void Builder_Init(void) {
 	Builder_Offsets[FACE_XMIN] = -1;
 	Builder_Offsets[FACE_XMAX] = 1;
@@ -454,15 +1011,64 @@ void Builder_Init(void) {
 	Builder_Offsets[FACE_ZMAX] = EXTCHUNK_SIZE;
 	Builder_Offsets[FACE_YMIN] = -EXTCHUNK_SIZE_2;
 	Builder_Offsets[FACE_YMAX] = EXTCHUNK_SIZE_2;
+
+	builder_jobs = Platform_MemAlloc(BUILDER_MAX_JOBS, sizeof(BuilderJob));
+	if (builder_jobs == NULL) ErrorHandler_Fail("Builder - failed to allocate jobs");
+	Platform_MemSet(builder_jobs, 0, BUILDER_MAX_JOBS * sizeof(BuilderJob));
+
+	Int32 i;
+	for (i = 0; i < BUILDER_MAX_JOBS; i++) {
+		BuilderJobQueue_Enqueue(&builder_free, &builder_jobs[i]);
+	}
+
+	builder_jobsMutex    = Platform_MutexCreate();
+	builder_pendingEvent = Platform_EventCreate();
+	builder_terminate    = false;
+
+	/* Leave one core free for the main thread */
+	builder_workersCount = Platform_ProcessorsCount() - 1;
+	Math_Clamp(builder_workersCount, 1, BUILDER_MAX_WORKERS);
+	for (i = 0; i < builder_workersCount; i++) {
+		builder_workers[i] = Platform_ThreadStart(Builder_WorkerFunc);
+	}
+}
+
+void Builder_Free(void) {
+	builder_terminate = true;
+	Platform_EventSet(builder_pendingEvent);
+
+	Int32 i;
+	for (i = 0; i < builder_workersCount; i++) {
+		Platform_ThreadJoin(builder_workers[i]);
+		Platform_ThreadFreeHandle(builder_workers[i]);
+	}
+	builder_workersCount = 0;
+
+	Platform_EventFree(builder_pendingEvent);
+	Platform_MutexFree(builder_jobsMutex);
+
+	for (i = 0; i < BUILDER_MAX_JOBS; i++) {
+		Platform_MemFree(&builder_jobs[i].State.Vertices);
+		Platform_MemFree(&builder_jobs[i].State.Lights);
+	}
+	Platform_MemFree(&builder_jobs);
+	Platform_MemFree(&builder_mainState.Vertices);
+	Platform_MemFree(&builder_mainState.Lights);
+#if CC_BUILD_COMPACTVERTEX
+	Platform_MemFree(&builder_compactVertices);
+	builder_compactElems = 0;
+#endif
+	Builder_ClearCache();
+	Platform_MemFree(&builder_cache);
+	builder_free.Count = 0; builder_pending.Count = 0; builder_done.Count = 0;
 }
 
-static void Builder_SetDefault(void) {
+void Builder_SetDefault(void) {
 	Builder_StretchXLiquid = NULL;
 	Builder_StretchX       = NULL;
 	Builder_StretchZ       = NULL;
 	Builder_RenderBlock    = NULL;
 
-	Builder_UseBitFlags = false;
 	Builder_PreStretchTiles  = Builder_DefaultPreStretchTiles;
 	Builder_PostStretchTiles = Builder_DefaultPostStretchTiles;
 }
@@ -470,47 +1076,55 @@ static void Builder_SetDefault(void) {
 void Builder_OnNewMapLoaded(void) {
 	Builder_SidesLevel = max(0, WorldEnv_SidesHeight);
 	Builder_EdgeLevel  = max(0, WorldEnv_EdgeHeight);
+
+	Builder_ClearCache();
+	Platform_MemFree(&builder_cache);
+	builder_cache = Platform_MemAlloc(MapRenderer_ChunksCount, sizeof(BuilderCacheSlot));
+	if (builder_cache == NULL) ErrorHandler_Fail("Builder - failed to allocate mesh cache");
+	Platform_MemSet(builder_cache, 0, MapRenderer_ChunksCount * sizeof(BuilderCacheSlot));
 }
 
 
-static PackedCol NormalBuilder_LightCol(Int32 x, Int32 y, Int32 z, Int32 face, BlockID block) {
+/*########################################################################################################################*
+*---------------------------------------------------Normal mesh builder---------------------------------------------------*
+*#########################################################################################################################*/
+/* Whether the given face of the block at the given coordinates is in sunlight. */
+static bool NormalBuilder_IsLit(BuilderState* s, Int32 x, Int32 y, Int32 z, Int32 face, BlockID block) {
 	Int32 offset = (Block_LightOffset[block] >> face) & 1;
 	switch (face) {
 	case FACE_XMIN:
-		return x < offset ? Lighting_OutsideXSide : Lighting_Col_XSide_Fast(x - offset, y, z);
+		return x < offset || Builder_IsLit(s, x - offset, y, z);
 	case FACE_XMAX:
-		return x >(World_MaxX - offset) ? Lighting_OutsideXSide : Lighting_Col_XSide_Fast(x + offset, y, z);
+		return x > (World_MaxX - offset) || Builder_IsLit(s, x + offset, y, z);
 	case FACE_ZMIN:
-		return z < offset ? Lighting_OutsideZSide : Lighting_Col_ZSide_Fast(x, y, z - offset);
+		return z < offset || Builder_IsLit(s, x, y, z - offset);
 	case FACE_ZMAX:
-		return z >(World_MaxZ - offset) ? Lighting_OutsideZSide : Lighting_Col_ZSide_Fast(x, y, z + offset);
+		return z > (World_MaxZ - offset) || Builder_IsLit(s, x, y, z + offset);
 	case FACE_YMIN:
-		return y <= 0 ? Lighting_OutsideYBottom : Lighting_Col_YBottom_Fast(x, y - offset, z);
+		return y <= 0 || Builder_IsLit(s, x, y - offset, z);
 	case FACE_YMAX:
-		return y >= World_MaxY ? Lighting_Outside : Lighting_Col_YTop_Fast(x, (y + 1) - offset, z);
+		return y >= World_MaxY || Builder_IsLit(s, x, (y + 1) - offset, z);
 	}
-
-	PackedCol black = PACKEDCOL_BLACK;
-	return black;
+	return true;
 }
 
-static bool NormalBuilder_CanStretch(BlockID initial, Int32 chunkIndex, Int32 x, Int32 y, Int32 z, Face face) {
-	BlockID cur = Builder_Chunk[chunkIndex];
+static bool NormalBuilder_CanStretch(BuilderState* s, BlockID initial, Int32 chunkIndex, Int32 x, Int32 y, Int32 z, Face face) {
+	BlockID cur = s->Chunk[chunkIndex];
 	return cur == initial
-		&& !Block_IsFaceHidden(cur, Builder_Chunk[chunkIndex + Builder_Offsets[face]], face)
-		&& (Builder_FullBright || (NormalBuilder_LightCol(Builder_X, Builder_Y, Builder_Z, face, initial).Packed == NormalBuilder_LightCol(x, y, z, face, cur).Packed));
+		&& !Block_IsFaceHidden(cur, s->Chunk[chunkIndex + Builder_Offsets[face]], face)
+		&& (s->FullBright || (NormalBuilder_IsLit(s, s->X, s->Y, s->Z, face, initial) == NormalBuilder_IsLit(s, x, y, z, face, cur)));
 }
 
-static Int32 NormalBuilder_StretchXLiquid(Int32 countIndex, Int32 x, Int32 y, Int32 z, Int32 chunkIndex, BlockID block) {
-	if (Builder_OccludedLiquid(chunkIndex)) return 0;
+static Int32 NormalBuilder_StretchXLiquid(BuilderState* s, Int32 countIndex, Int32 x, Int32 y, Int32 z, Int32 chunkIndex, BlockID block) {
+	if (Builder_OccludedLiquid(s, chunkIndex)) return 0;
 	Int32 count = 1;
 	x++;
 	chunkIndex++;
 	countIndex += FACE_COUNT;
 	bool stretchTile = (Block_CanStretch[block] & (1 << FACE_YMAX)) != 0;
 
-	while (x < Builder_ChunkEndX && stretchTile && NormalBuilder_CanStretch(block, chunkIndex, x, y, z, FACE_YMAX) && !Builder_OccludedLiquid(chunkIndex)) {
-		Builder_Counts[countIndex] = 0;
+	while (x < s->ChunkEndX && stretchTile && NormalBuilder_CanStretch(s, block, chunkIndex, x, y, z, FACE_YMAX) && !Builder_OccludedLiquid(s, chunkIndex)) {
+		s->Counts[countIndex] = 0;
 		count++;
 		x++;
 		chunkIndex++;
@@ -519,15 +1133,15 @@ static Int32 NormalBuilder_StretchXLiquid(Int32 countIndex, Int32 x, Int32 y, In
 	return count;
 }
 
-static Int32 NormalBuilder_StretchX(Int32 countIndex, Int32 x, Int32 y, Int32 z, Int32 chunkIndex, BlockID block, Face face) {
+static Int32 NormalBuilder_StretchX(BuilderState* s, Int32 countIndex, Int32 x, Int32 y, Int32 z, Int32 chunkIndex, BlockID block, Face face) {
 	Int32 count = 1;
 	x++;
 	chunkIndex++;
 	countIndex += FACE_COUNT;
 	bool stretchTile = (Block_CanStretch[block] & (1 << face)) != 0;
 
-	while (x < Builder_ChunkEndX && stretchTile && NormalBuilder_CanStretch(block, chunkIndex, x, y, z, face)) {
-		Builder_Counts[countIndex] = 0;
+	while (x < s->ChunkEndX && stretchTile && NormalBuilder_CanStretch(s, block, chunkIndex, x, y, z, face)) {
+		s->Counts[countIndex] = 0;
 		count++;
 		x++;
 		chunkIndex++;
@@ -536,15 +1150,15 @@ static Int32 NormalBuilder_StretchX(Int32 countIndex, Int32 x, Int32 y, Int32 z,
 	return count;
 }
 
-static Int32 NormalBuilder_StretchZ(Int32 countIndex, Int32 x, Int32 y, Int32 z, Int32 chunkIndex, BlockID block, Face face) {
+static Int32 NormalBuilder_StretchZ(BuilderState* s, Int32 countIndex, Int32 x, Int32 y, Int32 z, Int32 chunkIndex, BlockID block, Face face) {
 	Int32 count = 1;
 	z++;
 	chunkIndex += EXTCHUNK_SIZE;
 	countIndex += CHUNK_SIZE * FACE_COUNT;
 	bool stretchTile = (Block_CanStretch[block] & (1 << face)) != 0;
 
-	while (z < Builder_ChunkEndZ && stretchTile && NormalBuilder_CanStretch(block, chunkIndex, x, y, z, face)) {
-		Builder_Counts[countIndex] = 0;
+	while (z < s->ChunkEndZ && stretchTile && NormalBuilder_CanStretch(s, block, chunkIndex, x, y, z, face)) {
+		s->Counts[countIndex] = 0;
 		count++;
 		z++;
 		chunkIndex += EXTCHUNK_SIZE;
@@ -553,98 +1167,112 @@ static Int32 NormalBuilder_StretchZ(Int32 countIndex, Int32 x, Int32 y, Int32 z,
 	return count;
 }
 
-static void NormalBuilder_RenderBlock(Int32 index) {
-	if (Block_Draw[Builder_Block] == DRAW_SPRITE) {
-		Builder_FullBright = Block_FullBright[Builder_Block];
-		Builder_Tinted = Block_Tinted[Builder_Block];
+static void NormalBuilder_SetupDrawer(BuilderState* s, BlockID block) {
+	Drawer* drawer = &s->Drawer;
+	drawer->MinBB = Block_MinBB[block]; drawer->MinBB.Y = 1.0f - drawer->MinBB.Y;
+	drawer->MaxBB = Block_MaxBB[block]; drawer->MaxBB.Y = 1.0f - drawer->MaxBB.Y;
+
+	Vector3 min = Block_RenderMinBB[block], max = Block_RenderMaxBB[block];
+	drawer->X1 = s->X + min.X; drawer->Y1 = s->Y + min.Y; drawer->Z1 = s->Z + min.Z;
+	drawer->X2 = s->X + max.X; drawer->Y2 = s->Y + max.Y; drawer->Z2 = s->Z + max.Z;
+
+	drawer->Tinted = Block_Tinted[block];
+	drawer->TintColour = Block_FogCol[block];
+}
+
+static void NormalBuilder_RenderBlock(BuilderState* s, Int32 index) {
+	BlockID block = s->Block;
+	if (Block_Draw[block] == DRAW_SPRITE) {
+		s->FullBright = Block_FullBright[block];
+		s->Tinted = Block_Tinted[block];
 
-		Int32 count = Builder_Counts[index + FACE_YMAX];
-		if (count) Builder_DrawSprite(count);
+		Int32 count = s->Counts[index + FACE_YMAX];
+		if (count) Builder_DrawSprite(s, count);
 		return;
 	}
 
-	Int32 count_XMin = Builder_Counts[index + FACE_XMIN];
-	Int32 count_XMax = Builder_Counts[index + FACE_XMAX];
-	Int32 count_ZMin = Builder_Counts[index + FACE_ZMIN];
-	Int32 count_ZMax = Builder_Counts[index + FACE_ZMAX];
-	Int32 count_YMin = Builder_Counts[index + FACE_YMIN];
-	Int32 count_YMax = Builder_Counts[index + FACE_YMAX];
+	Int32 count_XMin = s->Counts[index + FACE_XMIN];
+	Int32 count_XMax = s->Counts[index + FACE_XMAX];
+	Int32 count_ZMin = s->Counts[index + FACE_ZMIN];
+	Int32 count_ZMax = s->Counts[index + FACE_ZMAX];
+	Int32 count_YMin = s->Counts[index + FACE_YMIN];
+	Int32 count_YMax = s->Counts[index + FACE_YMAX];
 
 	if (count_XMin == 0 && count_XMax == 0 && count_ZMin == 0 &&
 		count_ZMax == 0 && count_YMin == 0 && count_YMax == 0) return;
 
 
-	bool fullBright = Block_FullBright[Builder_Block];
-	Int32 partOffset = (Block_Draw[Builder_Block] == DRAW_TRANSLUCENT) * ATLAS1D_MAX_ATLASES;
-	Int32 lightFlags = Block_LightOffset[Builder_Block];
-
-	Drawer_MinBB = Block_MinBB[Builder_Block]; Drawer_MinBB.Y = 1.0f - Drawer_MinBB.Y;
-	Drawer_MaxBB = Block_MaxBB[Builder_Block]; Drawer_MaxBB.Y = 1.0f - Drawer_MaxBB.Y;
-
-	Vector3 min = Block_RenderMinBB[Builder_Block], max = Block_RenderMaxBB[Builder_Block];
-	Drawer_X1 = Builder_X + min.X; Drawer_Y1 = Builder_Y + min.Y; Drawer_Z1 = Builder_Z + min.Z;
-	Drawer_X2 = Builder_X + max.X; Drawer_Y2 = Builder_Y + max.Y; Drawer_Z2 = Builder_Z + max.Z;
-
-	Drawer_Tinted = Block_Tinted[Builder_Block];
-	Drawer_TintColour = Block_FogCol[Builder_Block];
+	bool fullBright = Block_FullBright[block];
+	Int32 partOffset = (Block_Draw[block] == DRAW_TRANSLUCENT) * ATLAS1D_MAX_ATLASES;
+	Int32 lightFlags = Block_LightOffset[block];
+	Drawer* drawer = &s->Drawer;
+	NormalBuilder_SetupDrawer(s, block);
 	PackedCol white = PACKEDCOL_WHITE;
 
 	if (count_XMin) {
-		TextureLoc texLoc = Block_GetTexLoc(Builder_Block, FACE_XMIN);
+		TextureLoc texLoc = Block_GetTexLoc(block, FACE_XMIN);
 		Int32 offset = (lightFlags >> FACE_XMIN) & 1;
-		Builder1DPart* part = &Builder_Parts[partOffset + Atlas1D_Index(texLoc)];
+		Builder1DPart* part = &s->Parts[partOffset + Atlas1D_Index(texLoc)];
 
-		PackedCol col = fullBright ? white :
-			Builder_X >= offset ? Lighting_Col_XSide_Fast(Builder_X - offset, Builder_Y, Builder_Z) : Lighting_OutsideXSide;
-		Drawer_XMin(count_XMin, col, texLoc, &part->fVertices[FACE_XMIN]);
+		bool lit = s->X < offset || Builder_IsLit(s, s->X - offset, s->Y, s->Z);
+		PackedCol col = fullBright ? white : Builder_LightCol(FACE_XMIN, lit);
+		Builder_SetQuadLight(s, part->fVertices[FACE_XMIN], block, lit);
+		Drawer_XMin(drawer, count_XMin, col, texLoc, &part->fVertices[FACE_XMIN]);
 	}
 
 	if (count_XMax) {
-		TextureLoc texLoc = Block_GetTexLoc(Builder_Block, FACE_XMAX);
+		TextureLoc texLoc = Block_GetTexLoc(block, FACE_XMAX);
 		Int32 offset = (lightFlags >> FACE_XMAX) & 1;
-		Builder1DPart* part = &Builder_Parts[partOffset + Atlas1D_Index(texLoc)];
+		Builder1DPart* part = &s->Parts[partOffset + Atlas1D_Index(texLoc)];
 
-		PackedCol col = fullBright ? white :
-			Builder_X <= (World_MaxX - offset) ? Lighting_Col_XSide_Fast(Builder_X + offset, Builder_Y, Builder_Z) : Lighting_OutsideXSide;
-		Drawer_XMax(count_XMax, col, texLoc, &part->fVertices[FACE_XMAX]);
+		bool lit = s->X > (World_MaxX - offset) || Builder_IsLit(s, s->X + offset, s->Y, s->Z);
+		PackedCol col = fullBright ? white : Builder_LightCol(FACE_XMAX, lit);
+		Builder_SetQuadLight(s, part->fVertices[FACE_XMAX], block, lit);
+		Drawer_XMax(drawer, count_XMax, col, texLoc, &part->fVertices[FACE_XMAX]);
 	}
 
 	if (count_ZMin) {
-		TextureLoc texLoc = Block_GetTexLoc(Builder_Block, FACE_ZMIN);
+		TextureLoc texLoc = Block_GetTexLoc(block, FACE_ZMIN);
 		Int32 offset = (lightFlags >> FACE_ZMIN) & 1;
-		Builder1DPart* part = &Builder_Parts[partOffset + Atlas1D_Index(texLoc)];
+		Builder1DPart* part = &s->Parts[partOffset + Atlas1D_Index(texLoc)];
 
-		PackedCol col = fullBright ? white :
-			Builder_Z >= offset ? Lighting_Col_ZSide_Fast(Builder_X, Builder_Y, Builder_Z - offset) : Lighting_OutsideZSide;
-		Drawer_ZMin(count_ZMin, col, texLoc, &part->fVertices[FACE_ZMIN]);
+		bool lit = s->Z < offset || Builder_IsLit(s, s->X, s->Y, s->Z - offset);
+		PackedCol col = fullBright ? white : Builder_LightCol(FACE_ZMIN, lit);
+		Builder_SetQuadLight(s, part->fVertices[FACE_ZMIN], block, lit);
+		Drawer_ZMin(drawer, count_ZMin, col, texLoc, &part->fVertices[FACE_ZMIN]);
 	}
 
 	if (count_ZMax) {
-		TextureLoc texLoc = Block_GetTexLoc(Builder_Block, FACE_ZMAX);
+		TextureLoc texLoc = Block_GetTexLoc(block, FACE_ZMAX);
 		Int32 offset = (lightFlags >> FACE_ZMAX) & 1;
-		Builder1DPart* part = &Builder_Parts[partOffset + Atlas1D_Index(texLoc)];
+		Builder1DPart* part = &s->Parts[partOffset + Atlas1D_Index(texLoc)];
 
-		PackedCol col = fullBright ? white :
-			Builder_Z <= (World_MaxZ - offset) ? Lighting_Col_ZSide_Fast(Builder_X, Builder_Y, Builder_Z + offset) : Lighting_OutsideZSide;
-		Drawer_ZMax(count_ZMax, col, texLoc, &part->fVertices[FACE_ZMAX]);
+		bool lit = s->Z > (World_MaxZ - offset) || Builder_IsLit(s, s->X, s->Y, s->Z + offset);
+		PackedCol col = fullBright ? white : Builder_LightCol(FACE_ZMAX, lit);
+		Builder_SetQuadLight(s, part->fVertices[FACE_ZMAX], block, lit);
+		Drawer_ZMax(drawer, count_ZMax, col, texLoc, &part->fVertices[FACE_ZMAX]);
 	}
 
 	if (count_YMin) {
-		TextureLoc texLoc = Block_GetTexLoc(Builder_Block, FACE_YMIN);
+		TextureLoc texLoc = Block_GetTexLoc(block, FACE_YMIN);
 		Int32 offset = (lightFlags >> FACE_YMIN) & 1;
-		Builder1DPart* part = &Builder_Parts[partOffset + Atlas1D_Index(texLoc)];
+		Builder1DPart* part = &s->Parts[partOffset + Atlas1D_Index(texLoc)];
 
-		PackedCol col = fullBright ? white : Lighting_Col_YBottom_Fast(Builder_X, Builder_Y - offset, Builder_Z);
-		Drawer_YMin(count_YMin, col, texLoc, &part->fVertices[FACE_YMIN]);
+		bool lit = Builder_IsLit(s, s->X, s->Y - offset, s->Z);
+		PackedCol col = fullBright ? white : Builder_LightCol(FACE_YMIN, lit);
+		Builder_SetQuadLight(s, part->fVertices[FACE_YMIN], block, lit);
+		Drawer_YMin(drawer, count_YMin, col, texLoc, &part->fVertices[FACE_YMIN]);
 	}
 
 	if (count_YMax) {
-		TextureLoc texLoc = Block_GetTexLoc(Builder_Block, FACE_YMAX);
+		TextureLoc texLoc = Block_GetTexLoc(block, FACE_YMAX);
 		Int32 offset = (lightFlags >> FACE_YMAX) & 1;
-		Builder1DPart* part = &Builder_Parts[partOffset + Atlas1D_Index(texLoc)];
+		Builder1DPart* part = &s->Parts[partOffset + Atlas1D_Index(texLoc)];
 
-		PackedCol col = fullBright ? white : Lighting_Col_YTop_Fast(Builder_X, (Builder_Y + 1) - offset, Builder_Z);
-		Drawer_YMax(count_YMax, col, texLoc, &part->fVertices[FACE_YMAX]);
+		bool lit = Builder_IsLit(s, s->X, (s->Y + 1) - offset, s->Z);
+		PackedCol col = fullBright ? white : Builder_LightCol(FACE_YMAX, lit);
+		Builder_SetQuadLight(s, part->fVertices[FACE_YMAX], block, lit);
+		Drawer_YMax(drawer, count_YMax, col, texLoc, &part->fVertices[FACE_YMAX]);
 	}
 }
 
@@ -655,3 +1283,136 @@ void NormalBuilder_SetActive(void) {
 	Builder_StretchZ       = NormalBuilder_StretchZ;
 	Builder_RenderBlock    = NormalBuilder_RenderBlock;
 }
+
+
+/*########################################################################################################################*
+*---------------------------------------------------Greedy mesh builder---------------------------------------------------*
+*#########################################################################################################################*/
+/* Whether the given face of the block covers the whole block along texture V axis. */
+static bool GreedyBuilder_CanMergeRows(BlockID block, Face face) {
+	if (face >= FACE_YMIN) {
+		return Block_MinBB[block].Z == 0.0f && Block_MaxBB[block].Z == 1.0f;
+	}
+	return Block_MinBB[block].Y == 0.0f && Block_MaxBB[block].Y == 1.0f;
+}
+
+/* Merges following rows into the given row, when they have the same block, stretch count and lighting.
+Rows are along Y axis for side faces, and along Z axis for top and bottom faces. */
+static Int32 GreedyBuilder_MergeRows(BuilderState* s, Int32 countIndex, Int32 chunkIndex, Int32 x, Int32 y, Int32 z, Face face, Int32 maxRows) {
+	BlockID block = s->Chunk[chunkIndex];
+	UInt8 count = s->Counts[countIndex];
+	bool fullBright = Block_FullBright[block];
+	bool lit = NormalBuilder_IsLit(s, x, y, z, face, block);
+
+	Int32 countStep = face >= FACE_YMIN ? CHUNK_SIZE * FACE_COUNT : CHUNK_SIZE_2 * FACE_COUNT;
+	Int32 chunkStep = face >= FACE_YMIN ? EXTCHUNK_SIZE : EXTCHUNK_SIZE_2;
+	Int32 rows = 1;
+
+	while (rows < maxRows) {
+		countIndex += countStep; chunkIndex += chunkStep;
+		if (face >= FACE_YMIN) { z++; } else { y++; }
+
+		if (s->Counts[countIndex] != count || s->Chunk[chunkIndex] != block) break;
+		if (!fullBright && NormalBuilder_IsLit(s, x, y, z, face, block) != lit) break;
+		s->Counts[countIndex] = 0;
+		rows++;
+	}
+
+	/* Merged rows no longer need their own quads */
+	if (rows > 1) {
+		Int32 partOffset = (Block_Draw[block] == DRAW_TRANSLUCENT) * ATLAS1D_MAX_ATLASES;
+		Builder1DPart* part = &s->Parts[partOffset + Atlas1D_Index(Block_GetTexLoc(block, face))];
+		part->fCount[face] -= 4 * (rows - 1);
+	}
+	return rows;
+}
+
+static void GreedyBuilder_MergeAllRows(BuilderState* s, Int32 x1, Int32 y1, Int32 z1) {
+	Int32 xCount = min(World_Width,  x1 + CHUNK_SIZE) - x1;
+	Int32 yCount = min(World_Height, y1 + CHUNK_SIZE) - y1;
+	Int32 zCount = min(World_Length, z1 + CHUNK_SIZE) - z1;
+	Int32 xx, yy, zz, face;
+
+	for (yy = 0; yy < yCount; yy++) {
+		for (zz = 0; zz < zCount; zz++) {
+			Int32 chunkIndex = (yy + 1) * EXTCHUNK_SIZE_2 + (zz + 1) * EXTCHUNK_SIZE + (0 + 1);
+			for (xx = 0; xx < xCount; xx++, chunkIndex++) {
+				BlockID block = s->Chunk[chunkIndex];
+				if (Block_Draw[block] == DRAW_GAS || Block_Draw[block] == DRAW_SPRITE) continue;
+				Int32 index = ((yy << 8) | (zz << 4) | xx) * FACE_COUNT;
+
+				for (face = 0; face < FACE_COUNT; face++) {
+					if (s->Counts[index + face] == 0 || !GreedyBuilder_CanMergeRows(block, face)) continue;
+					Int32 maxRows = face >= FACE_YMIN ? zCount - zz : yCount - yy;
+					s->RowCounts[index + face] = (UInt8)GreedyBuilder_MergeRows(s, index + face, chunkIndex,
+						x1 + xx, y1 + yy, z1 + zz, face, maxRows);
+				}
+			}
+		}
+	}
+}
+
+static void GreedyBuilder_PostStretchTiles(BuilderState* s, Int32 x1, Int32 y1, Int32 z1) {
+	Platform_MemSet(s->RowCounts, 1, CHUNK_SIZE_3 * FACE_COUNT);
+	/* Tiles can only be repeated along V axis when each 1D atlas contains just that tile */
+	if (Atlas1D_TilesPerAtlas == 1) GreedyBuilder_MergeAllRows(s, x1, y1, z1);
+	Builder_DefaultPostStretchTiles(s, x1, y1, z1);
+}
+
+static void GreedyBuilder_DrawRows(BuilderState* s, Face face, Int32 count, Int32 rows) {
+	BlockID block = s->Block;
+	Drawer* drawer = &s->Drawer;
+	NormalBuilder_SetupDrawer(s, block);
+
+	TextureLoc texLoc = Block_GetTexLoc(block, face);
+	Int32 partOffset = (Block_Draw[block] == DRAW_TRANSLUCENT) * ATLAS1D_MAX_ATLASES;
+	Builder1DPart* part = &s->Parts[partOffset + Atlas1D_Index(texLoc)];
+	VertexP3fT2fC4b** vertices = &part->fVertices[face];
+
+	PackedCol white = PACKEDCOL_WHITE;
+	bool lit = NormalBuilder_IsLit(s, s->X, s->Y, s->Z, face, block);
+	PackedCol col = Block_FullBright[block] ? white : Builder_LightCol(face, lit);
+	Builder_SetQuadLight(s, *vertices, block, lit);
+	Real32 extra = (Real32)(rows - 1);
+
+	/* Extend face over the merged rows. Texture wraps around along V, so the tile is repeated for each row. */
+	switch (face) {
+	case FACE_XMIN:
+		drawer->Y2 += extra; drawer->MaxBB.Y -= extra;
+		Drawer_XMin(drawer, count, col, texLoc, vertices); break;
+	case FACE_XMAX:
+		drawer->Y2 += extra; drawer->MaxBB.Y -= extra;
+		Drawer_XMax(drawer, count, col, texLoc, vertices); break;
+	case FACE_ZMIN:
+		drawer->Y2 += extra; drawer->MaxBB.Y -= extra;
+		Drawer_ZMin(drawer, count, col, texLoc, vertices); break;
+	case FACE_ZMAX:
+		drawer->Y2 += extra; drawer->MaxBB.Y -= extra;
+		Drawer_ZMax(drawer, count, col, texLoc, vertices); break;
+	case FACE_YMIN:
+		drawer->Z2 += extra; drawer->MaxBB.Z += extra / UV2_Scale;
+		Drawer_YMin(drawer, count, col, texLoc, vertices); break;
+	case FACE_YMAX:
+		drawer->Z2 += extra; drawer->MaxBB.Z += extra / UV2_Scale;
+		Drawer_YMax(drawer, count, col, texLoc, vertices); break;
+	}
+}
+
+static void GreedyBuilder_RenderBlock(BuilderState* s, Int32 index) {
+	Face face;
+	for (face = 0; face < FACE_COUNT; face++) {
+		Int32 rows = s->RowCounts[index + face];
+		if (rows <= 1) continue;
+
+		GreedyBuilder_DrawRows(s, face, s->Counts[index + face], rows);
+		/* Face has already been drawn, so normal builder should skip it */
+		s->Counts[index + face] = 0;
+	}
+	NormalBuilder_RenderBlock(s, index);
+}
+
+void GreedyBuilder_SetActive(void) {
+	NormalBuilder_SetActive();
+	Builder_RenderBlock      = GreedyBuilder_RenderBlock;
+	Builder_PostStretchTiles = GreedyBuilder_PostStretchTiles;
+}
\ No newline at end of file
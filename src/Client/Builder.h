@@ -2,21 +2,57 @@
 #define CC_BUILDER_H
 #include "Typedefs.h"
 /* Converts a 16x16x16 chunk into a mesh of vertices.
+   Chunk meshes are usually built by a pool of background threads, then uploaded to the GPU on the main thread.
+   A copy of recently built meshes is kept, so chunks that come back into view distance are not built again.
+   Cached meshes also record which quads are in sunlight, so new sun/shadow colours can be applied without building again.
 NormalMeshBuilder:
    Implements a simple chunk mesh builder, where each block face is a single colour.
    (whatever lighting engine returns as light colour for given block face at given coordinates)
+GreedyMeshBuilder:
+   Same as NormalMeshBuilder, but also merges rows of identical faces into rectangles.
+   (only when each 1D atlas holds a single tile, as otherwise textures cannot repeat along V axis)
 
 Copyright 2014-2017 ClassicalSharp | Licensed under BSD-3
 */
 typedef struct ChunkInfo_ ChunkInfo;
 
 Int32 Builder_SidesLevel, Builder_EdgeLevel;
+/* Maximum number of background threads that build chunk meshes. */
+#define BUILDER_MAX_WORKERS 8
+/* Maximum number of chunks that can be queued or being built at once. */
+#define BUILDER_MAX_JOBS 32
+/* Maximum number of vertices kept in the mesh cache. (24 MB) */
+#define BUILDER_CACHE_MAX_VERTICES (1024 * 1024)
 
+/* Starts the background threads that build chunk meshes. */
 void Builder_Init(void);
+/* Stops the background threads that build chunk meshes. */
+void Builder_Free(void);
 void Builder_SetDefault(void);
 void Builder_OnNewMapLoaded(void);
+/* Builds the mesh of the given chunk on the calling thread, then uploads it to the GPU. */
 void Builder_MakeChunk(ChunkInfo* info);
 
+/* Whether another chunk can be queued to have its mesh built in the background. */
+bool Builder_CanQueue(void);
+/* Queues the given chunk to have its mesh built on a background thread.
+Returns false if the chunk was finished immediately. (e.g. completely air, or its mesh was cached) */
+bool Builder_QueueChunk(ChunkInfo* info);
+/* Uploads the mesh of a chunk that finished building on a background thread to the GPU.
+Returns the chunk whose mesh was uploaded, or NULL if no chunks have finished building. */
+ChunkInfo* Builder_FinishChunk(void);
+/* Discards all queued chunks, and waits for chunks currently being built on background threads to finish.
+Must be called before changing block or atlas state that is read while building. Discarded chunks are queued again. */
+void Builder_CancelAll(void);
+/* Marks the mesh of the given chunk as outdated, discarding its cached mesh. */
+void Builder_InvalidateChunk(Int32 index);
+/* Discards all cached meshes. (e.g. because block definitions changed) */
+void Builder_ClearCache(void);
+/* Marks all cached meshes as needing to be recoloured to the current sun and shadow colours.
+   Each mesh is only recoloured when it is next uploaded, so the cost is spread out as chunks are rebuilt. */
+void Builder_RecolourCache(void);
+
 void NormalBuilder_SetActive(void);
+void GreedyBuilder_SetActive(void);
 void AdvLightingBuilder_SetActive(void);
 #endif
\ No newline at end of file
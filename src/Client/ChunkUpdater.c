@@ -14,10 +14,34 @@
 #include "Utils.h"
 #include "ErrorHandler.h"
 #include "Vectors.h"
+#include "Lighting.h"
 
 Vector3I ChunkUpdater_ChunkPos;
 UInt32* ChunkUpdater_Distances;
 
+/* Chunk reached when flood filling visibility outwards from the camera. */
+typedef struct OcclusionEntry_ {
+	ChunkInfo* Info;
+	Face EntryFace;  /* Face of the chunk that was passed through to reach it, FACE_COUNT for camera's chunk */
+	UInt8 Directions; /* Bit flags of the directions (as faces) travelled from camera's chunk */
+} OcclusionEntry;
+OcclusionEntry* cu_occlusionQueue;
+/* Whether which faces of a chunk can be seen from each other has changed for any chunk. */
+bool cu_occlusionChanged;
+
+/* Chunk waiting to have its mesh built. */
+typedef struct BuildEntry_ {
+	ChunkInfo* Info;
+	Int32 DistSqr; /* Squared distance from camera's chunk to centre of the chunk */
+	bool Hidden;   /* Whether chunk is outside the view frustum */
+} BuildEntry;
+/* Binary min heap of chunks waiting to be built, so nearest chunks in view are built first. */
+BuildEntry* cu_buildQueue;
+Int32 cu_buildCount;
+/* Chunks that have a mesh, so that unloading does not need to check every chunk in the world. */
+ChunkInfo** cu_loadedChunks;
+Int32 cu_loadedCount;
+
 void ChunkInfo_Reset(ChunkInfo* chunk, Int32 x, Int32 y, Int32 z) {
 	chunk->CentreX = x + 8; chunk->CentreY = y + 8; chunk->CentreZ = z + 8;
 #if !CC_BUILD_GL11
@@ -25,7 +49,9 @@ void ChunkInfo_Reset(ChunkInfo* chunk, Int32 x, Int32 y, Int32 z) {
 #endif
 
 	chunk->Visible = true; chunk->Empty = false;
-	chunk->PendingDelete = false; chunk->AllAir = false;
+	chunk->PendingDelete = false; chunk->AllAir = false; chunk->Building = false;
+	chunk->Occluded = false; chunk->OcclusionFlags = OCCLUSION_ALL;
+	chunk->Queued = false; chunk->Loaded = false;
 	chunk->DrawXMin = false; chunk->DrawXMax = false; chunk->DrawZMin = false;
 	chunk->DrawZMax = false; chunk->DrawYMin = false; chunk->DrawYMax = false;
 
@@ -38,10 +64,66 @@ Int32 cu_chunksTarget = 12;
 Vector3 cu_lastCamPos;
 Real32 cu_lastHeadY, cu_lastHeadX;
 Int32 cu_elementsPerBitmap;
+/* Whether sun or shadow colour changed, and chunk meshes need to be recoloured. */
+bool cu_coloursChanged;
+
+static void ChunkUpdater_OnChunkBuilt(ChunkInfo* info) {
+	if (info->OcclusionFlags != OCCLUSION_ALL) cu_occlusionChanged = true;
+	/* Chunk changed while its mesh was being built */
+	if (info->PendingDelete) ChunkUpdater_QueueChunk(info);
+	if (info->NormalParts == NULL && info->TranslucentParts == NULL) {
+		info->Empty = true;
+		return;
+	}
+	Int32 i;
+
+	if (!info->Loaded) {
+		info->Loaded = true;
+		cu_loadedChunks[cu_loadedCount] = info; cu_loadedCount++;
+	}
+
+	if (info->NormalParts != NULL) {
+		ChunkPartInfo* ptr = info->NormalParts;
+		for (i = 0; i < MapRenderer_1DUsedCount; i++, ptr += MapRenderer_ChunksCount) {
+			if (ptr->Offset >= 0) { MapRenderer_NormalPartsCount[i]++; }
+		}
+	}
+
+	if (info->TranslucentParts != NULL) {
+		ChunkPartInfo* ptr = info->TranslucentParts;
+		for (i = 0; i < MapRenderer_1DUsedCount; i++, ptr += MapRenderer_ChunksCount) {
+			if (ptr->Offset >= 0) { MapRenderer_TranslucentPartsCount[i]++; }
+		}
+	}
+}
+
+/* Applies new sun and shadow colours to all chunks. Chunks keep drawing their old mesh until the build queue
+gets to them, within the usual per frame budget. Chunks whose mesh is cached are then just recoloured and
+uploaded again, only the remaining chunks have to be built again. */
+static void ChunkUpdater_RefreshColours(void) {
+	cu_coloursChanged = false;
+	if (MapRenderer_Chunks == NULL || World_Blocks == NULL) return;
+	Builder_RecolourCache();
+
+	Int32 i;
+	for (i = 0; i < MapRenderer_ChunksCount; i++) {
+		ChunkInfo* info = &MapRenderer_Chunks[i];
+		/* Mesh being built may already have old colours */
+		if (info->Building) {
+			Builder_InvalidateChunk(i);
+			info->PendingDelete = true;
+		} else if (info->NormalParts != NULL || info->TranslucentParts != NULL) {
+			info->PendingDelete = true;
+		}
+	}
+	/* Refill build queue with all the chunks that need recolouring */
+	ChunkUpdater_ChunkPos = Vector3I_MaxValue();
+}
 
 static void ChunkUpdater_EnvVariableChanged(void* obj, Int32 envVar) {
 	if (envVar == ENV_VAR_SUN_COL || envVar == ENV_VAR_SHADOW_COL) {
-		ChunkUpdater_Refresh();
+		/* Deferred, as lighting colours may not have been updated yet */
+		cu_coloursChanged = true;
 	} else if (envVar == ENV_VAR_EDGE_HEIGHT || envVar == ENV_VAR_SIDES_OFFSET) {
 		Int32 oldClip = Builder_EdgeLevel;
 		Builder_SidesLevel = max(0, WorldEnv_SidesHeight);
@@ -75,6 +157,7 @@ static void ChunkUpdater_ProjectionChanged(void* obj) {
 
 static void ChunkUpdater_ViewDistanceChanged(void* obj) {
 	cu_lastCamPos = Vector3_BigPos();
+	ChunkUpdater_ChunkPos = Vector3I_MaxValue();
 }
 
 
@@ -87,9 +170,13 @@ static void ChunkUpdater_FreePartsAllocations(void) {
 static void ChunkUpdater_FreeAllocations(void) {
 	if (MapRenderer_Chunks == NULL) return;
 	Platform_MemFree(&MapRenderer_Chunks);
-	Platform_MemFree(&MapRenderer_SortedChunks);
 	Platform_MemFree(&MapRenderer_RenderChunks);
 	Platform_MemFree(&ChunkUpdater_Distances);
+	Platform_MemFree(&cu_occlusionQueue);
+	Platform_MemFree(&cu_buildQueue);
+	Platform_MemFree(&cu_loadedChunks);
+	MapRenderer_RenderChunksCount = 0;
+	cu_buildCount = 0; cu_loadedCount = 0;
 	ChunkUpdater_FreePartsAllocations();
 }
 
@@ -108,19 +195,26 @@ static void ChunkUpdater_PerformAllocations(void) {
 	MapRenderer_Chunks = Platform_MemAlloc(MapRenderer_ChunksCount, sizeof(ChunkInfo));
 	if (MapRenderer_Chunks == NULL) ErrorHandler_Fail("ChunkUpdater - failed to allocate chunk info");
 
-	MapRenderer_SortedChunks = Platform_MemAlloc(MapRenderer_ChunksCount, sizeof(ChunkInfo*));
-	if (MapRenderer_Chunks == NULL) ErrorHandler_Fail("ChunkUpdater - failed to allocate sorted chunk info");
-
 	MapRenderer_RenderChunks = Platform_MemAlloc(MapRenderer_ChunksCount, sizeof(ChunkInfo*));
 	if (MapRenderer_RenderChunks == NULL) ErrorHandler_Fail("ChunkUpdater - failed to allocate render chunk info");
 
 	ChunkUpdater_Distances = Platform_MemAlloc(MapRenderer_ChunksCount, sizeof(Int32));
 	if (ChunkUpdater_Distances == NULL) ErrorHandler_Fail("ChunkUpdater - failed to allocate chunk distances");
 
+	cu_occlusionQueue = Platform_MemAlloc(MapRenderer_ChunksCount, sizeof(OcclusionEntry));
+	if (cu_occlusionQueue == NULL) ErrorHandler_Fail("ChunkUpdater - failed to allocate occlusion queue");
+
+	cu_buildQueue = Platform_MemAlloc(MapRenderer_ChunksCount, sizeof(BuildEntry));
+	if (cu_buildQueue == NULL) ErrorHandler_Fail("ChunkUpdater - failed to allocate build queue");
+
+	cu_loadedChunks = Platform_MemAlloc(MapRenderer_ChunksCount, sizeof(ChunkInfo*));
+	if (cu_loadedChunks == NULL) ErrorHandler_Fail("ChunkUpdater - failed to allocate loaded chunks");
+
 	ChunkUpdater_PerformPartsAllocations();
 }
 
-void ChunkUpdater_Refresh(void) {
+/* Deletes all chunk meshes. Chunks are rebuilt, or restored from mesh cache, when next in view distance. */
+static void ChunkUpdater_Reload(void) {
 	ChunkUpdater_ChunkPos = Vector3I_MaxValue();
 	if (MapRenderer_Chunks != NULL && World_Blocks != NULL) {
 		ChunkUpdater_ClearChunkCache();
@@ -136,8 +230,13 @@ void ChunkUpdater_Refresh(void) {
 	}
 	ChunkUpdater_ResetPartCounts();
 }
-static void ChunkUpdater_Refresh_Handler(void* obj) {
-	ChunkUpdater_Refresh();
+void ChunkUpdater_Refresh(void) {
+	Builder_ClearCache();
+	ChunkUpdater_Reload();
+}
+static void ChunkUpdater_Reload_Handler(void* obj) {
+	/* Meshes were only lost from the GPU, so cached meshes are still valid */
+	ChunkUpdater_Reload();
 }
 
 void ChunkUpdater_RefreshBorders(Int32 clipLevel) {
@@ -150,7 +249,14 @@ void ChunkUpdater_RefreshBorders(Int32 clipLevel) {
 			for (x = 0; x < MapRenderer_ChunksX; x++) {
 				bool isBorder = x == 0 || z == 0 || x == (MapRenderer_ChunksX - 1) || z == (MapRenderer_ChunksZ - 1);
 				if (isBorder && (y * CHUNK_SIZE) < clipLevel) {
-					ChunkUpdater_DeleteChunk(&MapRenderer_Chunks[index]);
+					ChunkInfo* info = &MapRenderer_Chunks[index];
+					Builder_InvalidateChunk(index);
+					/* Keep drawing the old mesh until the chunk has been built again */
+					if (info->Building || info->NormalParts != NULL || info->TranslucentParts != NULL) {
+						info->PendingDelete = true;
+					} else {
+						ChunkUpdater_DeleteChunk(info);
+					}
 				}
 				index++;
 			}
@@ -163,6 +269,8 @@ void ChunkUpdater_ApplyMeshBuilder(void) {
 	if (Game_SmoothLighting) {
 		 /* TODO: Implement advanced lighting builder.*/
 		AdvLightingBuilder_SetActive();
+	} else if (Game_GreedyMeshing) {
+		GreedyBuilder_SetActive();
 	} else {
 		NormalBuilder_SetActive();
 	}
@@ -171,6 +279,7 @@ void ChunkUpdater_ApplyMeshBuilder(void) {
 static void ChunkUpdater_OnNewMap(void* obj) {
 	Game_ChunkUpdates = 0;
 	ChunkUpdater_ClearChunkCache();
+	Builder_ClearCache();
 	ChunkUpdater_ResetPartCounts();
 	ChunkUpdater_FreeAllocations();
 	ChunkUpdater_ChunkPos = Vector3I_MaxValue();
@@ -195,75 +304,341 @@ static void ChunkUpdater_OnNewMapLoaded(void* obj) {
 }
 
 
+static void ChunkUpdater_FinishChunks(Int32* chunkUpdates) {
+	ChunkInfo* info;
+	while ((info = Builder_FinishChunk()) != NULL) {
+		ChunkUpdater_OnChunkBuilt(info);
+		(*chunkUpdates)++;
+	}
+}
+
+
 static Int32 ChunkUpdater_AdjustViewDist(Int32 dist) {
 	if (dist < CHUNK_SIZE) dist = CHUNK_SIZE;
-	Int32 viewDist = Utils_AdjViewDist(dist);
-	return (viewDist + 24) * (viewDist + 24);
+	return Utils_AdjViewDist(dist) + 24;
 }
 
-static Int32 ChunkUpdater_UpdateChunksAndVisibility(Int32* chunkUpdates) {
-	Int32 i, j = 0;
-	Int32 viewDistSqr = ChunkUpdater_AdjustViewDist(Game_ViewDistance);
-	Int32 userDistSqr = ChunkUpdater_AdjustViewDist(Game_UserViewDistance);
+static Int32 ChunkUpdater_DistSqr(ChunkInfo* info) {
+	Vector3I pos = ChunkUpdater_ChunkPos;
+	Int32 dx = info->CentreX - pos.X, dy = info->CentreY - pos.Y, dz = info->CentreZ - pos.Z;
+	return dx * dx + dy * dy + dz * dz; /* TODO: do we need to cast to unsigned for the mulitplies? */
+}
 
-	for (i = 0; i < MapRenderer_ChunksCount; i++) {
-		ChunkInfo* info = MapRenderer_SortedChunks[i];
-		if (info->Empty) { continue; }
-		Int32 distSqr = ChunkUpdater_Distances[i];
-		bool noData = info->NormalParts == NULL && info->TranslucentParts == NULL;
-		
-		/* Unload chunks beyond visible range */
-		if (!noData && distSqr >= userDistSqr + 32 * 16) {
-			ChunkUpdater_DeleteChunk(info); continue;
+/* Calculates range of chunk coordinates that may be within the given distance of the camera's chunk.
+The chunk grid itself is used as the spatial index, so only chunks in this range need to be checked. */
+static void ChunkUpdater_CalcBounds(Int32 dist, Vector3I* minPos, Vector3I* maxPos) {
+	Int32 radius = (dist >> CHUNK_SHIFT) + 1;
+	Int32 cx = ChunkUpdater_ChunkPos.X >> CHUNK_SHIFT;
+	Int32 cy = ChunkUpdater_ChunkPos.Y >> CHUNK_SHIFT;
+	Int32 cz = ChunkUpdater_ChunkPos.Z >> CHUNK_SHIFT;
+
+	minPos->X = max(0, cx - radius); maxPos->X = min(MapRenderer_ChunksX - 1, cx + radius);
+	minPos->Y = max(0, cy - radius); maxPos->Y = min(MapRenderer_ChunksY - 1, cy + radius);
+	minPos->Z = max(0, cz - radius); maxPos->Z = min(MapRenderer_ChunksZ - 1, cz + radius);
+}
+
+static bool ChunkUpdater_NeedsBuild(ChunkInfo* info) {
+	if (info->Empty || info->Building) return false;
+	return info->PendingDelete || (info->NormalParts == NULL && info->TranslucentParts == NULL);
+}
+
+
+#define BuildQueue_Before(a, b) ((a).Hidden != (b).Hidden ? !(a).Hidden : (a).DistSqr < (b).DistSqr)
+
+static void BuildQueue_CalcPriority(BuildEntry* entry) {
+	ChunkInfo* info = entry->Info;
+	entry->DistSqr = ChunkUpdater_DistSqr(info);
+	entry->Hidden = !FrustumCulling_SphereInFrustum(info->CentreX, info->CentreY, info->CentreZ, 14); /* 14 ~ sqrt(3 * 8^2) */
+}
+
+static void BuildQueue_SiftUp(Int32 i) {
+	BuildEntry entry = cu_buildQueue[i];
+	while (i > 0) {
+		Int32 parent = (i - 1) >> 1;
+		if (!BuildQueue_Before(entry, cu_buildQueue[parent])) break;
+		cu_buildQueue[i] = cu_buildQueue[parent]; i = parent;
+	}
+	cu_buildQueue[i] = entry;
+}
+
+static void BuildQueue_SiftDown(Int32 i) {
+	BuildEntry entry = cu_buildQueue[i];
+	while (true) {
+		Int32 child = i * 2 + 1;
+		if (child >= cu_buildCount) break;
+		if (child + 1 < cu_buildCount && BuildQueue_Before(cu_buildQueue[child + 1], cu_buildQueue[child])) child++;
+
+		if (!BuildQueue_Before(cu_buildQueue[child], entry)) break;
+		cu_buildQueue[i] = cu_buildQueue[child]; i = child;
+	}
+	cu_buildQueue[i] = entry;
+}
+
+static void BuildQueue_Heapify(void) {
+	Int32 i;
+	for (i = (cu_buildCount >> 1) - 1; i >= 0; i--) {
+		BuildQueue_SiftDown(i);
+	}
+}
+
+/* Adds chunk to end of the queue, without restoring heap order. */
+static void BuildQueue_Add(ChunkInfo* info) {
+	BuildEntry* entry = &cu_buildQueue[cu_buildCount++];
+	entry->Info = info;
+	BuildQueue_CalcPriority(entry);
+	info->Queued = true;
+}
+
+static ChunkInfo* BuildQueue_Pop(void) {
+	ChunkInfo* info = cu_buildQueue[0].Info;
+	cu_buildQueue[0] = cu_buildQueue[--cu_buildCount];
+	if (cu_buildCount > 0) BuildQueue_SiftDown(0);
+
+	info->Queued = false;
+	return info;
+}
+
+static void BuildQueue_Clear(void) {
+	Int32 i;
+	for (i = 0; i < cu_buildCount; i++) {
+		cu_buildQueue[i].Info->Queued = false;
+	}
+	cu_buildCount = 0;
+}
+
+/* Recalculates priority of all queued chunks, as the camera has moved or rotated. */
+static void BuildQueue_UpdatePriorities(void) {
+	Int32 i;
+	for (i = 0; i < cu_buildCount; i++) {
+		BuildQueue_CalcPriority(&cu_buildQueue[i]);
+	}
+	BuildQueue_Heapify();
+}
+
+void ChunkUpdater_QueueChunk(ChunkInfo* info) {
+	if (info->Queued || cu_buildQueue == NULL) return;
+	/* Whole queue is rebuilt anyway when camera's chunk is next updated */
+	Vector3I invalid = Vector3I_MaxValue();
+	if (Vector3I_Equals(&ChunkUpdater_ChunkPos, &invalid)) return;
+
+	BuildQueue_Add(info);
+	BuildQueue_SiftUp(cu_buildCount - 1);
+}
+
+/* Queues all chunks within user view distance of the camera that need to be built. */
+static void ChunkUpdater_RefillBuildQueue(void) {
+	BuildQueue_Clear();
+	Int32 userDist = ChunkUpdater_AdjustViewDist(Game_UserViewDistance);
+	Int32 userDistSqr = userDist * userDist;
+
+	Vector3I minPos, maxPos;
+	ChunkUpdater_CalcBounds(userDist, &minPos, &maxPos);
+	Int32 x, y, z;
+
+	for (z = minPos.Z; z <= maxPos.Z; z++) {
+		for (y = minPos.Y; y <= maxPos.Y; y++) {
+			for (x = minPos.X; x <= maxPos.X; x++) {
+				ChunkInfo* info = &MapRenderer_Chunks[MapRenderer_Pack(x, y, z)];
+				if (!ChunkUpdater_NeedsBuild(info) || ChunkUpdater_DistSqr(info) > userDistSqr) continue;
+				BuildQueue_Add(info);
+			}
 		}
-		noData |= info->PendingDelete;
+	}
+	BuildQueue_Heapify();
+}
+
+/* Flood fills outwards from the chunk the camera is in, only passing through chunks that are in the frustum,
+and only between faces of a chunk that can be seen from each other. Chunks not reached are occluded.
+When the camera is outside the map, instead starts from the chunks on the sides of the map that face the camera.
+Only chunks within the given range of chunk coordinates are checked. */
+static void ChunkUpdater_UpdateOcclusion(Vector3I* minPos, Vector3I* maxPos) {
+	Vector3I pos; Vector3I_Floor(&pos, &Game_CurrentCameraPos);
+	Int32 cx = pos.X >> CHUNK_SHIFT, cy = pos.Y >> CHUNK_SHIFT, cz = pos.Z >> CHUNK_SHIFT;
+	OcclusionEntry* queue = cu_occlusionQueue;
+	Int32 head = 0, tail = 0, x, y, z;
+
+	/* Directions (as faces) travelled from the camera to reach the map, when camera is outside the map */
+	UInt8 outside = 0;
+	if (cx < minPos->X) outside |= 1 << FACE_XMAX;
+	if (cx > maxPos->X) outside |= 1 << FACE_XMIN;
+	if (cy < minPos->Y) outside |= 1 << FACE_YMAX;
+	if (cy > maxPos->Y) outside |= 1 << FACE_YMIN;
+	if (cz < minPos->Z) outside |= 1 << FACE_ZMAX;
+	if (cz > maxPos->Z) outside |= 1 << FACE_ZMIN;
+
+	for (z = minPos->Z; z <= maxPos->Z; z++) {
+		for (y = minPos->Y; y <= maxPos->Y; y++) {
+			for (x = minPos->X; x <= maxPos->X; x++) {
+				ChunkInfo* info = &MapRenderer_Chunks[MapRenderer_Pack(x, y, z)];
+				info->Occluded = true;
+				if (!outside) continue;
+
+				/* Chunk is entered through the face on the side of the map that faces the camera */
+				Face entry = FACE_COUNT; Int32 sides = 0;
+				if ((outside & (1 << FACE_XMAX)) && x == minPos->X) { entry = FACE_XMIN; sides++; }
+				if ((outside & (1 << FACE_XMIN)) && x == maxPos->X) { entry = FACE_XMAX; sides++; }
+				if ((outside & (1 << FACE_YMAX)) && y == minPos->Y) { entry = FACE_YMIN; sides++; }
+				if ((outside & (1 << FACE_YMIN)) && y == maxPos->Y) { entry = FACE_YMAX; sides++; }
+				if ((outside & (1 << FACE_ZMAX)) && z == minPos->Z) { entry = FACE_ZMIN; sides++; }
+				if ((outside & (1 << FACE_ZMIN)) && z == maxPos->Z) { entry = FACE_ZMAX; sides++; }
+
+				if (sides == 0) continue;
+				/* Chunks on an edge or corner of the map can be entered through any of those faces */
+				if (sides > 1) entry = FACE_COUNT;
+				if (!FrustumCulling_SphereInFrustum(info->CentreX, info->CentreY, info->CentreZ, 14)) continue;
+
+				info->Occluded = false;
+				queue[tail].Info = info; queue[tail].EntryFace = entry; queue[tail].Directions = outside; tail++;
+			}
+		}
+	}
 
-		if (noData && distSqr <= viewDistSqr && *chunkUpdates < cu_chunksTarget) {
-			ChunkUpdater_DeleteChunk(info);
-			ChunkUpdater_BuildChunk(info, chunkUpdates);
+	if (!outside) {
+		ChunkInfo* start = &MapRenderer_Chunks[MapRenderer_Pack(cx, cy, cz)];
+		start->Occluded = false;
+		queue[tail].Info = start; queue[tail].EntryFace = FACE_COUNT; queue[tail].Directions = 0; tail++;
+	}
+
+	while (head < tail) {
+		OcclusionEntry cur = queue[head++];
+		cx = cur.Info->CentreX >> CHUNK_SHIFT; cy = cur.Info->CentreY >> CHUNK_SHIFT; cz = cur.Info->CentreZ >> CHUNK_SHIFT;
+		Face face;
+
+		for (face = 0; face < FACE_COUNT; face++) {
+			/* Opposite faces are adjacent, e.g. FACE_XMIN and FACE_XMAX. Never travel back towards the camera. */
+			Face opposite = face ^ 1;
+			if (cur.Directions & (1 << opposite)) continue;
+			if (cur.EntryFace != FACE_COUNT && !(cur.Info->OcclusionFlags & OCCLUSION_PAIR(cur.EntryFace, face))) continue;
+
+			x = cx; y = cy; z = cz;
+			switch (face) {
+			case FACE_XMIN: x--; break;
+			case FACE_XMAX: x++; break;
+			case FACE_ZMIN: z--; break;
+			case FACE_ZMAX: z++; break;
+			case FACE_YMIN: y--; break;
+			case FACE_YMAX: y++; break;
+			}
+			if (x < minPos->X || y < minPos->Y || z < minPos->Z || x > maxPos->X || y > maxPos->Y || z > maxPos->Z) continue;
+
+			ChunkInfo* next = &MapRenderer_Chunks[MapRenderer_Pack(x, y, z)];
+			if (!next->Occluded) continue;
+			if (!FrustumCulling_SphereInFrustum(next->CentreX, next->CentreY, next->CentreZ, 14)) continue;
+
+			next->Occluded = false;
+			queue[tail].Info = next; queue[tail].EntryFace = opposite;
+			queue[tail].Directions = cur.Directions | (1 << face); tail++;
 		}
+	}
+}
+
+static void ChunkUpdater_UpdateDrawFlags(ChunkInfo* info) {
+	Vector3I pos = ChunkUpdater_ChunkPos;
+	Int32 dx = info->CentreX - pos.X, dy = info->CentreY - pos.Y, dz = info->CentreZ - pos.Z;
 
-		info->Visible = distSqr <= viewDistSqr &&
-			FrustumCulling_SphereInFrustum(info->CentreX, info->CentreY, info->CentreZ, 14); /* 14 ~ sqrt(3 * 8^2) */
-		if (info->Visible && !info->Empty) { MapRenderer_RenderChunks[j] = info; j++; }
+	/* Can work out distance to chunk faces as offset from distance to chunk centre on each axis. */
+	Int32 dXMin = dx - HALF_CHUNK_SIZE, dXMax = dx + HALF_CHUNK_SIZE;
+	Int32 dYMin = dy - HALF_CHUNK_SIZE, dYMax = dy + HALF_CHUNK_SIZE;
+	Int32 dZMin = dz - HALF_CHUNK_SIZE, dZMax = dz + HALF_CHUNK_SIZE;
+
+	/* Back face culling: make sure that the chunk is definitely entirely back facing. */
+	info->DrawXMin = !(dXMin <= 0 && dXMax <= 0);
+	info->DrawXMax = !(dXMin >= 0 && dXMax >= 0);
+	info->DrawZMin = !(dZMin <= 0 && dZMax <= 0);
+	info->DrawZMax = !(dZMin >= 0 && dZMax >= 0);
+	info->DrawYMin = !(dYMin <= 0 && dYMax <= 0);
+	info->DrawYMax = !(dYMin >= 0 && dYMax >= 0);
+}
+
+static void ChunkUpdater_QuickSort(Int32 left, Int32 right) {
+	ChunkInfo** values = MapRenderer_RenderChunks; ChunkInfo* value;
+	Int32* keys = ChunkUpdater_Distances;          Int32 key;
+	while (left < right) {
+		Int32 i = left, j = right;
+		Int32 pivot = keys[(i + j) / 2];
+
+		/* partition the list */
+		while (i <= j) {
+			while (pivot > keys[i]) i++;
+			while (pivot < keys[j]) j--;
+			QuickSort_Swap_KV_Maybe();
+		}
+		/* recurse into the smaller subset */
+		QuickSort_Recurse(ChunkUpdater_QuickSort)
+	}
+}
+
+/* Fills MapRenderer_RenderChunks with the chunks in view distance that are visible, sorted nearest first. */
+static Int32 ChunkUpdater_UpdateVisibility(void) {
+	Int32 viewDist = ChunkUpdater_AdjustViewDist(Game_ViewDistance);
+	Int32 viewDistSqr = viewDist * viewDist;
+
+	Vector3I minPos, maxPos;
+	ChunkUpdater_CalcBounds(viewDist, &minPos, &maxPos);
+	ChunkUpdater_UpdateOcclusion(&minPos, &maxPos);
+	Int32 x, y, z, count = 0;
+
+	for (z = minPos.Z; z <= maxPos.Z; z++) {
+		for (y = minPos.Y; y <= maxPos.Y; y++) {
+			for (x = minPos.X; x <= maxPos.X; x++) {
+				ChunkInfo* info = &MapRenderer_Chunks[MapRenderer_Pack(x, y, z)];
+				if (info->Empty) continue;
+				Int32 distSqr = ChunkUpdater_DistSqr(info);
+
+				info->Visible = distSqr <= viewDistSqr && !info->Occluded &&
+					FrustumCulling_SphereInFrustum(info->CentreX, info->CentreY, info->CentreZ, 14); /* 14 ~ sqrt(3 * 8^2) */
+				if (!info->Visible) continue;
+
+				ChunkUpdater_UpdateDrawFlags(info);
+				MapRenderer_RenderChunks[count] = info;
+				ChunkUpdater_Distances[count] = distSqr; count++;
+			}
+		}
 	}
-	return j;
+
+	ChunkUpdater_QuickSort(0, count - 1);
+	return count;
 }
 
-static Int32 ChunkUpdater_UpdateChunksStill(Int32* chunkUpdates) {
+/* Deletes meshes of chunks beyond user view distance. Returns whether any chunks were unloaded. */
+static bool ChunkUpdater_UnloadChunks(Int32 userDistSqr) {
 	Int32 i, j = 0;
-	Int32 viewDistSqr = ChunkUpdater_AdjustViewDist(Game_ViewDistance);
-	Int32 userDistSqr = ChunkUpdater_AdjustViewDist(Game_UserViewDistance);
+	bool unloaded = false;
 
-	for (i = 0; i < MapRenderer_ChunksCount; i++) {
-		ChunkInfo* info = MapRenderer_SortedChunks[i];
-		if (info->Empty) { continue; }
-		Int32 distSqr = ChunkUpdater_Distances[i];
+	for (i = 0; i < cu_loadedCount; i++) {
+		ChunkInfo* info = cu_loadedChunks[i];
 		bool noData = info->NormalParts == NULL && info->TranslucentParts == NULL;
 
 		/* Unload chunks beyond visible range */
-		if (!noData && distSqr >= userDistSqr + 32 * 16) {
-			ChunkUpdater_DeleteChunk(info); continue;
+		if (!noData && ChunkUpdater_DistSqr(info) >= userDistSqr + 32 * 16) {
+			ChunkUpdater_DeleteChunk(info);
+			noData = true; unloaded = true;
 		}
-		noData |= info->PendingDelete;
 
-		if (noData && distSqr <= userDistSqr && *chunkUpdates < cu_chunksTarget) {
-			ChunkUpdater_DeleteChunk(info);
-			ChunkUpdater_BuildChunk(info, chunkUpdates);
-
-			/* only need to update the visibility of chunks in range. */
-			info->Visible = distSqr <= viewDistSqr &&
-				FrustumCulling_SphereInFrustum(info->CentreX, info->CentreY, info->CentreZ, 14); /* 14 ~ sqrt(3 * 8^2) */
-			if (info->Visible && !info->Empty) { MapRenderer_RenderChunks[j] = info; j++; }
-		} else if (info->Visible) {
-			MapRenderer_RenderChunks[j] = info; j++;
+		/* Also drop chunks that were deleted elsewhere from the list */
+		if (noData) {
+			info->Loaded = false;
+		} else {
+			cu_loadedChunks[j] = info; j++;
 		}
 	}
-	return j;
+	cu_loadedCount = j;
+	return unloaded;
+}
+
+/* Builds chunks in the queue, nearest chunks in view first, until build target for this frame is reached. */
+static void ChunkUpdater_BuildQueued(Int32* chunkUpdates, Int32 userDistSqr) {
+	while (cu_buildCount > 0 && *chunkUpdates < cu_chunksTarget && Builder_CanQueue()) {
+		ChunkInfo* info = BuildQueue_Pop();
+		/* Chunk may have been built, or left view distance, since it was queued */
+		if (!ChunkUpdater_NeedsBuild(info) || ChunkUpdater_DistSqr(info) > userDistSqr) continue;
+		ChunkUpdater_BuildChunk(info, chunkUpdates);
+	}
 }
 
 void ChunkUpdater_UpdateChunks(Real64 delta) {
 	Int32 chunkUpdates = 0;
+	ChunkUpdater_FinishChunks(&chunkUpdates);
 	cu_chunksTarget += delta < cu_targetTime ? 1 : -1; /* build more chunks if 30 FPS or over, otherwise slowdown. */
 	Math_Clamp(cu_chunksTarget, 4, Game_MaxChunkUpdates);
 
@@ -273,9 +648,20 @@ void ChunkUpdater_UpdateChunks(Real64 delta) {
 	Real32 headY = p->Base.HeadY;
 
 	bool samePos = Vector3_Equals(&camPos, &cu_lastCamPos) && headX == cu_lastHeadX && headY == cu_lastHeadY;
-	MapRenderer_RenderChunksCount = samePos ?
-		ChunkUpdater_UpdateChunksStill(&chunkUpdates) :
-		ChunkUpdater_UpdateChunksAndVisibility(&chunkUpdates);
+	/* Chunks that were occluded may now be visible, or vice versa */
+	samePos &= !cu_occlusionChanged;
+	cu_occlusionChanged = false;
+
+	Int32 userDist = ChunkUpdater_AdjustViewDist(Game_UserViewDistance);
+	Int32 userDistSqr = userDist * userDist;
+	/* Different chunks may now be in the frustum, and so should be built first */
+	if (!samePos) BuildQueue_UpdatePriorities();
+
+	bool unloaded = ChunkUpdater_UnloadChunks(userDistSqr);
+	ChunkUpdater_BuildQueued(&chunkUpdates, userDistSqr);
+	if (!samePos || unloaded || chunkUpdates != 0) {
+		MapRenderer_RenderChunksCount = ChunkUpdater_UpdateVisibility();
+	}
 
 	cu_lastCamPos = camPos;
 	cu_lastHeadX = headX; cu_lastHeadY = headY;
@@ -310,13 +696,14 @@ void ChunkUpdater_CreateChunkCache(void) {
 		for (y = 0; y < World_Height; y += CHUNK_SIZE) {
 			for (x = 0; x < World_Width; x += CHUNK_SIZE) {
 				ChunkInfo_Reset(&MapRenderer_Chunks[index], x, y, z);
-				MapRenderer_SortedChunks[index] = &MapRenderer_Chunks[index];
 				MapRenderer_RenderChunks[index] = &MapRenderer_Chunks[index];
 				ChunkUpdater_Distances[index] = 0;
 				index++;
 			}
 		}
 	}
+	MapRenderer_RenderChunksCount = 0;
+	cu_buildCount = 0; cu_loadedCount = 0;
 }
 
 void ChunkUpdater_ResetChunkCache(void) {
@@ -329,9 +716,14 @@ void ChunkUpdater_ResetChunkCache(void) {
 			}
 		}
 	}
+	MapRenderer_RenderChunksCount = 0;
+	cu_buildCount = 0; cu_loadedCount = 0;
 }
 
 void ChunkUpdater_ClearChunkCache(void) {
+	/* Cancelled chunks do not need to be queued again, as all chunks are deleted anyway */
+	ChunkUpdater_ChunkPos = Vector3I_MaxValue();
+	Builder_CancelAll();
 	if (MapRenderer_Chunks == NULL) return;
 
 	Int32 i;
@@ -347,10 +739,11 @@ static void ChunkUpdater_ClearChunkCache_Handler(void* obj) {
 
 void ChunkUpdater_DeleteChunk(ChunkInfo* info) {
 	info->Empty = false; info->AllAir = false;
-#if OCCLUSION
-	info.OcclusionFlags = 0;
-	info.OccludedFlags = 0;
-#endif
+	/* Mesh being built may be outdated, so make sure chunk is built again */
+	if (info->Building) info->PendingDelete = true;
+	/* Assume all faces are connected until the chunk has been built again */
+	if (info->OcclusionFlags != OCCLUSION_ALL) cu_occlusionChanged = true;
+	info->OcclusionFlags = OCCLUSION_ALL;
 #if !CC_BUILD_GL11
 	Gfx_DeleteVb(&info->Vb);
 #endif
@@ -385,48 +778,16 @@ void ChunkUpdater_BuildChunk(ChunkInfo* info, Int32* chunkUpdates) {
 	Game_ChunkUpdates++;
 	(*chunkUpdates)++;
 	info->PendingDelete = false;
-	Builder_MakeChunk(info);
-
-	if (info->NormalParts == NULL && info->TranslucentParts == NULL) {
-		info->Empty = true;
-		return;
-	}
-	Int32 i;
+	UInt32 oldFlags = info->OcclusionFlags;
 
-	if (info->NormalParts != NULL) {
-		ChunkPartInfo* ptr = info->NormalParts;
-		for (i = 0; i < MapRenderer_1DUsedCount; i++, ptr += MapRenderer_ChunksCount) {
-			if (ptr->Offset >= 0) { MapRenderer_NormalPartsCount[i]++; }
-		}
-	}
-
-	if (info->TranslucentParts != NULL) {
-		ChunkPartInfo* ptr = info->TranslucentParts;
-		for (i = 0; i < MapRenderer_1DUsedCount; i++, ptr += MapRenderer_ChunksCount) {
-			if (ptr->Offset >= 0) { MapRenderer_TranslucentPartsCount[i]++; }
-		}
-	}
+	/* Chunks that need a mesh are finished later by ChunkUpdater_FinishChunks */
+	bool queued = Builder_QueueChunk(info);
+	if (info->OcclusionFlags != oldFlags) cu_occlusionChanged = true;
+	if (queued) return;
+	ChunkUpdater_OnChunkBuilt(info);
 }
 
-static void ChunkUpdater_QuickSort(Int32 left, Int32 right) {
-	ChunkInfo** values = MapRenderer_SortedChunks; ChunkInfo* value;
-	Int32* keys = ChunkUpdater_Distances;          Int32 key;
-	while (left < right) {
-		Int32 i = left, j = right;
-		Int32 pivot = keys[(i + j) / 2];
-
-		/* partition the list */
-		while (i <= j) {
-			while (pivot > keys[i]) i++;
-			while (pivot < keys[j]) j--;
-			QuickSort_Swap_KV_Maybe();
-		}
-		/* recurse into the smaller subset */
-		QuickSort_Recurse(ChunkUpdater_QuickSort)
-	}
-}
-
-static void ChunkUpdater_UpdateSortOrder(void) {
+static void ChunkUpdater_UpdateChunkPos(void) {
 	Vector3 cameraPos = Game_CurrentCameraPos;
 	Vector3I newChunkPos;
 	Vector3I_Floor(&newChunkPos, &cameraPos);
@@ -434,43 +795,24 @@ static void ChunkUpdater_UpdateSortOrder(void) {
 	newChunkPos.X = (newChunkPos.X & ~CHUNK_MAX) + HALF_CHUNK_SIZE;
 	newChunkPos.Y = (newChunkPos.Y & ~CHUNK_MAX) + HALF_CHUNK_SIZE;
 	newChunkPos.Z = (newChunkPos.Z & ~CHUNK_MAX) + HALF_CHUNK_SIZE;
-	/* Same chunk, therefore don't need to recalculate sort order. */
+	/* Same chunk, therefore don't need to rebuild the queue. */
 	if (Vector3I_Equals(&newChunkPos, &ChunkUpdater_ChunkPos)) return;
 
 	Vector3I pPos = newChunkPos;
 	ChunkUpdater_ChunkPos = pPos;
 	if (MapRenderer_ChunksCount == 0) return;
 
-	Int32 i = 0;
-	for (i = 0; i < MapRenderer_ChunksCount; i++) {
-		ChunkInfo* info = MapRenderer_SortedChunks[i];
-
-		/* Calculate distance to chunk centre*/
-		Int32 dx = info->CentreX - pPos.X, dy = info->CentreY - pPos.Y, dz = info->CentreZ - pPos.Z;
-		ChunkUpdater_Distances[i] = dx * dx + dy * dy + dz * dz; /* TODO: do we need to cast to unsigned for the mulitplies? */
-
-																 /* Can work out distance to chunk faces as offset from distance to chunk centre on each axis. */
-		Int32 dXMin = dx - HALF_CHUNK_SIZE, dXMax = dx + HALF_CHUNK_SIZE;
-		Int32 dYMin = dy - HALF_CHUNK_SIZE, dYMax = dy + HALF_CHUNK_SIZE;
-		Int32 dZMin = dz - HALF_CHUNK_SIZE, dZMax = dz + HALF_CHUNK_SIZE;
-
-		/* Back face culling: make sure that the chunk is definitely entirely back facing. */
-		info->DrawXMin = !(dXMin <= 0 && dXMax <= 0);
-		info->DrawXMax = !(dXMin >= 0 && dXMax >= 0);
-		info->DrawZMin = !(dZMin <= 0 && dZMax <= 0);
-		info->DrawZMax = !(dZMin >= 0 && dZMax >= 0);
-		info->DrawYMin = !(dYMin <= 0 && dYMax <= 0);
-		info->DrawYMax = !(dYMin >= 0 && dYMax >= 0);
-	}
-
-	ChunkUpdater_QuickSort(0, MapRenderer_ChunksCount - 1);
+	ChunkUpdater_RefillBuildQueue();
 	ChunkUpdater_ResetPartFlags();
 	/*SimpleOcclusionCulling();*/
 }
 
 void ChunkUpdater_Update(Real64 deltaTime) {
 	if (MapRenderer_Chunks == NULL) return;
-	ChunkUpdater_UpdateSortOrder();
+	/* Block changes this frame may have changed lighting of chunks */
+	Lighting_FlushChanges();
+	if (cu_coloursChanged) ChunkUpdater_RefreshColours();
+	ChunkUpdater_UpdateChunkPos();
 	ChunkUpdater_UpdateChunks(deltaTime);
 }
 
@@ -484,9 +826,10 @@ void ChunkUpdater_Init(void) {
 	Event_RegisterVoid(&GfxEvents_ViewDistanceChanged, NULL, ChunkUpdater_ViewDistanceChanged);
 	Event_RegisterVoid(&GfxEvents_ProjectionChanged,   NULL, ChunkUpdater_ProjectionChanged);
 	Event_RegisterVoid(&GfxEvents_ContextLost,         NULL, ChunkUpdater_ClearChunkCache_Handler);
-	Event_RegisterVoid(&GfxEvents_ContextRecreated,    NULL, ChunkUpdater_Refresh_Handler);
+	Event_RegisterVoid(&GfxEvents_ContextRecreated,    NULL, ChunkUpdater_Reload_Handler);
 
 	ChunkUpdater_ChunkPos = Vector3I_MaxValue();
+	Builder_Init();
 	ChunkUpdater_ApplyMeshBuilder();
 }
 
@@ -500,7 +843,8 @@ void ChunkUpdater_Free(void) {
 	Event_UnregisterVoid(&GfxEvents_ViewDistanceChanged, NULL, ChunkUpdater_ViewDistanceChanged);
 	Event_UnregisterVoid(&GfxEvents_ProjectionChanged,   NULL, ChunkUpdater_ProjectionChanged);
 	Event_UnregisterVoid(&GfxEvents_ContextLost,         NULL, ChunkUpdater_ClearChunkCache_Handler);
-	Event_UnregisterVoid(&GfxEvents_ContextRecreated,    NULL, ChunkUpdater_Refresh_Handler);
+	Event_UnregisterVoid(&GfxEvents_ContextRecreated,    NULL, ChunkUpdater_Reload_Handler);
 
 	ChunkUpdater_OnNewMap(NULL);
+	Builder_Free();
 }
\ No newline at end of file
@@ -3,7 +3,7 @@
 #include "Typedefs.h"
 #include "Constants.h"
 /* Manages the process of building/deleting chunk meshes.
-   Also sorts chunks so nearest chunks are ordered first, and calculates chunk visibility.
+   Also queues chunks so nearest chunks in view are built first, and calculates chunk visibility.
    Copyright 2014-2017 ClassicalSharp | Licensed under BSD-3
 */
 
@@ -17,6 +17,11 @@ typedef struct ChunkPartInfo_ {
 	UInt16 Counts[FACE_COUNT]; /* Counts per face */
 } ChunkPartInfo;
 
+/* Bit in ChunkInfo OcclusionFlags, for whether the two given faces of a chunk are connected by non-opaque blocks. */
+#define OCCLUSION_PAIR(a, b) ((a) < (b) ? (1UL << ((a) * FACE_COUNT + (b))) : (1UL << ((b) * FACE_COUNT + (a))))
+/* Value of ChunkInfo OcclusionFlags when all faces of a chunk are connected to each other. */
+#define OCCLUSION_ALL 0xFFFFFFFFUL
+
 /* Describes data necessary for rendering a chunk. */
 typedef struct ChunkInfo_ {	
 	UInt16 CentreX, CentreY, CentreZ; /* Centre coordinates of the chunk */
@@ -25,6 +30,10 @@ typedef struct ChunkInfo_ {
 	UInt8 Empty : 1;         /* Whether the chunk is empty of data */
 	UInt8 PendingDelete : 1; /* Whether chunk is pending deletion*/	
 	UInt8 AllAir : 1;        /* Whether chunk is completely air */
+	UInt8 Building : 1;      /* Whether chunk's mesh is being built on a background thread */
+	UInt8 Occluded : 1;      /* Whether chunk cannot be seen from the camera, as other chunks block view of it */
+	UInt8 Queued : 1;        /* Whether chunk is in the queue of chunks waiting to be built */
+	UInt8 Loaded : 1;        /* Whether chunk is in the list of chunks that have a mesh */
 	UInt8 : 0;               /* pad to next byte*/
 
 	UInt8 DrawXMin : 1;
@@ -34,10 +43,7 @@ typedef struct ChunkInfo_ {
 	UInt8 DrawYMin : 1;
 	UInt8 DrawYMax : 1;
 	UInt8 : 0;          /* pad to next byte */
-#if OCCLUSION
-	public bool Visited = false, Occluded = false;
-	public byte OcclusionFlags, OccludedFlags, DistanceFlags;
-#endif
+	UInt32 OcclusionFlags;   /* OCCLUSION_PAIR bits for which faces of the chunk can be seen through from each other */
 #if !CC_BUILD_GL11
 	GfxResourceID Vb;
 #endif
@@ -61,5 +67,7 @@ void ChunkUpdater_ResetChunkCache(void);
 void ChunkUpdater_ClearChunkCache(void);
 
 void ChunkUpdater_DeleteChunk(ChunkInfo* info);
+/* Adds chunk to the queue of chunks waiting to be built, if it is not already queued. */
+void ChunkUpdater_QueueChunk(ChunkInfo* info);
 void ChunkUpdater_BuildChunk(ChunkInfo* info, Int32* chunkUpdates);
 #endif
\ No newline at end of file
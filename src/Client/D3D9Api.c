@@ -12,13 +12,14 @@
 #include <d3d9caps.h>
 #include <d3d9types.h>
 
-Int32 Gfx_strideSizes[2] = GFX_STRIDE_SIZES;
+Int32 Gfx_strideSizes[3] = GFX_STRIDE_SIZES;
 D3DFORMAT d3d9_depthFormats[6] = { D3DFMT_D32, D3DFMT_D24X8, D3DFMT_D24S8, D3DFMT_D24X4S4, D3DFMT_D16, D3DFMT_D15S1 };
 D3DFORMAT d3d9_viewFormats[4] = { D3DFMT_X8R8G8B8, D3DFMT_R8G8B8, D3DFMT_R5G6B5, D3DFMT_X1R5G5B5 };
 D3DBLEND d3d9_blendFuncs[6] = { D3DBLEND_ZERO, D3DBLEND_ONE, D3DBLEND_SRCALPHA, D3DBLEND_INVSRCALPHA, D3DBLEND_DESTALPHA, D3DBLEND_INVDESTALPHA };
 D3DCMPFUNC d3d9_compareFuncs[8] = { D3DCMP_ALWAYS, D3DCMP_NOTEQUAL, D3DCMP_NEVER, D3DCMP_LESS, D3DCMP_LESSEQUAL, D3DCMP_EQUAL, D3DCMP_GREATEREQUAL, D3DCMP_GREATER };
 D3DFOGMODE d3d9_modes[3] = { D3DFOG_LINEAR, D3DFOG_EXP, D3DFOG_EXP2 };
-UInt32 d3d9_formatMappings[2] = { D3DFVF_XYZ | D3DFVF_DIFFUSE, D3DFVF_XYZ | D3DFVF_DIFFUSE | D3DFVF_TEX2 };
+/* Fixed function pipeline only supports float positions, so VERTEX_FORMAT_P3ST2FC4B cannot be mapped. */
+UInt32 d3d9_formatMappings[3] = { D3DFVF_XYZ | D3DFVF_DIFFUSE, D3DFVF_XYZ | D3DFVF_DIFFUSE | D3DFVF_TEX2, 0 };
 
 bool d3d9_vsync;
 IDirect3D9* d3d;
@@ -490,6 +491,7 @@ void Gfx_DeleteIb(GfxResourceID* ib) { D3D9_FreeResource(ib); }
 Int32 d3d9_batchFormat = -1;
 void Gfx_SetBatchFormat(Int32 format) {
 	if (format == d3d9_batchFormat) return;
+	if (format == VERTEX_FORMAT_P3ST2FC4B) ErrorHandler_Fail("D3D9 - compact vertex format is not supported");
 	d3d9_batchFormat = format;
 
 	ReturnCode hresult = IDirect3DDevice9_SetFVF(device, d3d9_formatMappings[format]);
@@ -573,7 +575,7 @@ void Gfx_CalcPerspectiveMatrix(Real32 fov, Real32 aspect, Real32 zNear, Real32 z
 }
 
 
-void Gfx_TakeScreenshot(Stream* output, Int32 width, Int32 height) {
+void Gfx_TakeScreenshot(Bitmap* bmp, Int32 width, Int32 height) {
 	IDirect3DSurface9* backbuffer;
 	IDirect3DSurface9* temp;
 	ReturnCode hresult;
@@ -590,8 +592,13 @@ void Gfx_TakeScreenshot(Stream* output, Int32 width, Int32 height) {
 	hresult = IDirect3DSurface9_LockRect(temp, &rect, NULL, D3DLOCK_READONLY | D3DLOCK_NO_DIRTY_UPDATE);
 	ErrorHandler_CheckOrFail(hresult, "Gfx_TakeScreenshot - Lock temp surface");
 
-	Bitmap bmp; Bitmap_Create(&bmp, width, height, rect.pBits);
-	Bitmap_EncodePng(&bmp, output);
+	/* Rows of the locked surface may be padded, so copy each row separately */
+	Bitmap_Allocate(bmp, width, height);
+	Int32 y;
+	for (y = 0; y < height; y++) {
+		UInt8* src = (UInt8*)rect.pBits + y * rect.Pitch;
+		Platform_MemCpy(Bitmap_GetRow(bmp, y), src, bmp->Stride);
+	}
 	hresult = IDirect3DSurface9_UnlockRect(temp);
 	ErrorHandler_CheckOrFail(hresult, "Gfx_TakeScreenshot - Unlock temp surface");
 
@@ -3,6 +3,7 @@
 #include "Funcs.h"
 #include "Platform.h"
 #include "Stream.h"
+#include "Utils.h"
 
 static bool Header_ReadByte(Stream* s, UInt8* state, Int32* value) {
 	*value = Stream_TryReadByte(s);
@@ -20,8 +21,8 @@ enum GZIP_STATE_ {
 	GZIP_STATE_HEADER1, GZIP_STATE_HEADER2,
 	GZIP_STATE_COMPRESSIONMETHOD, GZIP_STATE_FLAGS,
 	GZIP_STATE_LASTMODIFIEDTIME, GZIP_STATE_COMPRESSIONFLAGS,
-	GZIP_STATE_OPERATINGSYSTEM, GZIP_STATE_HEADERCHECKSUM,
-	GZIP_STATE_FILENAME, GZIP_STATE_COMMENT, GZIP_STATE_DONE,
+	GZIP_STATE_OPERATINGSYSTEM, GZIP_STATE_EXTRALENGTH, GZIP_STATE_EXTRA,
+	GZIP_STATE_FILENAME, GZIP_STATE_COMMENT, GZIP_STATE_HEADERCHECKSUM, GZIP_STATE_DONE,
 };
 
 void GZipHeader_Init(GZipHeader* header) {
@@ -29,6 +30,10 @@ void GZipHeader_Init(GZipHeader* header) {
 	header->Done = false;
 	header->Flags = 0;
 	header->PartsRead = 0;
+	header->Extra = NULL;
+	header->ExtraCapacity = 0;
+	header->ExtraSize = 0;
+	header->ExtraRead = 0;
 }
 
 void GZipHeader_Read(Stream* s, GZipHeader* header) {
@@ -49,7 +54,6 @@ void GZipHeader_Read(Stream* s, GZipHeader* header) {
 
 	case GZIP_STATE_FLAGS:
 		if (!Header_ReadByte(s, &header->State, &header->Flags)) return;
-		if (header->Flags & 0x04) { ErrorHandler_Fail("Unsupported GZIP header flags"); }
 
 	case GZIP_STATE_LASTMODIFIEDTIME:
 		for (; header->PartsRead < 4; header->PartsRead++) {
@@ -65,6 +69,27 @@ void GZipHeader_Read(Stream* s, GZipHeader* header) {
 	case GZIP_STATE_OPERATINGSYSTEM:
 		if (!Header_ReadByte(s, &header->State, &temp)) return;
 
+	case GZIP_STATE_EXTRALENGTH:
+		if (header->Flags & 0x04) {
+			for (; header->PartsRead < 2; header->PartsRead++) {
+				temp = Stream_TryReadByte(s);
+				if (temp == -1) return;
+				header->ExtraSize |= temp << (header->PartsRead * 8);
+			}
+		}
+		header->State++;
+		header->PartsRead = 0;
+
+	case GZIP_STATE_EXTRA:
+		if (header->Flags & 0x04) {
+			for (; header->ExtraRead < header->ExtraSize; header->ExtraRead++) {
+				temp = Stream_TryReadByte(s);
+				if (temp == -1) return;
+				if (header->ExtraRead < header->ExtraCapacity) header->Extra[header->ExtraRead] = temp;
+			}
+		}
+		header->State++;
+
 	case GZIP_STATE_FILENAME:
 		if (header->Flags & 0x08) {
 			for (; ;) {
@@ -153,9 +178,13 @@ enum INFLATE_STATE_ {
 };
 
 /* Insert this byte into the bit buffer */
-#define Inflate_GetByte(state) state->AvailIn--; state->Bits |= (UInt32)(*state->NextIn) << state->NumBits; state->NextIn++; state->NumBits += 8;
+#define Inflate_GetByte(state) state->AvailIn--; state->Bits |= (UInt64)(*state->NextIn) << state->NumBits; state->NextIn++; state->NumBits += 8;
+/* Inserts as many whole bytes as fit into the bit buffer, leaving at least 56 bits. Requires 8 bytes of input. */
+/* Bits of the partially inserted byte are identical to those of the next refill, so are harmless in the fast path. */
+#define Inflate_UNSAFE_Refill(state) state->Bits |= Inflate_ReadU64_LE(state->NextIn) << state->NumBits;\
+state->NextIn += (63 - state->NumBits) >> 3; state->AvailIn -= (63 - state->NumBits) >> 3; state->NumBits |= 56;
 /* Retrieves bits from the bit buffer */
-#define Inflate_PeekBits(state, bits) (state->Bits & ((1UL << (bits)) - 1UL))
+#define Inflate_PeekBits(state, bits) ((UInt32)(state->Bits & ((1UL << (bits)) - 1UL)))
 /* Consumes/eats up bits from the bit buffer */
 #define Inflate_ConsumeBits(state, bits) state->Bits >>= (bits); state->NumBits -= (bits);
 /* Aligns bit buffer to be on a byte boundary */
@@ -173,8 +202,13 @@ enum INFLATE_STATE_ {
 #define Inflate_NextCompressState(state) ((state->AvailIn >= INFLATE_FASTINF_IN && state->AvailOut >= INFLATE_FASTINF_OUT) ? INFLATE_STATE_FASTCOMPRESSED : INFLATE_STATE_COMPRESSED_LIT)
 /* The maximum amount of bytes that can be output is 258 */
 #define INFLATE_FASTINF_OUT 258
-/* The most input bytes required for huffman codes and extra data is 16 + 5 + 16 + 13 bits. Add 3 extra bytes to account for putting data into the bit buffer. */
-#define INFLATE_FASTINF_IN 10
+/* The most input bits required for huffman codes and extra data is 15 + 5 + 15 + 13 bits, which fits in one refill of 8 bytes */
+#define INFLATE_FASTINF_IN 8
+
+static UInt64 Inflate_ReadU64_LE(UInt8* data) {
+	return (UInt64)data[0]         | ((UInt64)data[1] << 8)  | ((UInt64)data[2] << 16) | ((UInt64)data[3] << 24)
+		| ((UInt64)data[4] << 32) | ((UInt64)data[5] << 40) | ((UInt64)data[6] << 48) | ((UInt64)data[7] << 56);
+}
 
 static UInt32 Huffman_ReverseBits(UInt32 n, UInt8 bits) {
 	n = ((n & 0xAAAA) >> 1) | ((n & 0x5555) << 1);
@@ -282,21 +316,20 @@ static Int32 Huffman_Decode(InflateState* state, HuffmanTable* table) {
 	return -1;
 }
 
+/* Bit buffer must have at least INFLATE_MAX_BITS - 1 bits. */
 static Int32 Huffman_Unsafe_Decode(InflateState* state, HuffmanTable* table) {
-	Inflate_UNSAFE_EnsureBits(state, INFLATE_MAX_BITS);
-	UInt32 codeword = Inflate_PeekBits(state, INFLATE_FAST_BITS);
-	Int32 packed = table->Fast[codeword];
+	Int32 packed = table->Fast[Inflate_PeekBits(state, INFLATE_FAST_BITS)];
 	if (packed >= 0) {
 		Int32 bits = packed >> INFLATE_FAST_BITS;
 		Inflate_ConsumeBits(state, bits);
 		return packed & 0x1FF;
 	}
 
-	/* Slow, bit by bit lookup. Need to reverse order for huffman. */
-	codeword = Huffman_ReverseBits(codeword, INFLATE_FAST_BITS);
-	UInt32 i, j;
-	for (i = INFLATE_FAST_BITS + 1, j = INFLATE_FAST_BITS; i < INFLATE_MAX_BITS; i++, j++) {
-		codeword = (codeword << 1) | ((state->Bits >> j) & 1);
+	/* Slow lookup of longer codewords. Need to reverse order for huffman. */
+	UInt32 bits = Huffman_ReverseBits(Inflate_PeekBits(state, INFLATE_MAX_BITS - 1), INFLATE_MAX_BITS - 1);
+	UInt32 i;
+	for (i = INFLATE_FAST_BITS + 1; i < INFLATE_MAX_BITS; i++) {
+		UInt32 codeword = bits >> (INFLATE_MAX_BITS - 1 - i);
 
 		if (codeword < table->EndCodewords[i]) {
 			Int32 offset = table->FirstOffsets[i] + (codeword - table->FirstCodewords[i]);
@@ -309,19 +342,6 @@ static Int32 Huffman_Unsafe_Decode(InflateState* state, HuffmanTable* table) {
 	return -1;
 }
 
-void Inflate_Init(InflateState* state, Stream* source) {
-	state->State = INFLATE_STATE_HEADER;
-	state->LastBlock = false;
-	state->Bits = 0;
-	state->NumBits = 0;
-	state->NextIn = state->Input;
-	state->AvailIn = 0;
-	state->Output = NULL;
-	state->AvailOut = 0;
-	state->Source = source;
-	state->WindowIndex = 0;
-}
-
 UInt8 fixed_lits[INFLATE_MAX_LITS] = {
 	8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8, 8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
 	8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8, 8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
@@ -350,69 +370,120 @@ UInt8 dist_bits[32] = { 0,0,0,0,1,1,2,2,3,3,
 4,4,5,5,6,6,7,7,8,8,
 9,9,10,10,11,11,12,12,13,13,0,0 };
 UInt8 codelens_order[INFLATE_MAX_CODELENS] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+/* len_base and len_bits combined into one lookup, as (bits << 16) | base. Likewise for dists */
+UInt32 inflate_lens[29], inflate_dists[30];
+bool inflate_tablesInited;
+
+static void Inflate_InitTables(void) {
+	Int32 i;
+	for (i = 0; i < 29; i++) { inflate_lens[i]  = (len_bits[i]  << 16) | len_base[i]; }
+	for (i = 0; i < 30; i++) { inflate_dists[i] = (dist_bits[i] << 16) | dist_base[i]; }
+	inflate_tablesInited = true;
+}
+
+void Inflate_Init(InflateState* state, Stream* source) {
+	state->State = INFLATE_STATE_HEADER;
+	state->LastBlock = false;
+	state->Bits = 0;
+	state->NumBits = 0;
+	state->NextIn = state->Input;
+	state->AvailIn = 0;
+	state->Output = NULL;
+	state->AvailOut = 0;
+	state->Source = source;
+	state->FlatStart = NULL;
+	state->WindowIndex = 0;
+	if (!inflate_tablesInited) Inflate_InitTables();
+}
+
+void Inflate_SetFlatOutput(InflateState* state, UInt8* data) {
+	state->FlatStart = data;
+}
+
+/* Copies data to the window, which always holds the last INFLATE_WINDOW_SIZE bytes output */
+static void Inflate_UpdateWindow(InflateState* state, UInt8* data, UInt32 count) {
+	if (count > INFLATE_WINDOW_SIZE) {
+		state->WindowIndex = (state->WindowIndex + (count - INFLATE_WINDOW_SIZE)) & INFLATE_WINDOW_MASK;
+		data += (count - INFLATE_WINDOW_SIZE); count = INFLATE_WINDOW_SIZE;
+	}
+
+	UInt32 partLen = min(count, INFLATE_WINDOW_SIZE - state->WindowIndex);
+	Platform_MemCpy(&state->Window[state->WindowIndex], data, partLen);
+	/* Wrap around remainder of copy to start from beginning of window */
+	if (partLen < count) {
+		Platform_MemCpy(state->Window, &data[partLen], count - partLen);
+	}
+	state->WindowIndex = (state->WindowIndex + count) & INFLATE_WINDOW_MASK;
+}
+
+/* Copies a match to output. Output from history onwards is contiguous, anything before that is in the window. */
+static UInt8* Inflate_CopyMatch(InflateState* state, UInt8* out, UInt8* history, UInt32 len, UInt32 dist) {
+	UInt32 i, produced = (UInt32)(out - history);
+
+	/* Start of match is before contiguous output, so is in the window */
+	if (dist > produced) {
+		UInt32 back = dist - produced, count = min(len, back);
+		UInt32 startIdx = (state->WindowIndex - back) & INFLATE_WINDOW_MASK;
+		for (i = 0; i < count; i++) {
+			*out++ = state->Window[(startIdx + i) & INFLATE_WINDOW_MASK];
+		}
+		len -= count;
+	}
+
+	UInt8* src = out - dist;
+	if (dist >= len) {
+		Platform_MemCpy(out, src, len); out += len;
+	} else if (dist == 1) {
+		/* Run of the same byte, very common in map data */
+		Platform_MemSet(out, *src, len); out += len;
+	} else {
+		for (i = 0; i < (len & ~0x3); i += 4) {
+			*out++ = *src++; *out++ = *src++; *out++ = *src++; *out++ = *src++;
+		}
+		for (; i < len; i++) { *out++ = *src++; }
+	}
+	return out;
+}
 
+/* Decodes directly into the output buffer, only copying to the window at the end */
 static void Inflate_InflateFast(InflateState* state) {
-	UInt32 copyStart = state->WindowIndex, copyLen = 0;
-	UInt8* window = state->Window;
-	UInt32 curIdx = state->WindowIndex;
+	UInt8* out      = state->Output;
+	UInt8* outStart = state->Output;
+	UInt8* history  = state->FlatStart ? state->FlatStart : outStart;
 
-#define INFLATE_FAST_COPY_MAX (INFLATE_WINDOW_SIZE - INFLATE_FASTINF_OUT)
-	while (state->AvailOut >= INFLATE_FASTINF_OUT && state->AvailIn >= INFLATE_FASTINF_IN && copyLen < INFLATE_FAST_COPY_MAX) {
+	while (state->AvailOut >= INFLATE_FASTINF_OUT && state->AvailIn >= INFLATE_FASTINF_IN) {
+		Inflate_UNSAFE_Refill(state);
 		UInt32 lit = Huffman_Unsafe_Decode(state, &state->LitsTable);
 		if (lit <= 256) {
 			//Platform_Log1("lit %i", &lit);
 			if (lit < 256) {
-				window[curIdx] = (UInt8)lit;
-				state->AvailOut--; copyLen++;
-				curIdx = (curIdx + 1) & INFLATE_WINDOW_MASK;
+				*out++ = (UInt8)lit;
+				state->AvailOut--;
 			} else {
 				state->State = Inflate_NextBlockState(state);
 				break;
 			}
 		} else {
-			UInt32 lenIdx = lit - 257;
-			UInt32 bits = len_bits[lenIdx];
-			Inflate_UNSAFE_EnsureBits(state, bits);
-			UInt32 len = len_base[lenIdx] + Inflate_ReadBits(state, bits);
+			UInt32 packed = inflate_lens[lit - 257];
+			UInt32 len = (packed & 0xFFFF) + Inflate_PeekBits(state, packed >> 16);
+			Inflate_ConsumeBits(state, packed >> 16);
 
 			UInt32 distIdx = Huffman_Unsafe_Decode(state, &state->DistsTable);
-			bits = dist_bits[distIdx];
-			Inflate_UNSAFE_EnsureBits(state, bits);
-			UInt32 dist = dist_base[distIdx] + Inflate_ReadBits(state, bits);
+			packed = inflate_dists[distIdx];
+			UInt32 dist = (packed & 0xFFFF) + Inflate_PeekBits(state, packed >> 16);
+			Inflate_ConsumeBits(state, packed >> 16);
 
 			//Platform_Log2("len %i, dist %i", &len, &dist);
-
-			UInt32 startIdx = (curIdx - dist) & INFLATE_WINDOW_MASK;
-			UInt32 i;
-			if (curIdx >= startIdx && (curIdx + len) < INFLATE_WINDOW_SIZE) {
-				UInt8* src = &window[startIdx]; UInt8* dst = &window[curIdx];
-				for (i = 0; i < (len & ~0x3); i += 4) {
-					*dst++ = *src++; *dst++ = *src++; *dst++ = *src++; *dst++ = *src++;
-				}
-				for (; i < len; i++) { *dst++ = *src++; }
-			} else {
-				for (i = 0; i < len; i++) {
-					window[(curIdx + i) & INFLATE_WINDOW_MASK] = window[(startIdx + i) & INFLATE_WINDOW_MASK];
-				}
-			}
-			curIdx = (curIdx + len) & INFLATE_WINDOW_MASK;
-			state->AvailOut -= len; copyLen += len;
+			state->AvailOut -= len;
+			out = Inflate_CopyMatch(state, out, history, len, dist);
 		}
 	}
 
-	state->WindowIndex = curIdx;
-	if (copyLen > 0) {
-		if (copyStart + copyLen < INFLATE_WINDOW_SIZE) {
-			Platform_MemCpy(state->Output, &state->Window[copyStart], copyLen);
-			state->Output += copyLen;
-		} else {
-			UInt32 partLen = INFLATE_WINDOW_SIZE - copyStart;
-			Platform_MemCpy(state->Output, &state->Window[copyStart], partLen);
-			state->Output += partLen;
-			Platform_MemCpy(state->Output, state->Window, copyLen - partLen);
-			state->Output += (copyLen - partLen);
-		}
-	}
+	/* Slow path doesn't expect partially inserted bytes (e.g. uncompressed blocks read directly from NextIn) */
+	state->Bits &= ((UInt64)1 << state->NumBits) - 1;
+	state->Output = out;
+	if (state->FlatStart) return;
+	Inflate_UpdateWindow(state, outStart, (UInt32)(out - outStart));
 }
 
 static void Inflate_Process(InflateState* state) {
@@ -462,9 +533,10 @@ static void Inflate_Process(InflateState* state) {
 		case INFLATE_STATE_UNCOMPRESSED_DATA: {
 			while (state->NumBits > 0 && state->AvailOut > 0 && state->Index > 0) {
 				*state->Output = Inflate_ReadBits(state, 8);
-				state->Window[state->WindowIndex] = *state->Output;
-
-				state->WindowIndex = (state->WindowIndex + 1) & INFLATE_WINDOW_MASK;
+				if (!state->FlatStart) {
+					state->Window[state->WindowIndex] = *state->Output;
+					state->WindowIndex = (state->WindowIndex + 1) & INFLATE_WINDOW_MASK;
+				}
 				state->Output++; state->AvailOut--;	state->Index--;
 			}
 			if (state->AvailIn == 0 || state->AvailOut == 0) return;
@@ -473,16 +545,7 @@ static void Inflate_Process(InflateState* state) {
 			copyLen = min(copyLen, state->Index);
 			if (copyLen > 0) {
 				Platform_MemCpy(state->Output, state->NextIn, copyLen);
-				UInt32 windowCopyLen = INFLATE_WINDOW_SIZE - state->WindowIndex;
-				windowCopyLen = min(windowCopyLen, copyLen);
-
-				Platform_MemCpy(&state->Window[state->WindowIndex], state->Output, windowCopyLen);
-				/* Wrap around remainder of copy to start from beginning of window */
-				if (windowCopyLen < copyLen) {
-					Platform_MemCpy(state->Window, &state->Output[windowCopyLen], copyLen - windowCopyLen);
-				}
-
-				state->WindowIndex = (state->WindowIndex + copyLen) & INFLATE_WINDOW_MASK;
+				if (!state->FlatStart) Inflate_UpdateWindow(state, state->Output, copyLen);
 				state->Output += copyLen; state->AvailOut -= copyLen; state->Index -= copyLen;
 				state->NextIn += copyLen; state->AvailIn -= copyLen;		
 			}
@@ -589,9 +652,11 @@ static void Inflate_Process(InflateState* state) {
 				if (lit == -1) return;
 				//Platform_Log1("lit %i", &lit);
 				*state->Output = (UInt8)lit;
-				state->Window[state->WindowIndex] = (UInt8)lit;
+				if (!state->FlatStart) {
+					state->Window[state->WindowIndex] = (UInt8)lit;
+					state->WindowIndex = (state->WindowIndex + 1) & INFLATE_WINDOW_MASK;
+				}
 				state->Output++; state->AvailOut--;
-				state->WindowIndex = (state->WindowIndex + 1) & INFLATE_WINDOW_MASK;
 				break;
 			} else if (lit == 256) {
 				state->State = Inflate_NextBlockState(state);
@@ -631,6 +696,14 @@ static void Inflate_Process(InflateState* state) {
 			UInt32 len = state->TmpLit, dist = state->TmpDist;
 			len = min(len, state->AvailOut);
 
+			if (state->FlatStart) {
+				state->Output = Inflate_CopyMatch(state, state->Output, state->FlatStart, len, dist);
+				state->TmpLit -= len;
+				state->AvailOut -= len;
+				if (state->TmpLit == 0) { state->State = Inflate_NextCompressState(state); }
+				break;
+			}
+
 			/* TODO: Should we test outside of the loop, whether a masking will be required or not? */
 			UInt32 startIdx = (state->WindowIndex - dist) & INFLATE_WINDOW_MASK, curIdx = state->WindowIndex;
 			UInt32 i;
@@ -662,6 +735,33 @@ static void Inflate_Process(InflateState* state) {
 	}
 }
 
+static ReturnCode Inflate_FillInput(InflateState* state, bool* hasInput) {
+	UInt32 read;
+	/* Decompress directly from memory (e.g. a memory mapped file), instead of copying into Input first */
+	UInt8* mem = Stream_UNSAFE_GetMemory(state->Source, &read);
+	if (mem != NULL) {
+		state->NextIn  = read ? mem : state->Input;
+		state->AvailIn = read;
+		*hasInput = read > 0;
+		return Stream_Skip(state->Source, read);
+	}
+
+	/* Fully used up input buffer. Cycle back to start. */
+	UInt8* inputEnd = state->Input + INFLATE_MAX_INPUT;
+	if (state->NextIn == inputEnd) state->NextIn = state->Input;
+
+	UInt8* cur = state->NextIn;
+	UInt32 remaining = (UInt32)(inputEnd - state->NextIn);
+	ReturnCode code = state->Source->Read(state->Source, cur, remaining, &read);
+	if (code != 0) return code;
+
+	/* Did we fail to read in more input data? Can't immediately return here, 
+	/* because there might be a few bits of data left in the bit buffer */
+	*hasInput = read > 0;
+	state->AvailIn += read;
+	return 0;
+}
+
 static ReturnCode Inflate_StreamRead(Stream* stream, UInt8* data, UInt32 count, UInt32* modified) {
 	InflateState* state = (InflateState*)stream->Meta_Inflate;
 	*modified = 0;
@@ -672,19 +772,8 @@ static ReturnCode Inflate_StreamRead(Stream* stream, UInt8* data, UInt32 count,
 	while (state->AvailOut > 0 && hasInput) {
 		if (state->State == INFLATE_STATE_DONE) break;
 		if (state->AvailIn == 0) {
-			/* Fully used up input buffer. Cycle back to start. */
-			UInt8* inputEnd = state->Input + INFLATE_MAX_INPUT;
-			if (state->NextIn == inputEnd) state->NextIn = state->Input;
-
-			UInt8* cur = state->NextIn;
-			UInt32 read, remaining = (UInt32)(inputEnd - state->NextIn);
-			ReturnCode code = state->Source->Read(state->Source, cur, remaining, &read);
+			ReturnCode code = Inflate_FillInput(state, &hasInput);
 			if (code != 0) return code;
-
-			/* Did we fail to read in more input data? Can't immediately return here, 
-			/* because there might be a few bits of data left in the bit buffer */
-			hasInput = read > 0;
-			state->AvailIn += read;
 		}
 		
 		/* Reading data reduces available out */
@@ -718,125 +807,457 @@ void Inflate_MakeStream(Stream* stream, InflateState* state, Stream* underlying)
 #define Deflate_FlushBits(state) while (state->NumBits >= 8) { Deflate_WriteByte(state); }
 
 #define DEFLATE_MAX_MATCH_LEN 258
-static Int32 Deflate_MatchLen(UInt8* a, UInt8* b, Int32 maxLen) {
-	Int32 i = 0;
-	while (i < maxLen && *a == *b) { i++; a++; b++; }
-	return i;
+/* Largest codeword length for literal/length and distance huffman codes */
+#define DEFLATE_MAX_CODE_BITS 15
+/* Largest codeword length for the huffman code used to encode codeword lengths */
+#define DEFLATE_MAX_CODELENS_BITS 7
+#define DEFLATE_END_OF_BLOCK 256
+/* Number of symbols between checks of whether to split the current block */
+#define DEFLATE_SPLIT_INTERVAL 2048
+/* Leave room in output buffer for a few bytes and symbols */
+#define DEFLATE_OUT_RESERVE 20
+
+/* Max hash chain entries searched, match length that stops the search, whether to use lazy matching */
+typedef struct DeflateLevel_ { UInt16 MaxChain, NiceLen; bool LazyMatch; } DeflateLevel;
+DeflateLevel deflate_levels[DEFLATE_LEVEL_BEST] = {
+	{    4,   8, false }, {    8,  16, false }, {   16,  32, false },
+	{   16,  16, true  }, {   32,  32, true  }, {  128, 128, true  },
+	{  256, 258, true  }, { 1024, 258, true  }, { 4096, 258, true  },
+};
+
+UInt8 deflate_lenSyms[DEFLATE_MAX_MATCH_LEN + 1]; /* Index into len_base for each match length */
+UInt8 deflate_distSyms[512]; /* Index into dist_base for (dist - 1) if <= 256, else 256 + ((dist - 1) >> 7) */
+UInt8 deflate_rleBits[3] = { 2, 3, 7 };
+bool deflate_tablesInited;
+
+static void Deflate_InitTables(void) {
+	Int32 i, j;
+	for (i = 3, j = 0; i <= DEFLATE_MAX_MATCH_LEN; i++) {
+		if (j < 28 && i >= len_base[j + 1]) j++;
+		deflate_lenSyms[i] = j;
+	}
+
+	/* Distances above 256 all start on a multiple of 128 (plus 1) */
+	for (i = 1, j = 0; i <= 256; i++) {
+		if (i >= dist_base[j + 1]) j++;
+		deflate_distSyms[i - 1] = j;
+	}
+	for (i = 257; i <= INFLATE_WINDOW_SIZE; i += 128) {
+		while (j < 29 && i >= dist_base[j + 1]) j++;
+		deflate_distSyms[256 + ((i - 1) >> 7)] = j;
+	}
+	deflate_tablesInited = true;
 }
 
-static UInt32 Deflate_Hash(UInt8* src) {
-	return (UInt32)((src[0] << 8) ^ (src[1] << 4) ^ (src[2])) & DEFLATE_HASH_MASK;
+static Int32 Deflate_DistSym(Int32 dist) {
+	return dist <= 256 ? deflate_distSyms[dist - 1] : deflate_distSyms[256 + ((dist - 1) >> 7)];
 }
 
-static void Deflate_Lit(DeflateState* state, Int32 lit) {
-	if (lit <= 143) { Deflate_PushHuff(state, lit + 48, 8); } 
-	else { Deflate_PushHuff(state, lit + 256, 9); }
-	Deflate_FlushBits(state);
+/* Calculates huffman codeword lengths for the given symbol frequencies, limited to maxBits.
+Based off in-place algorithm from "In-Place Calculation of Minimum-Redundancy Codes" (Moffat, Katajainen) */
+static void Deflate_BuildLengths(UInt32* freqs, Int32 count, UInt8* lens, Int32 maxBits) {
+	UInt16 syms[INFLATE_MAX_LITS];
+	UInt32 A[INFLATE_MAX_LITS];
+	UInt32 blCount[INFLATE_MAX_BITS] = { 0 };
+	Int32 i, j, n = 0;
+
+	/* Sort used symbols by ascending frequency */
+	for (i = 0; i < count; i++) {
+		lens[i] = 0;
+		if (!freqs[i]) continue;
+
+		for (j = n; j > 0 && A[j - 1] > freqs[i]; j--) {
+			A[j] = A[j - 1]; syms[j] = syms[j - 1];
+		}
+		A[j] = freqs[i]; syms[j] = i; n++;
+	}
+
+	/* Always use at least two codewords, so the code is complete */
+	if (n == 0) { lens[0] = 1; lens[1] = 1; return; }
+	if (n == 1) { lens[syms[0]] = 1; lens[syms[0] ? 0 : 1] = 1; return; }
+
+	/* Combine nodes, replacing frequencies with parent indices */
+	Int32 root = 0, leaf = 2, next, avail, used, depth;
+	A[0] += A[1];
+	for (next = 1; next < n - 1; next++) {
+		if (leaf >= n || A[root] < A[leaf]) { A[next] = A[root]; A[root++] = next; }
+		else { A[next] = A[leaf++]; }
+
+		if (leaf >= n || (root < next && A[root] < A[leaf])) { A[next] += A[root]; A[root++] = next; }
+		else { A[next] += A[leaf++]; }
+	}
+
+	/* Convert parent indices to depths of internal nodes */
+	A[n - 2] = 0;
+	for (next = n - 3; next >= 0; next--) { A[next] = A[A[next]] + 1; }
+
+	/* Convert internal node depths to leaf depths */
+	avail = 1; used = 0; depth = 0; root = n - 2; next = n - 1;
+	while (avail > 0) {
+		while (root >= 0 && (Int32)A[root] == depth) { used++; root--; }
+		while (avail > used) { A[next--] = depth; avail--; }
+		avail = 2 * used; depth++; used = 0;
+	}
+
+	/* Clamp to maxBits, then lengthen shorter codewords until the code is complete again */
+	for (i = 0; i < n; i++) { blCount[min((Int32)A[i], maxBits)]++; }
+	UInt32 total = 0;
+	for (i = maxBits; i > 0; i--) { total += blCount[i] << (maxBits - i); }
+
+	while (total != (1UL << maxBits)) {
+		blCount[maxBits]--;
+		for (i = maxBits - 1; i > 0; i--) {
+			if (!blCount[i]) continue;
+			blCount[i]--; blCount[i + 1] += 2; break;
+		}
+		total--;
+	}
 
-	//Platform_Log1("lit %i", &lit);
+	/* Least frequent symbols get the longest codewords */
+	for (i = maxBits, j = 0; i > 0; i--) {
+		UInt32 k;
+		for (k = blCount[i]; k > 0; k--) { lens[syms[j++]] = i; }
+	}
 }
 
-static void Deflate_LenDist(DeflateState* state, Int32 len, Int32 dist) {
-	Int32 j;
-	len_base[29]  = UInt16_MaxValue;
-	dist_base[30] = UInt16_MaxValue;
-	/* TODO: Remove this hack out into Deflate_FlushBlock */
-	/* TODO: is that hack even thread-safe */
-	/* TODO: Do we actually need the if (len_bits[j]) ????????? does writing 0 bits matter??? */
+static void Deflate_BuildCodes(UInt8* lens, Int32 count, UInt16* codes) {
+	UInt16 blCount[INFLATE_MAX_BITS] = { 0 }, nextCode[INFLATE_MAX_BITS];
+	UInt16 code = 0;
+	Int32 i;
 
-	for (j = 0; len >= len_base[j + 1]; j++);
-	if (j <= 22) { Deflate_PushHuff(state, j + 1, 7); }
-	else { Deflate_PushHuff(state, j + 169, 8); }
-	if (len_bits[j]) { Deflate_PushBits(state, len - len_base[j], len_bits[j]); }
-	Deflate_FlushBits(state);
+	for (i = 0; i < count; i++) { blCount[lens[i]]++; }
+	blCount[0] = 0;
+	for (i = 1; i < INFLATE_MAX_BITS; i++) {
+		code = (code + blCount[i - 1]) << 1;
+		nextCode[i] = code;
+	}
+	for (i = 0; i < count; i++) {
+		codes[i] = lens[i] ? nextCode[lens[i]]++ : 0;
+	}
+}
 
-	for (j = 0; dist >= dist_base[j + 1]; j++);
-	Deflate_PushHuff(state, j, 5);
-	if (dist_bits[j]) { Deflate_PushBits(state, dist - dist_base[j], dist_bits[j]); }
+typedef struct DeflateBlock_ {
+	UInt8 LitLens[DEFLATE_NUM_LITS];   UInt16 LitCodes[INFLATE_MAX_LITS];
+	UInt8 DistLens[DEFLATE_NUM_DISTS]; UInt16 DistCodes[DEFLATE_NUM_DISTS];
+	UInt8 CodeLensLens[INFLATE_MAX_CODELENS]; UInt16 CodeLensCodes[INFLATE_MAX_CODELENS];
+	UInt32 CodeLensFreqs[INFLATE_MAX_CODELENS];
+
+	UInt8 Rle[INFLATE_MAX_LITS_DISTS];      /* Run length encoded literal/length and distance codeword lengths */
+	UInt8 RleExtra[INFLATE_MAX_LITS_DISTS]; /* Repeat count for symbols 16 to 18 in Rle */
+	Int32 NumRle, NumLits, NumDists, NumCodeLens;
+	UInt32 FixedBits, DynamicBits; /* Size of block with fixed or dynamic huffman codes, excluding extra bits */
+} DeflateBlock;
+
+static void Deflate_AddRle(DeflateBlock* b, UInt8 sym, UInt8 extra) {
+	b->Rle[b->NumRle] = sym; b->RleExtra[b->NumRle] = extra;
+	b->NumRle++;
+	b->CodeLensFreqs[sym]++;
+}
+
+/* Calculates dynamic huffman codeword lengths for a block with the given symbol frequencies,
+and the size of the block when encoded using either fixed or dynamic huffman codes. */
+static void Deflate_PlanBlock(DeflateBlock* b, UInt32* litFreqs, UInt32* distFreqs) {
+	UInt8 lens[INFLATE_MAX_LITS_DISTS];
+	Int32 i, total, prev = -1;
+
+	litFreqs[DEFLATE_END_OF_BLOCK] = 1;
+	Deflate_BuildLengths(litFreqs,  DEFLATE_NUM_LITS,  b->LitLens,  DEFLATE_MAX_CODE_BITS);
+	Deflate_BuildLengths(distFreqs, DEFLATE_NUM_DISTS, b->DistLens, DEFLATE_MAX_CODE_BITS);
+
+	b->FixedBits   = 3;
+	b->DynamicBits = 3 + 5 + 5 + 4;
+	for (i = 0; i < DEFLATE_NUM_LITS; i++) {
+		b->FixedBits   += litFreqs[i] * fixed_lits[i];
+		b->DynamicBits += litFreqs[i] * b->LitLens[i];
+	}
+	for (i = 0; i < DEFLATE_NUM_DISTS; i++) {
+		b->FixedBits   += distFreqs[i] * fixed_dists[i];
+		b->DynamicBits += distFreqs[i] * b->DistLens[i];
+	}
+
+	for (b->NumLits = DEFLATE_NUM_LITS; b->NumLits > 257 && !b->LitLens[b->NumLits - 1]; b->NumLits--) {}
+	for (b->NumDists = DEFLATE_NUM_DISTS; b->NumDists > 1 && !b->DistLens[b->NumDists - 1]; b->NumDists--) {}
+	Platform_MemCpy(lens, b->LitLens, b->NumLits);
+	Platform_MemCpy(&lens[b->NumLits], b->DistLens, b->NumDists);
+	total = b->NumLits + b->NumDists;
+
+	b->NumRle = 0;
+	Platform_MemSet(b->CodeLensFreqs, 0, sizeof(b->CodeLensFreqs));
+	for (i = 0; i < total;) {
+		Int32 len = lens[i], run = 1, rep;
+		while (i + run < total && lens[i + run] == len) run++;
+
+		if (len == 0 && run >= 3) {
+			rep = min(run, 138);
+			if (rep >= 11) { Deflate_AddRle(b, 18, rep - 11); }
+			else { Deflate_AddRle(b, 17, rep - 3); }
+		} else if (len == prev && run >= 3) {
+			rep = min(run, 6);
+			Deflate_AddRle(b, 16, rep - 3);
+		} else {
+			rep = 1;
+			Deflate_AddRle(b, len, 0);
+		}
+		i += rep; prev = len;
+	}
+
+	Deflate_BuildLengths(b->CodeLensFreqs, INFLATE_MAX_CODELENS, b->CodeLensLens, DEFLATE_MAX_CODELENS_BITS);
+	for (b->NumCodeLens = INFLATE_MAX_CODELENS; b->NumCodeLens > 4 && !b->CodeLensLens[codelens_order[b->NumCodeLens - 1]]; b->NumCodeLens--) {}
+
+	b->DynamicBits += b->NumCodeLens * 3;
+	for (i = 0; i < INFLATE_MAX_CODELENS; i++) {
+		b->DynamicBits += b->CodeLensFreqs[i] * b->CodeLensLens[i];
+	}
+	for (i = 16; i < INFLATE_MAX_CODELENS; i++) {
+		b->DynamicBits += b->CodeLensFreqs[i] * deflate_rleBits[i - 16];
+	}
+}
+
+static UInt32 Deflate_BlockBits(UInt32* litFreqs, UInt32* distFreqs) {
+	DeflateBlock b;
+	Deflate_PlanBlock(&b, litFreqs, distFreqs);
+	return min(b.FixedBits, b.DynamicBits);
+}
+
+static ReturnCode Deflate_WriteOutput(DeflateState* state) {
+	ReturnCode result = Stream_TryWrite(state->Dest, state->Output, DEFLATE_OUT_SIZE - state->AvailOut);
+	state->NextOut  = state->Output;
+	state->AvailOut = DEFLATE_OUT_SIZE;
+	return result;
+}
+
+/* Writes the first count buffered symbols as one block, using whichever of fixed or dynamic huffman codes is smaller */
+static ReturnCode Deflate_WriteBlock(DeflateState* state, Int32 count, UInt32* litFreqs, UInt32* distFreqs, bool final) {
+	DeflateBlock b;
+	UInt8* litLens; UInt8* distLens;
+	Int32 i, numLits = DEFLATE_NUM_LITS;
+	ReturnCode result;
+
+	Deflate_PlanBlock(&b, litFreqs, distFreqs);
+	if (b.DynamicBits < b.FixedBits) {
+		Deflate_PushBits(state, final | (2 << 1), 3); /* block type DYNAMIC */
+		Deflate_PushBits(state, b.NumLits - 257, 5);
+		Deflate_PushBits(state, b.NumDists - 1, 5);
+		Deflate_PushBits(state, b.NumCodeLens - 4, 4);
+		Deflate_FlushBits(state);
+
+		for (i = 0; i < b.NumCodeLens; i++) {
+			Deflate_PushBits(state, b.CodeLensLens[codelens_order[i]], 3);
+			Deflate_FlushBits(state);
+		}
+
+		Deflate_BuildCodes(b.CodeLensLens, INFLATE_MAX_CODELENS, b.CodeLensCodes);
+		for (i = 0; i < b.NumRle; i++) {
+			UInt8 sym = b.Rle[i];
+			Deflate_PushHuff(state, b.CodeLensCodes[sym], b.CodeLensLens[sym]);
+			if (sym >= 16) { Deflate_PushBits(state, b.RleExtra[i], deflate_rleBits[sym - 16]); }
+			Deflate_FlushBits(state);
+
+			if (state->AvailOut >= DEFLATE_OUT_RESERVE) continue;
+			result = Deflate_WriteOutput(state);
+			if (result != 0) return result;
+		}
+		litLens = b.LitLens; distLens = b.DistLens;
+	} else {
+		Deflate_PushBits(state, final | (1 << 1), 3); /* block type FIXED */
+		litLens = fixed_lits; distLens = fixed_dists;
+		/* Fixed codes are assigned over all 288 literal/length symbols */
+		numLits = INFLATE_MAX_LITS;
+	}
+
+	Deflate_BuildCodes(litLens,  numLits,           b.LitCodes);
+	Deflate_BuildCodes(distLens, DEFLATE_NUM_DISTS, b.DistCodes);
+
+	for (i = 0; i < count; i++) {
+		Int32 len = state->SymLens[i], dist = state->SymDists[i];
+		if (dist) {
+			Int32 lenSym = deflate_lenSyms[len], distSym = Deflate_DistSym(dist);
+			Deflate_PushHuff(state, b.LitCodes[lenSym + 257], litLens[lenSym + 257]);
+			Deflate_PushBits(state, len - len_base[lenSym], len_bits[lenSym]);
+			Deflate_FlushBits(state);
+
+			Deflate_PushHuff(state, b.DistCodes[distSym], distLens[distSym]);
+			Deflate_FlushBits(state);
+			Deflate_PushBits(state, dist - dist_base[distSym], dist_bits[distSym]);
+		} else {
+			Deflate_PushHuff(state, b.LitCodes[len], litLens[len]);
+		}
+		Deflate_FlushBits(state);
+
+		if (state->AvailOut >= DEFLATE_OUT_RESERVE) continue;
+		result = Deflate_WriteOutput(state);
+		if (result != 0) return result;
+	}
+
+	Deflate_PushHuff(state, b.LitCodes[DEFLATE_END_OF_BLOCK], litLens[DEFLATE_END_OF_BLOCK]);
 	Deflate_FlushBits(state);
+	return 0;
+}
 
-	//Platform_Log2("len %i, dist %i", &len, &dist);
+/* Merges the last segment of symbols into the current block, unless the block and segment
+are smaller when written as separate blocks. (i.e. symbol statistics changed enough) */
+static ReturnCode Deflate_EndSegment(DeflateState* state) {
+	UInt32 joinedLits[DEFLATE_NUM_LITS], joinedDists[DEFLATE_NUM_DISTS];
+	UInt32 start = state->SegmentStart, count = state->NumSymbols - start;
+	ReturnCode result;
+	Int32 i;
+
+	for (i = 0; i < DEFLATE_NUM_LITS; i++)  { joinedLits[i]  = state->BlockLits[i]  + state->SegmentLits[i]; }
+	for (i = 0; i < DEFLATE_NUM_DISTS; i++) { joinedDists[i] = state->BlockDists[i] + state->SegmentDists[i]; }
+
+	bool split = start && count
+		&& Deflate_BlockBits(state->BlockLits, state->BlockDists) + Deflate_BlockBits(state->SegmentLits, state->SegmentDists)
+		< Deflate_BlockBits(joinedLits, joinedDists);
+
+	if (split) {
+		result = Deflate_WriteBlock(state, start, state->BlockLits, state->BlockDists, false);
+		if (result != 0) return result;
+
+		/* Segment is always shorter than the written block, so can't overlap */
+		Platform_MemCpy(state->SymLens,  &state->SymLens[start],  count * sizeof(UInt16));
+		Platform_MemCpy(state->SymDists, &state->SymDists[start], count * sizeof(UInt16));
+		state->NumSymbols = count;
+		Platform_MemCpy(state->BlockLits,  state->SegmentLits,  sizeof(state->BlockLits));
+		Platform_MemCpy(state->BlockDists, state->SegmentDists, sizeof(state->BlockDists));
+	} else {
+		Platform_MemCpy(state->BlockLits,  joinedLits,  sizeof(state->BlockLits));
+		Platform_MemCpy(state->BlockDists, joinedDists, sizeof(state->BlockDists));
+	}
 
-	len_base[29]  = 0;
-	dist_base[30] = 0;
+	Platform_MemSet(state->SegmentLits,  0, sizeof(state->SegmentLits));
+	Platform_MemSet(state->SegmentDists, 0, sizeof(state->SegmentDists));
+	state->SegmentStart = state->NumSymbols;
+	if (state->NumSymbols < DEFLATE_MAX_SYMBOLS) return 0;
+
+	/* Symbols buffer is full, so have to end the block here */
+	result = Deflate_WriteBlock(state, state->NumSymbols, state->BlockLits, state->BlockDists, false);
+	state->NumSymbols   = 0;
+	state->SegmentStart = 0;
+	Platform_MemSet(state->BlockLits,  0, sizeof(state->BlockLits));
+	Platform_MemSet(state->BlockDists, 0, sizeof(state->BlockDists));
+	return result;
 }
 
-static ReturnCode Deflate_FlushBlock(DeflateState* state, Int32 len) {
-	if (!state->WroteHeader) {
-		state->WroteHeader = true;
-		Deflate_PushBits(state, 2, 3); /* final block TRUE, block type FIXED */
+/* Adds a literal (dist of 0) or match to the buffered symbols of the current block */
+static ReturnCode Deflate_AddSymbol(DeflateState* state, Int32 len, Int32 dist) {
+	state->SymLens[state->NumSymbols]  = len;
+	state->SymDists[state->NumSymbols] = dist;
+	state->NumSymbols++;
+
+	if (dist) {
+		state->SegmentLits[deflate_lenSyms[len] + 257]++;
+		state->SegmentDists[Deflate_DistSym(dist)]++;
+	} else {
+		state->SegmentLits[len]++;
 	}
 
-	/* TODO: Hash chains should persist past one block flush */
-	Platform_MemSet(state->Head, 0, sizeof(state->Head));
-	Platform_MemSet(state->Prev, 0, sizeof(state->Prev));
+	if (state->NumSymbols - state->SegmentStart < DEFLATE_SPLIT_INTERVAL) return 0;
+	return Deflate_EndSegment(state);
+}
+
+static Int32 Deflate_MatchLen(UInt8* a, UInt8* b, Int32 maxLen) {
+	Int32 i = 0;
+	while (i < maxLen && *a == *b) { i++; a++; b++; }
+	return i;
+}
+
+static UInt32 Deflate_Hash(UInt8* src) {
+	return (UInt32)((src[0] << 6) ^ (src[1] << 3) ^ (src[2])) & DEFLATE_HASH_MASK;
+}
+
+static void Deflate_Insert(DeflateState* state, Int32 pos, UInt32 hash) {
+	state->Prev[pos & DEFLATE_WINDOW_MASK] = state->Head[hash];
+	state->Head[hash] = pos;
+}
+
+/* Moves the last DEFLATE_WINDOW_SIZE bytes of input to the start of the input buffer */
+static void Deflate_SlideWindow(DeflateState* state) {
+	Int32 i;
+	Platform_MemCpy(state->Input, &state->Input[DEFLATE_WINDOW_SIZE], DEFLATE_WINDOW_SIZE);
+	state->InputPosition -= DEFLATE_WINDOW_SIZE;
+	state->NextPosition  -= DEFLATE_WINDOW_SIZE;
+
+	/* Positions that fall out of the window end their hash chain */
+	for (i = 0; i < DEFLATE_HASH_SIZE; i++) {
+		UInt16 pos = state->Head[i];
+		state->Head[i] = pos >= DEFLATE_WINDOW_SIZE ? pos - DEFLATE_WINDOW_SIZE : 0;
+	}
+	for (i = 0; i < DEFLATE_WINDOW_SIZE; i++) {
+		UInt16 pos = state->Prev[i];
+		state->Prev[i] = pos >= DEFLATE_WINDOW_SIZE ? pos - DEFLATE_WINDOW_SIZE : 0;
+	}
+}
 
+/* Compresses buffered input, then slides the window along if the input buffer is full.
+Unless finished, the last DEFLATE_MAX_MATCH_LEN bytes are left for later, so matches aren't cut short. */
+static ReturnCode Deflate_ProcessInput(DeflateState* state, bool finished) {
 	/* Based off descriptions from http://www.gzip.org/algorithm.txt and
 	https://github.com/nothings/stb/blob/master/stb_image_write.h */
 	UInt8* src = state->Input;
-	UInt8* cur = src;
+	Int32 end  = state->InputPosition;
+	Int32 stop = finished ? end : end - DEFLATE_MAX_MATCH_LEN;
+	Int32 cur  = state->NextPosition;
+	ReturnCode result;
+
+	while (cur < stop) {
+		Int32 len = end - cur;
+		/* literals for last few bytes */
+		if (len <= 3) {
+			result = Deflate_AddSymbol(state, src[cur], 0);
+			if (result != 0) return result;
+			cur++; continue;
+		}
 
-	while (len > 3) {
-		UInt32 hash = Deflate_Hash(cur);
+		UInt32 hash = Deflate_Hash(&src[cur]);
 		Int32 maxLen = min(len, DEFLATE_MAX_MATCH_LEN);
+		/* Matches can't be DEFLATE_WINDOW_SIZE or more bytes back */
+		Int32 limit = max(cur - (Int32)DEFLATE_WINDOW_SIZE, 0);
+		Int32 nextLimit = max(cur + 1 - (Int32)DEFLATE_WINDOW_SIZE, 0);
 
 		Int32 bestLen = 3 - 1; /* Match must be at least 3 bytes */
 		Int32 bestPos = 0;
 
-		Int32 pos = state->Head[hash];
-		while (pos != 0) { /* TODO: Need to limit chain length here */
-			Int32 matchLen = Deflate_MatchLen(&src[pos], cur, maxLen);
-			if (matchLen > bestLen) { bestLen = matchLen; bestPos = pos; }
-			pos = state->Prev[pos];
+		Int32 pos = state->Head[hash], chain = state->MaxChain;
+		while (pos > limit && chain-- > 0) {
+			Int32 matchLen = Deflate_MatchLen(&src[pos], &src[cur], maxLen);
+			if (matchLen > bestLen) {
+				bestLen = matchLen; bestPos = pos;
+				if (bestLen >= state->NiceLen) break;
+			}
+			pos = state->Prev[pos & DEFLATE_WINDOW_MASK];
 		}
-
-		/* Insert this entry into the hash chain */
-		pos = (Int32)(cur - src);
-		UInt16 oldHead = state->Head[hash];
-		state->Head[hash] = pos;
-		state->Prev[pos] = oldHead;
+		Deflate_Insert(state, cur, hash);
 
 		/* Lazy evaluation: Find longest match starting at next byte */
 		/* If that's longer than the longest match at current byte, throwaway this match */
-		if (bestPos && len > 2) {
-			UInt32 nextHash = Deflate_Hash(cur + 1);
-			Int32 nextPos = state->Head[nextHash];
+		if (bestPos && state->LazyMatch && bestLen < state->NiceLen) {
+			Int32 nextPos = state->Head[Deflate_Hash(&src[cur + 1])];
 			maxLen = min(len - 1, DEFLATE_MAX_MATCH_LEN);
+			chain  = state->MaxChain;
 
-			while (nextPos != 0) { /* TODO: Need to limit chain length here */
-				Int32 matchLen = Deflate_MatchLen(&src[nextPos], cur + 1, maxLen);
+			while (nextPos > nextLimit && chain-- > 0) {
+				Int32 matchLen = Deflate_MatchLen(&src[nextPos], &src[cur + 1], maxLen);
 				if (matchLen > bestLen) { bestPos = 0; break; }
-				nextPos = state->Prev[nextPos];
+				nextPos = state->Prev[nextPos & DEFLATE_WINDOW_MASK];
 			}
 		}
 
 		if (bestPos) {
-			Deflate_LenDist(state, bestLen, pos - bestPos);
-			len -= bestLen; cur += bestLen;
+			result = Deflate_AddSymbol(state, bestLen, cur - bestPos);
+			/* Insert the other bytes of the match into the hash chains too */
+			for (pos = cur + 1, cur += bestLen; pos < cur && pos + 3 <= end; pos++) {
+				Deflate_Insert(state, pos, Deflate_Hash(&src[pos]));
+			}
 		} else {
-			Deflate_Lit(state, *cur);
-			len--; cur++;
+			result = Deflate_AddSymbol(state, src[cur], 0);
+			cur++;
 		}
-
-		/* leave room for a few bytes and literals at end */
-		if (state->AvailOut >= 20) continue;
-		ReturnCode result = Stream_TryWrite(state->Dest, state->Output, DEFLATE_OUT_SIZE - state->AvailOut);
-		state->NextOut = state->Output;
-		state->AvailOut = DEFLATE_OUT_SIZE;
 		if (result != 0) return result;
 	}
 
-	/* literals for last few bytes */
-	while (len > 0) {
-		Deflate_Lit(state, *cur);
-		len--; cur++;
-	}
-
-	state->InputPosition = 0;
-	ReturnCode resultFinal = Stream_TryWrite(state->Dest, state->Output, DEFLATE_OUT_SIZE - state->AvailOut);
-	state->NextOut = state->Output;
-	state->AvailOut = DEFLATE_OUT_SIZE;
-	return resultFinal;
+	state->NextPosition = cur;
+	if (state->InputPosition == DEFLATE_BUFFER_SIZE) Deflate_SlideWindow(state);
+	return 0;
 }
 
 static ReturnCode Deflate_StreamWrite(Stream* stream, UInt8* data, UInt32 count, UInt32* modified) {
@@ -856,21 +1277,25 @@ static ReturnCode Deflate_StreamWrite(Stream* stream, UInt8* data, UInt32 count,
 		data += toWrite;
 
 		if (state->InputPosition == DEFLATE_BUFFER_SIZE) {
-			ReturnCode result = Deflate_FlushBlock(state, DEFLATE_BUFFER_SIZE);
+			ReturnCode result = Deflate_ProcessInput(state, false);
 			if (result != 0) return result;
 		}
 	}
 	return 0;
 }
 
-static ReturnCode Deflate_StreamClose(Stream* stream) {
-	DeflateState* state = stream->Meta_Inflate;
-	ReturnCode result = Deflate_FlushBlock(state, state->InputPosition);
+static ReturnCode Deflate_Finish(DeflateState* state, bool final) {
+	ReturnCode result = Deflate_ProcessInput(state, true);
 	if (result != 0) return result;
 
-	/* Write huffman encoded "literal 256" to terminate symbols */
-	Deflate_PushBits(state, 512, 7); 
-	Deflate_FlushBits(state);
+	if (state->NumSymbols > state->SegmentStart) {
+		result = Deflate_EndSegment(state);
+		if (result != 0) return result;
+	}
+	result = Deflate_WriteBlock(state, state->NumSymbols, state->BlockLits, state->BlockDists, final);
+	if (result != 0) return result;
+	/* Empty stored block, so that the next segment starts on a byte boundary */
+	if (!final) { Deflate_PushBits(state, 0, 3); Deflate_FlushBits(state); }
 
 	/* In case last byte still has a few extra bits */
 	if (state->NumBits) {
@@ -878,21 +1303,47 @@ static ReturnCode Deflate_StreamClose(Stream* stream) {
 		Deflate_FlushBits(state);
 	}
 
+	if (!final) {
+		*state->NextOut++ = 0x00; *state->NextOut++ = 0x00;
+		*state->NextOut++ = 0xFF; *state->NextOut++ = 0xFF;
+		state->AvailOut -= 4;
+	}
 	return Stream_TryWrite(state->Dest, state->Output, DEFLATE_OUT_SIZE - state->AvailOut);
 }
 
-void Deflate_MakeStream(Stream* stream, DeflateState* state, Stream* underlying) {
+static ReturnCode Deflate_StreamClose(Stream* stream) {
+	return Deflate_Finish(stream->Meta_Inflate, true);
+}
+
+static ReturnCode Deflate_SegmentClose(Stream* stream) {
+	return Deflate_Finish(stream->Meta_Inflate, false);
+}
+
+void Deflate_MakeStream(Stream* stream, DeflateState* state, Stream* underlying, Int32 level) {
 	Stream_SetName(stream, &underlying->Name);
 	stream->Meta_Inflate = state;
+	if (!deflate_tablesInited) Deflate_InitTables();
 
 	state->InputPosition = 0;
+	state->NextPosition  = 0;
 	state->Bits    = 0;
 	state->NumBits = 0;
 
 	state->NextOut  = state->Output;
 	state->AvailOut = DEFLATE_OUT_SIZE;
 	state->Dest     = underlying;
-	state->WroteHeader = false;
+
+	level = max(DEFLATE_LEVEL_FASTEST, min(level, DEFLATE_LEVEL_BEST));
+	state->MaxChain  = deflate_levels[level - 1].MaxChain;
+	state->NiceLen   = deflate_levels[level - 1].NiceLen;
+	state->LazyMatch = deflate_levels[level - 1].LazyMatch;
+
+	state->NumSymbols   = 0;
+	state->SegmentStart = 0;
+	Platform_MemSet(state->BlockLits,    0, sizeof(state->BlockLits));
+	Platform_MemSet(state->BlockDists,   0, sizeof(state->BlockDists));
+	Platform_MemSet(state->SegmentLits,  0, sizeof(state->SegmentLits));
+	Platform_MemSet(state->SegmentDists, 0, sizeof(state->SegmentDists));
 
 	Platform_MemSet(state->Head, 0, sizeof(state->Head));
 	Platform_MemSet(state->Prev, 0, sizeof(state->Prev));
@@ -902,6 +1353,11 @@ void Deflate_MakeStream(Stream* stream, DeflateState* state, Stream* underlying)
 	stream->Close = Deflate_StreamClose;
 }
 
+void Deflate_MakeSegmentStream(Stream* stream, DeflateState* state, Stream* underlying, Int32 level) {
+	Deflate_MakeStream(stream, state, underlying, level);
+	stream->Close = Deflate_SegmentClose;
+}
+
 
 /*########################################################################################################################*
 *-----------------------------------------------------GZip (compress)-----------------------------------------------------*
@@ -920,36 +1376,99 @@ static ReturnCode GZip_StreamClose(Stream* stream) {
 static ReturnCode GZip_StreamWrite(Stream* stream, UInt8* data, UInt32 count, UInt32* modified) {
 	GZipState* state = stream->Meta_Inflate;
 	state->Size += count;
-	UInt32 i, crc32 = state->Crc32;
+	state->Crc32 = Utils_Crc32Update(state->Crc32, data, count);
+	return Deflate_StreamWrite(stream, data, count, modified);
+}
 
-	/* TODO: Optimise this calculation */
-	for (i = 0; i < count; i++) {
-		crc32 = Utils_Crc32Table[(crc32 ^ data[i]) & 0xFF] ^ (crc32 >> 8);
+static ReturnCode GZip_WriteHeader(Stream* stream) {
+	UInt8 gz_header[12] = { 0x1F, 0x8B, 0x08 };
+	GZipState* state = stream->Meta_Inflate;
+	UInt32 headerSize = 10;
+	stream->Write = GZip_StreamWrite;
+
+	if (state->Extra != NULL) {
+		gz_header[3]  = 0x04; /* FEXTRA flag */
+		gz_header[10] = (UInt8)state->ExtraSize; gz_header[11] = (UInt8)(state->ExtraSize >> 8);
+		headerSize = 12;
 	}
 
-	state->Crc32 = crc32;
-	return Deflate_StreamWrite(stream, data, count, modified);
+	ReturnCode result = Stream_TryWrite(state->Base.Dest, gz_header, headerSize);
+	if (result != 0 || state->Extra == NULL) return result;
+	return Stream_TryWrite(state->Base.Dest, state->Extra, state->ExtraSize);
 }
 
 static ReturnCode GZip_StreamWriteFirst(Stream* stream, UInt8* data, UInt32 count, UInt32* modified) {
-	static UInt8 gz_header[10] = { 0x1F, 0x8B, 0x08 };
-	GZipState* state = stream->Meta_Inflate;
-
-	ReturnCode result = Stream_TryWrite(state->Base.Dest, gz_header, sizeof(gz_header));
+	ReturnCode result = GZip_WriteHeader(stream);
 	if (result != 0) return result;
-
-	stream->Write = GZip_StreamWrite;
 	return GZip_StreamWrite(stream, data, count, modified);
 }
 
-void GZip_MakeStream(Stream* stream, GZipState* state, Stream* underlying) {
-	Deflate_MakeStream(stream, &state->Base, underlying);
+void GZip_MakeStream(Stream* stream, GZipState* state, Stream* underlying, Int32 level) {
+	Deflate_MakeStream(stream, &state->Base, underlying, level);
 	state->Crc32 = 0xFFFFFFFFUL;
 	state->Size  = 0;
+	state->Extra = NULL;
+	state->ExtraSize = 0;
 	stream->Write = GZip_StreamWriteFirst;
 	stream->Close = GZip_StreamClose;
 }
 
+void GZip_SetExtra(GZipState* state, UInt8* data, UInt16 size) {
+	state->Extra = data;
+	state->ExtraSize = size;
+}
+
+/* Multiplies vector by 32x32 matrix over GF(2). (Based off crc32_combine from zlib) */
+static UInt32 GZip_Gf2Times(UInt32* mat, UInt32 vec) {
+	UInt32 sum = 0;
+	for (; vec; vec >>= 1, mat++) {
+		if (vec & 1) sum ^= *mat;
+	}
+	return sum;
+}
+
+static void GZip_Gf2Square(UInt32* square, UInt32* mat) {
+	Int32 i;
+	for (i = 0; i < 32; i++) { square[i] = GZip_Gf2Times(mat, mat[i]); }
+}
+
+/* Calculates CRC32 of A followed by B, given the CRC32 of A and B and the length of B. */
+static UInt32 GZip_Crc32Combine(UInt32 crc1, UInt32 crc2, UInt32 len2) {
+	UInt32 even[32], odd[32]; /* Operators for applying 2^n zero bits to a CRC */
+	UInt32 i, row = 1;
+	if (len2 == 0) return crc1;
+
+	odd[0] = 0xEDB88320UL; /* operator for 1 zero bit */
+	for (i = 1; i < 32; i++) { odd[i] = row; row <<= 1; }
+	GZip_Gf2Square(even, odd); /* 2 zero bits */
+	GZip_Gf2Square(odd, even); /* 4 zero bits */
+
+	/* Apply len2 zero bytes to crc1 */
+	do {
+		GZip_Gf2Square(even, odd);
+		if (len2 & 1) crc1 = GZip_Gf2Times(even, crc1);
+		len2 >>= 1;
+		if (len2 == 0) break;
+
+		GZip_Gf2Square(odd, even);
+		if (len2 & 1) crc1 = GZip_Gf2Times(odd, crc1);
+		len2 >>= 1;
+	} while (len2);
+	return crc1 ^ crc2;
+}
+
+ReturnCode GZip_WriteSegment(Stream* stream, UInt8* data, UInt32 count, UInt32 size, UInt32 crc32) {
+	GZipState* state = stream->Meta_Inflate;
+	if (stream->Write == GZip_StreamWriteFirst) {
+		ReturnCode result = GZip_WriteHeader(stream);
+		if (result != 0) return result;
+	}
+
+	state->Crc32 = GZip_Crc32Combine(state->Crc32 ^ 0xFFFFFFFFUL, crc32, size) ^ 0xFFFFFFFFUL;
+	state->Size += size;
+	return Stream_TryWrite(state->Base.Dest, data, count);
+}
+
 
 /*########################################################################################################################*
 *-----------------------------------------------------ZLib (compress)-----------------------------------------------------*
@@ -963,19 +1482,32 @@ static ReturnCode ZLib_StreamClose(Stream* stream) {
 	return 0;
 }
 
-static ReturnCode ZLib_StreamWrite(Stream* stream, UInt8* data, UInt32 count, UInt32* modified) {
-	ZLibState* state = stream->Meta_Inflate;
-	UInt32 i, adler32 = state->Adler32;
+#define ADLER32_BASE 65521
+/* Most bytes that can be summed before s2 could overflow 32 bits, so modulo only needs to be done once per this many */
+#define ADLER32_NMAX 5552
+static UInt32 ZLib_Adler32(UInt32 adler32, UInt8* data, UInt32 count) {
 	UInt32 s1 = adler32 & 0xFFFF, s2 = (adler32 >> 16) & 0xFFFF;
+	while (count > 0) {
+		UInt32 i, len = min(count, ADLER32_NMAX);
+		count -= len;
+
+		for (i = 0; i < (len & ~0x7); i += 8) {
+			s1 += data[i + 0]; s2 += s1; s1 += data[i + 1]; s2 += s1;
+			s1 += data[i + 2]; s2 += s1; s1 += data[i + 3]; s2 += s1;
+			s1 += data[i + 4]; s2 += s1; s1 += data[i + 5]; s2 += s1;
+			s1 += data[i + 6]; s2 += s1; s1 += data[i + 7]; s2 += s1;
+		}
+		for (; i < len; i++) { s1 += data[i]; s2 += s1; }
 
-	/* TODO: Optimise this calculation */
-	for (i = 0; i < count; i++) {
-		#define ADLER32_BASE 65521
-		s1 = (s1 + data[i]) % ADLER32_BASE;
-		s2 = (s2 + s1)      % ADLER32_BASE;
+		data += len;
+		s1 %= ADLER32_BASE; s2 %= ADLER32_BASE;
 	}
+	return (s2 << 16) | s1;
+}
 
-	state->Adler32 = (s2 << 16) | s1;
+static ReturnCode ZLib_StreamWrite(Stream* stream, UInt8* data, UInt32 count, UInt32* modified) {
+	ZLibState* state = stream->Meta_Inflate;
+	state->Adler32 = ZLib_Adler32(state->Adler32, data, count);
 	return Deflate_StreamWrite(stream, data, count, modified);
 }
 
@@ -990,8 +1522,8 @@ static ReturnCode ZLib_StreamWriteFirst(Stream* stream, UInt8* data, UInt32 coun
 	return ZLib_StreamWrite(stream, data, count, modified);
 }
 
-void ZLib_MakeStream(Stream* stream, ZLibState* state, Stream* underlying) {
-	Deflate_MakeStream(stream, &state->Base, underlying);
+void ZLib_MakeStream(Stream* stream, ZLibState* state, Stream* underlying, Int32 level) {
+	Deflate_MakeStream(stream, &state->Base, underlying, level);
 	state->Adler32 = 1;
 	stream->Write = ZLib_StreamWriteFirst;
 	stream->Close = ZLib_StreamClose;
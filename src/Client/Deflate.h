@@ -13,6 +13,9 @@ typedef struct Stream_ Stream;
 
 typedef struct GZipHeader_ {
 	UInt8 State; bool Done; UInt8 PartsRead; Int32 Flags;
+	UInt8* Extra;         /* Buffer that the extra field is read into, NULL to skip the extra field */
+	UInt32 ExtraCapacity; /* Size of Extra buffer, extra field data past this is skipped */
+	UInt32 ExtraSize, ExtraRead;
 } GZipHeader;
 void GZipHeader_Init(GZipHeader* header);
 void GZipHeader_Read(Stream* s, GZipHeader* header);
@@ -30,7 +33,7 @@ void ZLibHeader_Read(Stream* s, ZLibHeader* header);
 #define INFLATE_MAX_DISTS 32
 #define INFLATE_MAX_LITS_DISTS (INFLATE_MAX_LITS + INFLATE_MAX_DISTS)
 #define INFLATE_MAX_BITS 16
-#define INFLATE_FAST_BITS 9
+#define INFLATE_FAST_BITS 10
 #define INFLATE_WINDOW_SIZE 0x8000UL
 #define INFLATE_WINDOW_MASK 0x7FFFUL
 
@@ -45,7 +48,7 @@ typedef struct HuffmanTable_ {
 typedef struct InflateState_ {
 	UInt8 State;
 	bool LastBlock; /* Whether the last DEFLATE block has been encounted in the stream */
-	UInt32 Bits;    /* Holds bits across byte boundaries*/
+	UInt64 Bits;    /* Holds bits across byte boundaries*/
 	UInt32 NumBits; /* Number of bits in Bits buffer*/
 
 	UInt8* NextIn;   /* Pointer within Input buffer to next byte that can be read */
@@ -53,6 +56,7 @@ typedef struct InflateState_ {
 	UInt8* Output;   /* Pointer for output data */
 	UInt32 AvailOut; /* Max number of bytes that can be written to Output buffer */
 	Stream* Source;  /* Source for filling Input buffer */
+	UInt8* FlatStart; /* Start of flat output buffer used as history instead of Window, NULL if none */
 
 	UInt32 Index;                          /* General purpose index / counter */
 	UInt32 WindowIndex;                    /* Current index within window circular buffer */
@@ -70,33 +74,64 @@ typedef struct InflateState_ {
 } InflateState;
 
 void Inflate_Init(InflateState* state, Stream* source);
+/* All further output will be written contiguously into data, which is then used as history instead of the window.
+   Avoids copying output into the window, when decompressing into one large buffer. (e.g. map blocks) */
+void Inflate_SetFlatOutput(InflateState* state, UInt8* data);
 void Inflate_Process(InflateState* state);
 void Inflate_MakeStream(Stream* stream, InflateState* state, Stream* underlying);
 
 
-#define DEFLATE_BUFFER_SIZE 16384
+#define DEFLATE_WINDOW_SIZE 0x8000UL
+#define DEFLATE_WINDOW_MASK 0x7FFFUL
+#define DEFLATE_BUFFER_SIZE (DEFLATE_WINDOW_SIZE * 2)
 #define DEFLATE_OUT_SIZE 8192
-#define DEFLATE_HASH_SIZE 0x1000UL
-#define DEFLATE_HASH_MASK 0x0FFFUL
+#define DEFLATE_HASH_SIZE 0x4000UL
+#define DEFLATE_HASH_MASK 0x3FFFUL
+#define DEFLATE_MAX_SYMBOLS 8192
+#define DEFLATE_NUM_LITS 286
+#define DEFLATE_NUM_DISTS 30
+#define DEFLATE_LEVEL_FASTEST 1
+#define DEFLATE_LEVEL_DEFAULT 6
+#define DEFLATE_LEVEL_BEST 9
 typedef struct DeflateState_ {
 	UInt32 Bits;         /* Holds bits across byte boundaries*/
 	UInt32 NumBits;      /* Number of bits in Bits buffer*/
-	UInt32 InputPosition;
+	UInt32 InputPosition; /* Index in Input that next written data is copied to */
+	UInt32 NextPosition;  /* Index in Input of next byte to compress */
 
 	UInt8* NextOut;  /* Pointer within Output buffer to next byte that can be written */
 	UInt32 AvailOut; /* Max number of bytes that can be written to Output buffer */
 	Stream* Dest;    /* Destination that Output buffer is written to */  
 	
-	UInt8 Input[DEFLATE_BUFFER_SIZE];
+	UInt8 Input[DEFLATE_BUFFER_SIZE]; /* Last DEFLATE_WINDOW_SIZE bytes compressed, then bytes yet to compress */
 	UInt8 Output[DEFLATE_OUT_SIZE];
-	UInt16 Head[DEFLATE_HASH_SIZE];
-	UInt16 Prev[DEFLATE_BUFFER_SIZE];
-	bool WroteHeader;
+	UInt16 Head[DEFLATE_HASH_SIZE];   /* Most recent position in Input of each hash, 0 for none */
+	UInt16 Prev[DEFLATE_WINDOW_SIZE]; /* Previous position with same hash, indexed by position & DEFLATE_WINDOW_MASK */
+
+	UInt16 MaxChain; /* Max number of hash chain entries searched for a match */
+	UInt16 NiceLen;  /* Length of match that is long enough to stop searching */
+	bool LazyMatch;  /* Whether to check if next byte starts a longer match */
+
+	UInt32 NumSymbols;   /* Number of symbols buffered for current block */
+	UInt32 SegmentStart; /* Index of first symbol not yet merged into current block */
+	UInt16 SymLens[DEFLATE_MAX_SYMBOLS];  /* Literal byte, or length of match */
+	UInt16 SymDists[DEFLATE_MAX_SYMBOLS]; /* Distance back of match, 0 for literals */
+	UInt32 BlockLits[DEFLATE_NUM_LITS], BlockDists[DEFLATE_NUM_DISTS];     /* Symbol frequencies of current block */
+	UInt32 SegmentLits[DEFLATE_NUM_LITS], SegmentDists[DEFLATE_NUM_DISTS]; /* Symbol frequencies of last segment */
 } DeflateState;
-void Deflate_MakeStream(Stream* stream, DeflateState* state, Stream* underlying);
+/* Level is between DEFLATE_LEVEL_FASTEST and DEFLATE_LEVEL_BEST, trading speed for smaller output. */
+void Deflate_MakeStream(Stream* stream, DeflateState* state, Stream* underlying, Int32 level);
+/* Compressed data does not end the DEFLATE stream, and is padded to finish on a byte boundary.
+   Independently compressed segments can then be concatenated together. (e.g. when compressing in parallel) */
+void Deflate_MakeSegmentStream(Stream* stream, DeflateState* state, Stream* underlying, Int32 level);
 
-typedef struct GZipState_ { DeflateState Base; UInt32 Crc32, Size; } GZipState;
-void GZip_MakeStream(Stream* stream, GZipState* state, Stream* underlying);
+typedef struct GZipState_ { DeflateState Base; UInt32 Crc32, Size; UInt8* Extra; UInt16 ExtraSize; } GZipState;
+void GZip_MakeStream(Stream* stream, GZipState* state, Stream* underlying, Int32 level);
+/* Sets the data written to the extra field of the gzip header. Must be called before anything is written. */
+void GZip_SetExtra(GZipState* state, UInt8* data, UInt16 size);
+/* Writes a segment compressed by Deflate_MakeSegmentStream, where crc32 is Utils_CRC32 of the uncompressed data.
+   Must be called before any data is written normally. */
+ReturnCode GZip_WriteSegment(Stream* stream, UInt8* data, UInt32 count, UInt32 size, UInt32 crc32);
 typedef struct ZLibState_ { DeflateState Base; UInt32 Adler32; } ZLibState;
-void ZLib_MakeStream(Stream* stream, ZLibState* state, Stream* underlying);
+void ZLib_MakeStream(Stream* stream, ZLibState* state, Stream* underlying, Int32 level);
 #endif
\ No newline at end of file
@@ -6,29 +6,33 @@
    Copyright 2014-2017 ClassicalSharp | Licensed under BSD-3
 */
 
-/* Whether a colour tinting effect should be applied to all faces. */
-bool Drawer_Tinted;
-/* The colour to multiply colour of faces by (tinting effect). */
-PackedCol Drawer_TintColour;
-/* Minimum base block bounding box corner. (For texture UV) */
-Vector3 Drawer_MinBB;
-/* Maximum base block bounding box corner. (For texture UV) */
-Vector3 Drawer_MaxBB;
-/* Coordinate of minimum block bounding box corner in the world. */
-Real32 Drawer_X1, Drawer_Y1, Drawer_Z1;
-/* Coordinate of maximum block bounding box corner in the world. */
-Real32 Drawer_X2, Drawer_Y2, Drawer_Z2;
+/* Describes the cuboid region being drawn, and how its faces are coloured.
+NOTE: Each thread that draws block faces must use its own instance. */
+typedef struct Drawer_ {
+	/* Whether a colour tinting effect should be applied to all faces. */
+	bool Tinted;
+	/* The colour to multiply colour of faces by (tinting effect). */
+	PackedCol TintColour;
+	/* Minimum base block bounding box corner. (For texture UV) */
+	Vector3 MinBB;
+	/* Maximum base block bounding box corner. (For texture UV) */
+	Vector3 MaxBB;
+	/* Coordinate of minimum block bounding box corner in the world. */
+	Real32 X1, Y1, Z1;
+	/* Coordinate of maximum block bounding box corner in the world. */
+	Real32 X2, Y2, Z2;
+} Drawer;
 
 /* Draws the left face of the given cuboid region. */
-void Drawer_XMin(Int32 count, PackedCol col, TextureLoc texLoc, VertexP3fT2fC4b** vertices);
+void Drawer_XMin(Drawer* d, Int32 count, PackedCol col, TextureLoc texLoc, VertexP3fT2fC4b** vertices);
 /* Draws the right face of the given cuboid region. */
-void Drawer_XMax(Int32 count, PackedCol col, TextureLoc texLoc, VertexP3fT2fC4b** vertices);
+void Drawer_XMax(Drawer* d, Int32 count, PackedCol col, TextureLoc texLoc, VertexP3fT2fC4b** vertices);
 /* Draws the front face of the given cuboid region. */
-void Drawer_ZMin(Int32 count, PackedCol col, TextureLoc texLoc, VertexP3fT2fC4b** vertices);
+void Drawer_ZMin(Drawer* d, Int32 count, PackedCol col, TextureLoc texLoc, VertexP3fT2fC4b** vertices);
 /* Draws the back face of the given cuboid region. */
-void Drawer_ZMax(Int32 count, PackedCol col, TextureLoc texLoc, VertexP3fT2fC4b** vertices);
+void Drawer_ZMax(Drawer* d, Int32 count, PackedCol col, TextureLoc texLoc, VertexP3fT2fC4b** vertices);
 /* Draws the bottom face of the given cuboid region. */
-void Drawer_YMin(Int32 count, PackedCol col, TextureLoc texLoc, VertexP3fT2fC4b** vertices);
+void Drawer_YMin(Drawer* d, Int32 count, PackedCol col, TextureLoc texLoc, VertexP3fT2fC4b** vertices);
 /* Draws the top face of the given cuboid region. */
-void Drawer_YMax(Int32 count, PackedCol col, TextureLoc texLoc, VertexP3fT2fC4b** vertices);
+void Drawer_YMax(Drawer* d, Int32 count, PackedCol col, TextureLoc texLoc, VertexP3fT2fC4b** vertices);
 #endif
\ No newline at end of file
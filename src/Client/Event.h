@@ -107,6 +107,7 @@ Event_Void WorldEvents_NewMap;         /* Player begins loading a new world. */
 Event_Real WorldEvents_Loading;   /* Portion of world is decompressed/generated. (Arg is progress from 0-1) */
 Event_Void WorldEvents_MapLoaded;      /* New world has finished loading, player can now interact with it. */
 Event_Int WorldEvents_EnvVarChanged; /* World environment variable changed by player/CPE/WoM config. */
+Event_Real WorldEvents_Saving;    /* Portion of world is compressed and written to disc. (Arg is progress from 0-1) */
 
 Event_Void ChatEvents_FontChanged;     /* User changes whether system chat font used, and when the bitmapped font texture changes. */
 Event_Chat ChatEvents_ChatReceived;    /* Raised when the server or a client-side command sends a message */
@@ -10,6 +10,8 @@
 #include "ServerConnection.h"
 #include "Event.h"
 #include "Funcs.h"
+#include "Utils.h"
+#include "Chat.h"
 
 static void Map_ReadBlocks(Stream* stream) {
 	World_BlocksSize = World_Width * World_Length * World_Height;
@@ -20,6 +22,25 @@ static void Map_ReadBlocks(Stream* stream) {
 	Stream_Read(stream, World_Blocks, World_BlocksSize);
 }
 
+/* NBT before and after the blocks array is written to memory first, as it reads game state. (e.g. block definitions)
+   Then only the blocks array needs to be read when saving on a background thread. */
+#define MAP_HEADER_SIZE 512
+#define MAP_FOOTER_SIZE (128 * 1024)
+UInt8 map_header[MAP_HEADER_SIZE];
+UInt8* map_footer;
+UInt32 map_headerSize, map_footerSize, map_blocksSize;
+/* Whether blocks are read from a world snapshot, because the map is being saved on a background thread. */
+bool map_saveSnapshot;
+void* map_saveMutex;
+Real32 map_saveProgress;
+
+static void Map_SetSaveProgress(Real32 progress) {
+	if (!map_saveSnapshot) return;
+	Platform_MutexLock(map_saveMutex);
+	map_saveProgress = progress;
+	Platform_MutexUnlock(map_saveMutex);
+}
+
 
 /*########################################################################################################################*
 *--------------------------------------------------MCSharp level Format---------------------------------------------------*
@@ -385,6 +406,249 @@ static void Nbt_WriteTag(Stream* stream, UInt8 tagType, const UInt8* tagName) {
 }
 
 
+/*########################################################################################################################*
+*--------------------------------------------------ClassicWorld regions---------------------------------------------------*
+*#########################################################################################################################*/
+/* The NBT data before the blocks, and the blocks array split into regions, are each compressed independently into
+a DEFLATE segment. The segments are then concatenated into one gzip stream, so the file is still an ordinary .cw file.
+A 'CW' subfield in the extra field of the gzip header lists the compressed and uncompressed size of each segment. */
+#define CW_REGION_SIZE (256 * 1024)
+#define CW_MAX_REGIONS 4096
+#define CW_MAX_WORKERS 16
+#define CW_EXTRA_SIZE (4 + 4 + CW_MAX_REGIONS * 8)
+
+typedef struct CwRegion_ {
+	UInt8* Data; UInt32 Size;     /* Uncompressed data, NULL when blocks are read from the world snapshot */
+	UInt32 Offset;                /* Index of first block in region */
+	UInt8* Comp; UInt32 CompSize; /* Compressed DEFLATE segment */
+	UInt32 Crc32;
+} CwRegion;
+typedef void (*CwRegionFunc)(CwRegion* region);
+
+CwRegion* cw_regions;
+Int32 cw_regionsCount, cw_nextRegion, cw_regionsDone;
+CwRegionFunc cw_regionFunc;
+void* cw_regionsMutex;
+UInt8 cw_extra[CW_EXTRA_SIZE];
+
+static void Cw_AllocRegions(Int32 count) {
+	cw_regionsCount = count;
+	cw_regions = Platform_MemAlloc(count, sizeof(CwRegion));
+	if (cw_regions == NULL) ErrorHandler_Fail("Failed to allocate ClassicWorld regions");
+}
+
+static void Cw_RegionsWorkerFunc(void) {
+	for (;;) {
+		Platform_MutexLock(cw_regionsMutex);
+		Int32 i = cw_nextRegion++;
+		Platform_MutexUnlock(cw_regionsMutex);
+
+		if (i >= cw_regionsCount) return;
+		cw_regionFunc(&cw_regions[i]);
+	}
+}
+
+/* Calls func on every region, spread across all cores. */
+static void Cw_ProcessRegions(CwRegionFunc func) {
+	void* workers[CW_MAX_WORKERS];
+	cw_regionFunc   = func;
+	cw_nextRegion   = 0;
+	cw_regionsDone  = 0;
+	if (cw_regionsMutex == NULL) cw_regionsMutex = Platform_MutexCreate();
+
+	/* Main thread processes regions too */
+	Int32 i, workersCount = Platform_ProcessorsCount() - 1;
+	Math_Clamp(workersCount, 0, CW_MAX_WORKERS);
+	workersCount = min(workersCount, cw_regionsCount - 1);
+
+	for (i = 0; i < workersCount; i++) {
+		workers[i] = Platform_ThreadStart(Cw_RegionsWorkerFunc);
+	}
+	Cw_RegionsWorkerFunc();
+
+	for (i = 0; i < workersCount; i++) {
+		Platform_ThreadJoin(workers[i]);
+		Platform_ThreadFreeHandle(workers[i]);
+	}
+}
+
+static void Cw_CompressRegion(CwRegion* region) {
+	UInt8* data = region->Data;
+	if (data == NULL) {
+		data = Platform_MemAlloc(region->Size, sizeof(UInt8));
+		if (data == NULL) ErrorHandler_Fail("Cw_Save - failed to allocate region");
+		World_ReadSnapshot(data, region->Offset, region->Size);
+	}
+
+	String name = String_FromConst("ClassicWorld region");
+	Stream stream; Stream_WriteonlyMemory(&stream, region->Comp, region->CompSize, &name);
+	DeflateState* state = Platform_MemAlloc(1, sizeof(DeflateState));
+	if (state == NULL) ErrorHandler_Fail("Cw_Save - failed to allocate deflate state");
+
+	Stream compStream;
+	Deflate_MakeSegmentStream(&compStream, state, &stream, DEFLATE_LEVEL_DEFAULT);
+	Stream_Write(&compStream, data, region->Size);
+	ReturnCode result = compStream.Close(&compStream);
+	ErrorHandler_CheckOrFail(result, "Cw_Save - compressing region");
+
+	region->CompSize -= stream.Meta_Mem_Left;
+	region->Crc32 = Utils_CRC32(data, region->Size);
+	Platform_MemFree(&state);
+	if (data != region->Data) Platform_MemFree(&data);
+
+	Platform_MutexLock(cw_regionsMutex);
+	Int32 done = ++cw_regionsDone;
+	Platform_MutexUnlock(cw_regionsMutex);
+	Map_SetSaveProgress((Real32)done / cw_regionsCount);
+}
+
+static void Cw_DecompressRegion(CwRegion* region) {
+	String name = String_FromConst("ClassicWorld region");
+	Stream stream; Stream_ReadonlyMemory(&stream, region->Comp, region->CompSize, &name);
+	InflateState* state = Platform_MemAlloc(1, sizeof(InflateState));
+	if (state == NULL) ErrorHandler_Fail("Cw_Load - failed to allocate inflate state");
+
+	Stream compStream;
+	Inflate_MakeStream(&compStream, state, &stream);
+	/* Segments never refer back to data before them */
+	Inflate_SetFlatOutput(state, region->Data);
+	Stream_Read(&compStream, region->Data, region->Size);
+	Platform_MemFree(&state);
+}
+
+/* Compresses the NBT header and the blocks array into segments. Returns buffer holding the compressed segments. */
+static UInt8* Cw_CompressRegions(void) {
+	UInt32 regionSize = max(CW_REGION_SIZE, map_blocksSize / (CW_MAX_REGIONS - 1) + 1);
+	Int32 i, blockRegions = (map_blocksSize + (regionSize - 1)) / regionSize;
+	Cw_AllocRegions(1 + blockRegions);
+
+	cw_regions[0].Data = map_header; cw_regions[0].Size = map_headerSize;
+	for (i = 0; i < blockRegions; i++) {
+		UInt32 offset = i * regionSize;
+		cw_regions[i + 1].Data   = map_saveSnapshot ? NULL : &World_Blocks[offset];
+		cw_regions[i + 1].Size   = min(regionSize, map_blocksSize - offset);
+		cw_regions[i + 1].Offset = offset;
+	}
+
+	/* Enough room for the compressed data, even when it is all literals */
+	UInt32 compSize = 0;
+	for (i = 0; i < cw_regionsCount; i++) {
+		cw_regions[i].CompSize = cw_regions[i].Size + cw_regions[i].Size / 8 + 1024;
+		compSize += cw_regions[i].CompSize;
+	}
+
+	UInt8* comp = Platform_MemAlloc(compSize, sizeof(UInt8));
+	if (comp == NULL) ErrorHandler_Fail("Cw_Save - failed to allocate compression buffer");
+	for (i = 0, compSize = 0; i < cw_regionsCount; i++) {
+		cw_regions[i].Comp = &comp[compSize];
+		compSize += cw_regions[i].CompSize;
+	}
+
+	Cw_ProcessRegions(Cw_CompressRegion);
+	return comp;
+}
+
+/* Reads and decompresses all the segments. Returns buffer holding the decompressed data. */
+static UInt8* Cw_DecompressRegions(Stream* stream, UInt32* size) {
+	UInt32 compSize = 0;
+	Int32 i;
+	*size = 0;
+	for (i = 0; i < cw_regionsCount; i++) {
+		compSize += cw_regions[i].CompSize;
+		*size    += cw_regions[i].Size;
+	}
+
+	/* Decompress straight from the file's data when it is memory mapped */
+	UInt32 left;
+	UInt8* mem  = Stream_UNSAFE_GetMemory(stream, &left);
+	bool mapped = mem != NULL && left >= compSize;
+	UInt8* comp = mapped ? mem : Platform_MemAlloc(compSize, sizeof(UInt8));
+	UInt8* data = Platform_MemAlloc(*size, sizeof(UInt8));
+	if (comp == NULL || data == NULL) ErrorHandler_Fail("Cw_Load - failed to allocate regions");
+
+	if (mapped) {
+		ReturnCode result = Stream_Skip(stream, compSize);
+		ErrorHandler_CheckOrFail(result, "Cw_Load - skipping regions");
+	} else {
+		Stream_Read(stream, comp, compSize);
+	}
+
+	for (i = 0, compSize = 0, *size = 0; i < cw_regionsCount; i++) {
+		cw_regions[i].Comp = &comp[compSize]; compSize += cw_regions[i].CompSize;
+		cw_regions[i].Data = &data[*size];    *size    += cw_regions[i].Size;
+	}
+
+	Cw_ProcessRegions(Cw_DecompressRegion);
+	if (!mapped) Platform_MemFree(&comp);
+	return data;
+}
+
+static UInt16 Cw_WriteRegionIndex(void) {
+	String name = String_FromConst("ClassicWorld regions");
+	Stream stream; Stream_WriteonlyMemory(&stream, cw_extra, sizeof(cw_extra), &name);
+	UInt16 size = 4 + cw_regionsCount * 8;
+	Int32 i;
+
+	Stream_WriteU8(&stream, 'C'); Stream_WriteU8(&stream, 'W');
+	Stream_WriteU16_LE(&stream, size);
+	Stream_WriteU32_LE(&stream, cw_regionsCount);
+	for (i = 0; i < cw_regionsCount; i++) {
+		Stream_WriteU32_LE(&stream, cw_regions[i].CompSize);
+		Stream_WriteU32_LE(&stream, cw_regions[i].Size);
+	}
+	return 4 + size;
+}
+
+/* Checks that the sizes read from the region index are sane, as they come straight from the file. */
+static bool Cw_ValidateRegions(Stream* stream) {
+	UInt64 compSize = 0, size = 0;
+	Int32 i;
+	for (i = 0; i < cw_regionsCount; i++) {
+		compSize += cw_regions[i].CompSize;
+		size     += cw_regions[i].Size;
+	}
+	/* Also ensures that summing the sizes later in UInt32 never overflows */
+	if (compSize > Int32_MaxValue || size > Int32_MaxValue) return false;
+
+	/* Compressed regions must all fit within the rest of the file */
+	UInt32 left, pos, length;
+	if (Stream_UNSAFE_GetMemory(stream, &left) == NULL) {
+		if (stream->Position(stream, &pos) || stream->Length(stream, &length) || pos > length) return false;
+		left = length - pos;
+	}
+	return compSize <= left;
+}
+
+/* Finds the 'CW' subfield in the gzip extra field and reads the list of regions from it.
+Returns false if there is no valid region index, in which case the map must be loaded sequentially. */
+static bool Cw_ReadRegionIndex(GZipHeader* header, Stream* src) {
+	UInt32 i = 0, j, size = min(header->ExtraSize, header->ExtraCapacity);
+	UInt8* extra = header->Extra;
+
+	while (i + 4 <= size) {
+		UInt32 len = extra[i + 2] | (extra[i + 3] << 8);
+		if (i + 4 + len > size) return false;
+		if (extra[i] != 'C' || extra[i + 1] != 'W' || len < 4) { i += 4 + len; continue; }
+
+		String name = String_FromConst("ClassicWorld regions");
+		Stream stream; Stream_ReadonlyMemory(&stream, &extra[i + 4], len, &name);
+		UInt32 count = Stream_ReadU32_LE(&stream);
+		if (count == 0 || count > CW_MAX_REGIONS || len != 4 + count * 8) return false;
+
+		Cw_AllocRegions(count);
+		for (j = 0; j < count; j++) {
+			cw_regions[j].CompSize = Stream_ReadU32_LE(&stream);
+			cw_regions[j].Size     = Stream_ReadU32_LE(&stream);
+		}
+
+		if (Cw_ValidateRegions(src)) return true;
+		Platform_MemFree(&cw_regions);
+		return false;
+	}
+	return false;
+}
+
+
 /*########################################################################################################################*
 *--------------------------------------------------ClassicWorld format----------------------------------------------------*
 *#########################################################################################################################*/
@@ -590,16 +854,34 @@ static bool Cw_Callback(NbtTag* tag) {
 void Cw_Load(Stream* stream) {
 	GZipHeader gzHeader;
 	GZipHeader_Init(&gzHeader);
+	gzHeader.Extra = cw_extra;
+	gzHeader.ExtraCapacity = sizeof(cw_extra);
 	while (!gzHeader.Done) { GZipHeader_Read(stream, &gzHeader); }
 
 	Stream compStream;
 	InflateState state;
 	Inflate_MakeStream(&compStream, &state, stream);
+	Stream bufferedStream;
+	UInt8* regions = NULL;
+
+	if (Cw_ReadRegionIndex(&gzHeader, stream)) {
+		UInt32 size;
+		regions = Cw_DecompressRegions(stream, &size);
+		Platform_MemFree(&cw_regions);
+
+		/* NBT data is read from the decompressed regions first, then from the rest of the gzip stream */
+		Stream_ReadonlyBuffered(&bufferedStream, &compStream, regions, size);
+		bufferedStream.Meta_Mem_Left = size;
+		stream = &bufferedStream;
+	} else {
+		stream = &compStream;
+	}
 
-	if (Stream_ReadU8(&compStream) != NBT_TAG_COMPOUND) {
+	if (Stream_ReadU8(stream) != NBT_TAG_COMPOUND) {
 		ErrorHandler_Fail("NBT file most start with Compound Tag");
 	}
-	Nbt_ReadTag(NBT_TAG_COMPOUND, true, &compStream, NULL, Cw_Callback);
+	Nbt_ReadTag(NBT_TAG_COMPOUND, true, stream, NULL, Cw_Callback);
+	if (regions != NULL) Platform_MemFree(&regions);
 
 	/* Older versions incorrectly multiplied spawn coords by * 32, so we check for that */
 	Vector3* spawn = &LocalPlayer_Instance.Spawn;
@@ -943,12 +1225,7 @@ static void Cw_WriteMetadataCompound(Stream* stream) {
 	Nbt_WriteU8(stream, NBT_TAG_END);
 }
 
-void Cw_Save(Stream* stream) {
-	GZipState state;
-	Stream compStream;
-	GZip_MakeStream(&compStream, &state, stream);
-	stream = &compStream;
-
+static void Cw_WriteHeader(Stream* stream) {
 	Nbt_WriteTag(stream, NBT_TAG_COMPOUND, "ClassicWorld");
 
 	Nbt_WriteTag(stream, NBT_TAG_INT8, "FormatVersion");
@@ -969,23 +1246,62 @@ void Cw_Save(Stream* stream) {
 
 	Nbt_WriteTag(stream, NBT_TAG_INT8_ARRAY, "BlockArray");
 	Nbt_WriteI32(stream, World_BlocksSize);
-	Stream_Write(stream, World_Blocks, World_BlocksSize);
+}
 
-	Cw_WriteMetadataCompound(stream);
+static void Cw_PrepareSave(void) {
+	String name = String_FromConst("ClassicWorld header");
+	Stream stream; Stream_WriteonlyMemory(&stream, map_header, MAP_HEADER_SIZE, &name);
+	Cw_WriteHeader(&stream);
+	map_headerSize = MAP_HEADER_SIZE - stream.Meta_Mem_Left;
+
+	map_footer = Platform_MemAlloc(MAP_FOOTER_SIZE, sizeof(UInt8));
+	if (map_footer == NULL) ErrorHandler_Fail("Cw_Save - failed to allocate metadata");
+	Stream_WriteonlyMemory(&stream, map_footer, MAP_FOOTER_SIZE, &name);
+	Cw_WriteMetadataCompound(&stream);
+	Nbt_WriteU8(&stream, NBT_TAG_END);
+	map_footerSize = MAP_FOOTER_SIZE - stream.Meta_Mem_Left;
+	map_blocksSize = World_BlocksSize;
+}
 
-	Nbt_WriteU8(stream, NBT_TAG_END);
-	stream->Close(stream);
+static void Cw_SaveCore(Stream* stream) {
+	/* Header and blocks are compressed in parallel, then written out in order */
+	UInt8* comp = Cw_CompressRegions();
+	UInt16 extraSize = Cw_WriteRegionIndex();
+
+	GZipState state;
+	Stream compStream;
+	GZip_MakeStream(&compStream, &state, stream, DEFLATE_LEVEL_DEFAULT);
+	GZip_SetExtra(&state, cw_extra, extraSize);
+
+	Int32 i;
+	for (i = 0; i < cw_regionsCount; i++) {
+		CwRegion* region = &cw_regions[i];
+		ReturnCode result = GZip_WriteSegment(&compStream, region->Comp, region->CompSize, region->Size, region->Crc32);
+		ErrorHandler_CheckOrFail(result, "Cw_Save - writing region");
+	}
+	Platform_MemFree(&comp);
+	Platform_MemFree(&cw_regions);
+
+	Stream_Write(&compStream, map_footer, map_footerSize);
+	ReturnCode result = compStream.Close(&compStream);
+	ErrorHandler_CheckOrFail(result, "Cw_Save - closing compressed stream");
+}
+
+void Cw_Save(Stream* stream) {
+	Map_WaitSave();
+	Cw_PrepareSave();
+	Cw_SaveCore(stream);
+	Platform_MemFree(&map_footer);
 }
 
 
 /*########################################################################################################################*
 *---------------------------------------------------Schematic export------------------------------------------------------*
 *#########################################################################################################################*/
-void Schematic_Save(Stream* stream) {
-	GZipState state;
-	Stream compStream;
-	GZip_MakeStream(&compStream, &state, stream);
-	stream = &compStream;
+static void Schematic_PrepareSave(void) {
+	String name = String_FromConst("Schematic header");
+	Stream memStream; Stream_WriteonlyMemory(&memStream, map_header, MAP_HEADER_SIZE, &name);
+	Stream* stream = &memStream;
 
 	Nbt_WriteTag(stream, NBT_TAG_COMPOUND, "Schematic");
 
@@ -1002,14 +1318,40 @@ void Schematic_Save(Stream* stream) {
 
 	Nbt_WriteTag(stream, NBT_TAG_INT8_ARRAY, "Blocks");
 	Nbt_WriteI32(stream, World_BlocksSize);
-	Stream_Write(stream, World_Blocks, World_BlocksSize);
+	map_headerSize = MAP_HEADER_SIZE - memStream.Meta_Mem_Left;
+	map_blocksSize = World_BlocksSize;
+}
+
+static void Schematic_WriteBlocks(Stream* stream) {
+	if (!map_saveSnapshot) {
+		Stream_Write(stream, World_Blocks, map_blocksSize); return;
+	}
+
+	BlockID blocks[8192];
+	UInt32 i;
+	for (i = 0; i < map_blocksSize; i += sizeof(blocks)) {
+		UInt32 count = min(sizeof(blocks), map_blocksSize - i);
+		World_ReadSnapshot(blocks, i, count);
+		Stream_Write(stream, blocks, count);
+		Map_SetSaveProgress((Real32)(i + count) / map_blocksSize);
+	}
+}
+
+static void Schematic_SaveCore(Stream* stream) {
+	GZipState state;
+	Stream compStream;
+	GZip_MakeStream(&compStream, &state, stream, DEFLATE_LEVEL_DEFAULT);
+	stream = &compStream;
+
+	Stream_Write(stream, map_header, map_headerSize);
+	Schematic_WriteBlocks(stream);
 
 	Nbt_WriteTag(stream, NBT_TAG_INT8_ARRAY, "Data");
-	Nbt_WriteI32(stream, World_BlocksSize);
+	Nbt_WriteI32(stream, map_blocksSize);
 	UInt8 chunk[8192] = { 0 };
-	Int32 i;
-	for (i = 0; i < World_BlocksSize; i += sizeof(chunk)) {
-		Int32 count = min(sizeof(chunk), World_BlocksSize - i);
+	UInt32 i;
+	for (i = 0; i < map_blocksSize; i += sizeof(chunk)) {
+		UInt32 count = min(sizeof(chunk), map_blocksSize - i);
 		Stream_Write(stream, chunk, count);
 	}
 
@@ -1019,5 +1361,85 @@ void Schematic_Save(Stream* stream) {
 	Nbt_WriteU8(stream, NBT_TAG_COMPOUND); Nbt_WriteI32(stream, 0);
 
 	Nbt_WriteU8(stream, NBT_TAG_END);
-	stream->Close(stream);
+	ReturnCode result = stream->Close(stream);
+	ErrorHandler_CheckOrFail(result, "Schematic_Save - closing compressed stream");
+}
+
+void Schematic_Save(Stream* stream) {
+	Map_WaitSave();
+	Schematic_PrepareSave();
+	Schematic_SaveCore(stream);
+}
+
+
+/*########################################################################################################################*
+*-------------------------------------------------Background map saving---------------------------------------------------*
+*#########################################################################################################################*/
+void* map_saveThread;
+Stream map_saveStream;
+bool map_saveSchematic, map_saveFinished;
+
+static void Map_SaveFunc(void) {
+	if (map_saveSchematic) {
+		Schematic_SaveCore(&map_saveStream);
+	} else {
+		Cw_SaveCore(&map_saveStream);
+	}
+	ReturnCode result = map_saveStream.Close(&map_saveStream);
+	ErrorHandler_CheckOrFail(result, "Saving map - closing file");
+
+	Platform_MutexLock(map_saveMutex);
+	map_saveFinished = true;
+	Platform_MutexUnlock(map_saveMutex);
+}
+
+void Map_SaveAsync(void* file, STRING_PURE String* path) {
+	Map_WaitSave();
+	Stream_FromFile(&map_saveStream, file, path);
+	String cw = String_FromConst(".cw");
+	map_saveSchematic = !String_CaselessEnds(path, &cw);
+
+	if (map_saveSchematic) {
+		Schematic_PrepareSave();
+	} else {
+		Cw_PrepareSave();
+	}
+
+	World_BeginSnapshot();
+	map_saveSnapshot = true;
+	map_saveFinished = false;
+	map_saveProgress = 0.0f;
+	if (map_saveMutex == NULL) map_saveMutex = Platform_MutexCreate();
+	map_saveThread   = Platform_ThreadStart(Map_SaveFunc);
+}
+
+void Map_WaitSave(void) {
+	if (map_saveThread == NULL) return;
+	Platform_ThreadJoin(map_saveThread);
+	Platform_ThreadFreeHandle(map_saveThread);
+	map_saveThread = NULL;
+
+	World_EndSnapshot();
+	Platform_MemFree(&map_footer);
+	map_saveSnapshot = false;
+	Event_RaiseReal(&WorldEvents_Saving, 1.0f);
+
+	UInt8 msgBuffer[String_BufferSize(STRING_SIZE * 2)];
+	String msg = String_InitAndClearArray(msgBuffer);
+	String_Format1(&msg, "&eSaved map to: %s", &map_saveStream.Name);
+	Chat_Add(&msg);
+}
+
+void Map_SaveTick(ScheduledTask* task) {
+	if (map_saveThread == NULL) return;
+	Platform_MutexLock(map_saveMutex);
+	bool finished = map_saveFinished;
+	Real32 progress = map_saveProgress;
+	Platform_MutexUnlock(map_saveMutex);
+
+	if (finished) {
+		Map_WaitSave();
+	} else {
+		Event_RaiseReal(&WorldEvents_Saving, progress);
+	}
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef CC_MAPFORMATS_H
 #define CC_MAPFORMATS_H
 #include "Stream.h"
+#include "GameStructs.h"
 /* Imports/exports a world and associated metadata from/to a particular map file format.
    Copyright 2017 ClassicalSharp | Licensed under BSD-3
 */
@@ -14,4 +15,12 @@ void Cw_Save(Stream* stream);
 void Cw_Load(Stream* stream);
 void Dat_Load(Stream* stream);
 void Schematic_Save(Stream* stream);
+
+/* Saves the world to the given file on a background thread, as .cw or .schematic depending on the path's extension.
+   Blocks are read from a world snapshot, so the game can keep modifying the world while it is being saved. */
+void Map_SaveAsync(void* file, STRING_PURE String* path);
+/* Waits for the map currently being saved in the background (if any) to finish saving. */
+void Map_WaitSave(void);
+/* Raises WorldEvents_Saving with the progress of the background save, and finishes it once done. */
+void Map_SaveTick(ScheduledTask* task);
 #endif
\ No newline at end of file
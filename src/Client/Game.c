@@ -38,6 +38,8 @@
 #include "GraphicsCommon.h"
 #include "Menus.h"
 #include "Audio.h"
+#include "Formats.h"
+#include "Builder.h"
 
 IGameComponent Game_Components[26];
 Int32 Game_ComponentsCount;
@@ -138,6 +140,7 @@ bool Game_ChangeTerrainAtlas(Bitmap* atlas) {
 	}
 	if (Gfx_LostContext) return false;
 
+	Builder_CancelAll();
 	Atlas1D_Free();
 	Atlas2D_Free();
 	Atlas2D_UpdateState(atlas);
@@ -161,6 +164,42 @@ void Game_SetViewDistance(Int32 distance, bool userDist) {
 	Game_UpdateProjection();
 }
 
+/* Greedy meshing needs one 1D atlas per tile, and the chunk parts buffer has 2 parts per chunk for every atlas.
+On large maps that buffer would be too big, so greedy meshing then falls back to the usual 1D atlases. */
+#define GREEDY_MAX_PARTS_MEMORY (64 * 1024 * 1024)
+static bool Game_GreedyMeshingFits(void) {
+	if (World_Blocks == NULL) return true;
+	UInt64 chunksX = (World_Width + CHUNK_MAX)  >> CHUNK_SHIFT;
+	UInt64 chunksY = (World_Height + CHUNK_MAX) >> CHUNK_SHIFT;
+	UInt64 chunksZ = (World_Length + CHUNK_MAX) >> CHUNK_SHIFT;
+
+	/* Assume every tile is used, as block definitions can change later on */
+	UInt64 partsSize = chunksX * chunksY * chunksZ * ATLAS1D_MAX_ATLASES * 2 * sizeof(ChunkPartInfo);
+	return partsSize <= GREEDY_MAX_PARTS_MEMORY;
+}
+
+static void Game_UpdateGreedyAtlas(void) {
+	bool singleTile = Game_GreedyMeshing && Game_GreedyMeshingFits();
+	if (singleTile == Atlas1D_SingleTile) return;
+	Atlas1D_SingleTile = singleTile;
+
+	/* 1D atlases need to be split up again with the new number of tiles per atlas */
+	if (Atlas2D_Bitmap.Scan0 != NULL && !Gfx_LostContext) {
+		Builder_CancelAll();
+		Atlas1D_Free();
+		Atlas1D_UpdateState();
+		Event_RaiseVoid(&TextureEvents_AtlasChanged);
+	}
+}
+
+void Game_SetGreedyMeshing(bool greedy) {
+	Builder_CancelAll();
+	Game_GreedyMeshing = greedy;
+	Game_UpdateGreedyAtlas();
+	ChunkUpdater_ApplyMeshBuilder();
+	ChunkUpdater_Refresh();
+}
+
 void Game_UpdateProjection(void) {
 	Game_DefaultFov = Options_GetInt(OPT_FIELD_OF_VIEW, 1, 150, 70);
 	Camera_Active->GetProjection(&Gfx_Projection);
@@ -189,6 +228,7 @@ void Game_Disconnect(STRING_PURE String* title, STRING_PURE String* reason) {
 
 void Game_UpdateBlock(Int32 x, Int32 y, Int32 z, BlockID block) {
 	BlockID oldBlock = World_GetBlock(x, y, z);
+	if (World_Snapshotting) World_CopyOnWrite(World_Pack(x, y, z));
 	World_SetBlock(x, y, z, block);
 
 	if (Weather_Heightmap != NULL) {
@@ -301,6 +341,8 @@ static void Game_OnNewMapCore(void* obj) {
 }
 
 static void Game_OnNewMapLoadedCore(void* obj) {
+	/* Must be done before the map renderer allocates the chunk parts buffer */
+	Game_UpdateGreedyAtlas();
 	Int32 i;
 	for (i = 0; i < Game_ComponentsCount; i++) {
 		Game_Components[i].OnNewMapLoaded();
@@ -351,6 +393,8 @@ static void Game_LoadOptions(void) {
 	Game_ViewDistance     = Options_GetInt(OPT_VIEW_DISTANCE, 16, 4096, 512);
 	Game_UserViewDistance = Game_ViewDistance;
 	Game_SmoothLighting   = Options_GetBool(OPT_SMOOTH_LIGHTING, false);
+	Game_GreedyMeshing    = Options_GetBool(OPT_GREEDY_MESHING, false);
+	Atlas1D_SingleTile    = Game_GreedyMeshing;
 
 	Game_DefaultFov = Options_GetInt(OPT_FIELD_OF_VIEW, 1, 150, 70);
 	Game_Fov        = Game_DefaultFov;
@@ -404,6 +448,7 @@ static void Game_InitScheduledTasks(void) {
 
 	ScheduledTask_Add(GAME_DEF_TICKS, Particles_Tick);
 	ScheduledTask_Add(GAME_DEF_TICKS, Animations_Tick);
+	ScheduledTask_Add(GAME_DEF_TICKS, Map_SaveTick);
 }
 
 void Game_Free(void* obj);
@@ -654,12 +699,10 @@ void Game_TakeScreenshot(void) {
 	void* file;
 	ReturnCode result = Platform_FileCreate(&file, &path);
 	ErrorHandler_CheckOrFail(result, "Taking screenshot - opening file");
-	Stream stream; Stream_FromFile(&stream, file, &path);
-	{
-		Gfx_TakeScreenshot(&stream, Game_Width, Game_Height);
-	}
-	result = stream.Close(&stream);
-	ErrorHandler_CheckOrFail(result, "Taking screenshot - closing file");
+
+	/* Encoding is much slower than reading back the pixels, so is done on a background thread to avoid stalling */
+	Bitmap bmp; Gfx_TakeScreenshot(&bmp, Game_Width, Game_Height);
+	Bitmap_EncodePngAsync(&bmp, file, &path);
 
 	Game_ScreenshotRequested = false;
 	String_Clear(&path);
@@ -713,6 +756,8 @@ static void Game_RenderFrame(Real64 delta) {
 }
 
 void Game_Free(void* obj) {
+	Map_WaitSave();
+	Bitmap_WaitEncodePngs();
 	ChunkUpdater_Free();
 	Atlas2D_Free();
 	Atlas1D_Free();
@@ -50,6 +50,11 @@ bool Game_AllowCustomBlocks;
 bool Game_UseCPE;
 bool Game_AllowServerTextures;
 bool Game_SmoothLighting;
+/* Whether chunk faces are merged into rectangles. Requires the 1D atlases to hold a single tile each,
+so chunks have fewer vertices, but are drawn using more parts and texture switches. Best suited to
+small and medium maps on GPUs limited by vertex throughput. Faces are not merged on maps whose chunk
+parts buffer would exceed 64 MB with one atlas per tile (roughly more than 6500 chunks). */
+bool Game_GreedyMeshing;
 bool Game_ChatLogging;
 bool Game_AutoRotate;
 bool Game_SmoothCamera;
@@ -83,6 +88,7 @@ void Game_SetCursorVisible(bool visible);
 
 bool Game_ChangeTerrainAtlas(Bitmap* atlas);
 void Game_SetViewDistance(Int32 distance, bool userDist);
+void Game_SetGreedyMeshing(bool greedy);
 void Game_UpdateProjection(void);
 void Game_Disconnect(STRING_PURE String* title, STRING_PURE String* reason);
 void Game_UpdateBlock(Int32 x, Int32 y, Int32 z, BlockID block);
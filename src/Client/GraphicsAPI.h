@@ -13,6 +13,7 @@ typedef struct Stream_ Stream;
 #define ICOUNT(verticesCount) (((verticesCount) >> 2) * 6)
 #define VERTEX_FORMAT_P3FC4B 0
 #define VERTEX_FORMAT_P3FT2FC4B 1
+#define VERTEX_FORMAT_P3ST2FC4B 2
 
 enum COMPARE_FUNC {
 	COMPARE_FUNC_ALWAYS, COMPARE_FUNC_NOTEQUAL,  COMPARE_FUNC_NEVER,
@@ -39,7 +40,7 @@ Matrix Gfx_View, Gfx_Projection;
 
 #define GFX_MAX_INDICES (65536 / 4 * 6)
 #define GFX_MAX_VERTICES 65536
-#define GFX_STRIDE_SIZES { 16, 24 }
+#define GFX_STRIDE_SIZES { 16, 24, 20 }
 
 /* Callback invoked when the current context is lost, and is repeatedly invoked until the context can be retrieved. */
 ScheduledTaskCallback Gfx_LostContextFunction;
@@ -96,8 +97,8 @@ void Gfx_LoadIdentityMatrix(void);
 void Gfx_CalcOrthoMatrix(Real32 width, Real32 height, Matrix* matrix);
 void Gfx_CalcPerspectiveMatrix(Real32 fov, Real32 aspect, Real32 zNear, Real32 zFar, Matrix* matrix);
 
-/* Outputs a .png screenshot of the backbuffer */
-void Gfx_TakeScreenshot(Stream* output, Int32 width, Int32 height);
+/* Reads the backbuffer into a newly allocated bitmap. You are responsible for freeing its memory! */
+void Gfx_TakeScreenshot(Bitmap* bmp, Int32 width, Int32 height);
 /* Adds a warning to game's chat if this graphics API has problems with the current user's GPU. 
 Returns boolean of whether legacy rendering mode is needed. */
 bool Gfx_WarnIfNecessary(void);
@@ -151,25 +151,26 @@ void IsometricDrawer_DrawBatch(BlockID block, Real32 size, Real32 x, Real32 y) {
 		IsometricDrawer_SpriteZQuad(block, false);
 		IsometricDrawer_SpriteXQuad(block, false);
 	} else {
-		Drawer_MinBB = Block_MinBB[block]; Drawer_MinBB.Y = 1.0f - Drawer_MinBB.Y;
-		Drawer_MaxBB = Block_MaxBB[block]; Drawer_MaxBB.Y = 1.0f - Drawer_MaxBB.Y;
+		Drawer drawer;
+		drawer.MinBB = Block_MinBB[block]; drawer.MinBB.Y = 1.0f - drawer.MinBB.Y;
+		drawer.MaxBB = Block_MaxBB[block]; drawer.MaxBB.Y = 1.0f - drawer.MaxBB.Y;
 		Vector3 min = Block_MinBB[block], max = Block_MaxBB[block];
 
-		Drawer_X1 = iso_scale * (1.0f - min.X * 2.0f) + iso_pos.X; 
-		Drawer_X2 = iso_scale * (1.0f - max.X * 2.0f) + iso_pos.X;
-		Drawer_Y1 = iso_scale * (1.0f - min.Y * 2.0f) + iso_pos.Y; 
-		Drawer_Y2 = iso_scale * (1.0f - max.Y * 2.0f) + iso_pos.Y;
-		Drawer_Z1 = iso_scale * (1.0f - min.Z * 2.0f) + iso_pos.Z; 
-		Drawer_Z2 = iso_scale * (1.0f - max.Z * 2.0f) + iso_pos.Z;
+		drawer.X1 = iso_scale * (1.0f - min.X * 2.0f) + iso_pos.X; 
+		drawer.X2 = iso_scale * (1.0f - max.X * 2.0f) + iso_pos.X;
+		drawer.Y1 = iso_scale * (1.0f - min.Y * 2.0f) + iso_pos.Y; 
+		drawer.Y2 = iso_scale * (1.0f - max.Y * 2.0f) + iso_pos.Y;
+		drawer.Z1 = iso_scale * (1.0f - min.Z * 2.0f) + iso_pos.Z; 
+		drawer.Z2 = iso_scale * (1.0f - max.Z * 2.0f) + iso_pos.Z;
 
-		Drawer_Tinted = Block_Tinted[block];
-		Drawer_TintColour = Block_FogCol[block];
+		drawer.Tinted = Block_Tinted[block];
+		drawer.TintColour = Block_FogCol[block];
 
-		Drawer_XMax(1, bright ? iso_colNormal : iso_colXSide, 
+		Drawer_XMax(&drawer, 1, bright ? iso_colNormal : iso_colXSide, 
 			IsometricDrawer_GetTexLoc(block, FACE_XMAX), &iso_vertices);
-		Drawer_ZMin(1, bright ? iso_colNormal : iso_colZSide, 
+		Drawer_ZMin(&drawer, 1, bright ? iso_colNormal : iso_colZSide, 
 			IsometricDrawer_GetTexLoc(block, FACE_ZMIN), &iso_vertices);
-		Drawer_YMax(1, iso_colNormal, 
+		Drawer_YMax(&drawer, 1, iso_colNormal, 
 			IsometricDrawer_GetTexLoc(block, FACE_YMAX), &iso_vertices);
 	}
 }
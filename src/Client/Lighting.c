@@ -8,9 +8,21 @@
 #include "Event.h"
 
 Int16* Lighting_heightmap;
-PackedCol shadow, shadowZSide, shadowXSide, shadowYBottom;
 #define Lighting_Pack(x, z) ((x) + World_Width * (z))
 
+/* Column which had blocks changed since changes were last flushed. */
+typedef struct LightingColumn_ {
+	Int32 Index;       /* Index of the column in the heightmap */
+	Int16 OldHeight;   /* Light height of the column before any of the changes */
+	UInt16 MinY, MaxY; /* Lowest and highest Y coordinates of changed blocks */
+} LightingColumn;
+
+#define LIGHTING_MAX_COLUMNS 4096
+LightingColumn lighting_columns[LIGHTING_MAX_COLUMNS];
+Int32 lighting_columnsCount;
+/* 1 + index into lighting_columns of each column in the world, or 0 if column has no pending changes. */
+UInt16* lighting_columnSlots;
+
 static void Lighting_SetSun(PackedCol col) {
 	Lighting_Outside = col;
 	PackedCol_GetShaded(col, &Lighting_OutsideXSide,
@@ -18,9 +30,9 @@ static void Lighting_SetSun(PackedCol col) {
 }
 
 static void Lighting_SetShadow(PackedCol col) {
-	shadow = col;
-	PackedCol_GetShaded(col, &shadowXSide,
-		&shadowZSide, &shadowYBottom);
+	Lighting_Shadow = col;
+	PackedCol_GetShaded(col, &Lighting_ShadowXSide,
+		&Lighting_ShadowZSide, &Lighting_ShadowYBottom);
 }
 
 static void Lighting_EnvVariableChanged(void* obj, Int32 envVar) {
@@ -58,73 +70,62 @@ bool Lighting_IsLit(Int32 x, Int32 y, Int32 z) {
 }
 
 PackedCol Lighting_Col(Int32 x, Int32 y, Int32 z) {
-	return y > Lighting_GetLightHeight(x, z) ? Lighting_Outside : shadow;
+	return y > Lighting_GetLightHeight(x, z) ? Lighting_Outside : Lighting_Shadow;
 }
 
 PackedCol Lighting_Col_XSide(Int32 x, Int32 y, Int32 z) {
-	return y > Lighting_GetLightHeight(x, z) ? Lighting_OutsideXSide : shadowXSide;
+	return y > Lighting_GetLightHeight(x, z) ? Lighting_OutsideXSide : Lighting_ShadowXSide;
 }
 
 PackedCol Lighting_Col_Sprite_Fast(Int32 x, Int32 y, Int32 z) {
-	return y > Lighting_heightmap[(z * World_Width) + x] ? Lighting_Outside : shadow;
+	return y > Lighting_heightmap[(z * World_Width) + x] ? Lighting_Outside : Lighting_Shadow;
 }
 
 PackedCol Lighting_Col_YTop_Fast(Int32 x, Int32 y, Int32 z) {
-	return y > Lighting_heightmap[(z * World_Width) + x] ? Lighting_Outside : shadow;
+	return y > Lighting_heightmap[(z * World_Width) + x] ? Lighting_Outside : Lighting_Shadow;
 }
 
 PackedCol Lighting_Col_YBottom_Fast(Int32 x, Int32 y, Int32 z) {
-	return y > Lighting_heightmap[(z * World_Width) + x] ? Lighting_OutsideYBottom : shadowYBottom;
+	return y > Lighting_heightmap[(z * World_Width) + x] ? Lighting_OutsideYBottom : Lighting_ShadowYBottom;
 }
 
 PackedCol Lighting_Col_XSide_Fast(Int32 x, Int32 y, Int32 z) {
-	return y > Lighting_heightmap[(z * World_Width) + x] ? Lighting_OutsideXSide : shadowXSide;
+	return y > Lighting_heightmap[(z * World_Width) + x] ? Lighting_OutsideXSide : Lighting_ShadowXSide;
 }
 
 PackedCol Lighting_Col_ZSide_Fast(Int32 x, Int32 y, Int32 z) {
-	return y > Lighting_heightmap[(z * World_Width) + x] ? Lighting_OutsideZSide : shadowZSide;
+	return y > Lighting_heightmap[(z * World_Width) + x] ? Lighting_OutsideZSide : Lighting_ShadowZSide;
 }
 
-void Lighting_Refresh(void) {
-	Int32 i;
-	for (i = 0; i < World_Width * World_Length; i++) {
-		Lighting_heightmap[i] = Int16_MaxValue;
+void Lighting_CopyHeights(Int32 startX, Int32 startZ, Int16* heights) {
+	Int32 x1 = max(startX, 0), x2 = min(World_Width,  startX + EXTCHUNK_SIZE);
+	Int32 z1 = max(startZ, 0), z2 = min(World_Length, startZ + EXTCHUNK_SIZE);
+	Int32 x, z;
+
+	for (z = z1; z < z2; z++) {
+		Int32 index = (z - startZ) * EXTCHUNK_SIZE + (x1 - startX);
+		Int32 heightmapIndex = Lighting_Pack(x1, z);
+		for (x = x1; x < x2; x++) {
+			heights[index++] = Lighting_heightmap[heightmapIndex++];
+		}
 	}
 }
 
-
-static void Lighting_UpdateLighting(Int32 x, Int32 y, Int32 z, BlockID oldBlock, BlockID newBlock, Int32 index, Int32 lightH) {
-	bool didBlock = Block_BlocksLight[oldBlock];
-	bool nowBlocks = Block_BlocksLight[newBlock];
-	Int32 oldOffset = (Block_LightOffset[oldBlock] >> FACE_YMAX) & 1;
-	Int32 newOffset = (Block_LightOffset[newBlock] >> FACE_YMAX) & 1;
-
-	/* Two cases we need to handle here: */
-	if (didBlock == nowBlocks) {
-		if (!didBlock) return;              /* a) both old and new block do not block light */
-		if (oldOffset == newOffset) return; /* b) both blocks blocked light at the same Y coordinate */
+static void Lighting_ClearChanges(void) {
+	Int32 i;
+	for (i = 0; i < lighting_columnsCount; i++) {
+		lighting_columnSlots[lighting_columns[i].Index] = 0;
 	}
+	lighting_columnsCount = 0;
+}
 
-	if ((y - newOffset) >= lightH) {
-		if (nowBlocks) {
-			Lighting_heightmap[index] = (Int16)(y - newOffset);
-		} else {
-			/* Part of the column is now visible to light, we don't know how exactly how high it should be though. */
-			/* However, we know that if the old block was above or equal to light height, then the new light height must be <= old block.y */
-			Lighting_CalcHeightAt(x, y, z, index);
-		}
-	} else if (y == lightH && oldOffset == 0) {
-		/* For a solid block on top of an upside down slab, they will both have the same light height. */
-		/* So we need to account for this particular case. */
-		BlockID above = y == (World_Height - 1) ? BLOCK_AIR : World_GetBlock(x, y + 1, z);
-		if (Block_BlocksLight[above]) return;
-
-		if (nowBlocks) {
-			Lighting_heightmap[index] = (Int16)(y - newOffset);
-		} else {
-			Lighting_CalcHeightAt(x, y - 1, z, index);
-		}
+void Lighting_Refresh(void) {
+	Int32 i;
+	for (i = 0; i < World_Width * World_Length; i++) {
+		Lighting_heightmap[i] = Int16_MaxValue;
 	}
+	/* Light heights of all columns will be calculated again anyways */
+	Lighting_ClearChanges();
 }
 
 
@@ -172,22 +173,28 @@ static void Lighting_ResetColumn(Int32 cx, Int32 cy, Int32 cz, Int32 minCy, Int3
 	}
 }
 
-static void Lighting_RefreshAffected(Int32 x, Int32 y, Int32 z, BlockID block, Int32 oldHeight, Int32 newHeight) {
+static void Lighting_RefreshAffected(LightingColumn* col, Int32 x, Int32 z, Int32 oldHeight, Int32 newHeight) {
+	Int32 y = col->MaxY;
 	Int32 cx = x >> 4, cy = y >> 4, cz = z >> 4;
+	BlockID block = World_GetBlock(x, y, z);
 
 	/* NOTE: much faster to only update the chunks that are affected by the change in shadows, rather than the entire column. */
 	Int32 newCy = newHeight < 0 ? 0 : newHeight >> 4;
 	Int32 oldCy = oldHeight < 0 ? 0 : oldHeight >> 4;
 	Int32 minCy = min(oldCy, newCy), maxCy = max(oldCy, newCy);
+
+	/* Neighbours of the changed blocks also need to be refreshed, not just chunks whose shadows changed */
+	if (minCy == maxCy) {
+		minCy = col->MinY >> 4; maxCy = cy;
+	} else {
+		minCy = min(minCy, col->MinY >> 4); maxCy = max(maxCy, cy);
+	}
 	Lighting_ResetColumn(cx, cy, cz, minCy, maxCy);
 
-	Int32 bX = x & 0x0F, bY = y & 0x0F, bZ = z & 0x0F;
+	Int32 bX = x & 0x0F, bZ = z & 0x0F;
 	if (bX == 0 && cx > 0) {
 		Lighting_ResetNeighbour(x - 1, y, z, block, cx - 1, cy, cz, minCy, maxCy);
 	}
-	if (bY == 0 && cy > 0 && Lighting_Needs(block, World_GetBlock(x, y - 1, z))) {
-		MapRenderer_RefreshChunk(cx, cy - 1, cz);
-	}
 	if (bZ == 0 && cz > 0) {
 		Lighting_ResetNeighbour(x, y, z - 1, block, cx, cy, cz - 1, minCy, maxCy);
 	}
@@ -195,14 +202,27 @@ static void Lighting_RefreshAffected(Int32 x, Int32 y, Int32 z, BlockID block, I
 	if (bX == 15 && cx < MapRenderer_ChunksX - 1) {
 		Lighting_ResetNeighbour(x + 1, y, z, block, cx + 1, cy, cz, minCy, maxCy);
 	}
-	if (bY == 15 && cy < MapRenderer_ChunksY - 1 && Lighting_Needs(block, World_GetBlock(x, y + 1, z))) {
-		MapRenderer_RefreshChunk(cx, cy + 1, cz);
-	}
 	if (bZ == 15 && cz < MapRenderer_ChunksZ - 1) {
 		Lighting_ResetNeighbour(x, y, z + 1, block, cx, cy, cz + 1, minCy, maxCy);
 	}
 }
 
+void Lighting_FlushChanges(void) {
+	Int32 i;
+	for (i = 0; i < lighting_columnsCount; i++) {
+		LightingColumn* col = &lighting_columns[i];
+		lighting_columnSlots[col->Index] = 0;
+		Int32 x = col->Index % World_Width, z = col->Index / World_Width;
+
+		/* Blocks above both the old light height and the highest changed block still do not block light */
+		Int32 maxY = max(col->MaxY, col->OldHeight + 1);
+		maxY = min(maxY, World_MaxY);
+		Int32 newHeight = Lighting_CalcHeightAt(x, maxY, z, col->Index);
+		Lighting_RefreshAffected(col, x, z, col->OldHeight + 1, newHeight + 1);
+	}
+	lighting_columnsCount = 0;
+}
+
 void Lighting_OnBlockChanged(Int32 x, Int32 y, Int32 z, BlockID oldBlock, BlockID newBlock) {
 	Int32 index = (z * World_Width) + x;
 	Int32 lightH = Lighting_heightmap[index];
@@ -210,9 +230,29 @@ void Lighting_OnBlockChanged(Int32 x, Int32 y, Int32 z, BlockID oldBlock, BlockI
 	/* So we don't need to do anything. */
 	if (lightH == Int16_MaxValue) return;
 
-	Lighting_UpdateLighting(x, y, z, oldBlock, newBlock, index, lightH);
-	Int32 newHeight = Lighting_heightmap[index] + 1;
-	Lighting_RefreshAffected(x, y, z, newBlock, lightH + 1, newHeight);
+	Int32 cx = x >> 4, cy = y >> 4, cz = z >> 4, bY = y & 0x0F;
+	if (bY == 0 && cy > 0 && Lighting_Needs(newBlock, World_GetBlock(x, y - 1, z))) {
+		MapRenderer_RefreshChunk(cx, cy - 1, cz);
+	}
+	if (bY == 15 && cy < MapRenderer_ChunksY - 1 && Lighting_Needs(newBlock, World_GetBlock(x, y + 1, z))) {
+		MapRenderer_RefreshChunk(cx, cy + 1, cz);
+	}
+
+	/* Light height and affected chunks are only calculated once per column, when changes are flushed */
+	LightingColumn* col;
+	Int32 slot = lighting_columnSlots[index];
+	if (slot) {
+		col = &lighting_columns[slot - 1];
+		col->MinY = (UInt16)min(col->MinY, y);
+		col->MaxY = (UInt16)max(col->MaxY, y);
+		return;
+	}
+
+	if (lighting_columnsCount == LIGHTING_MAX_COLUMNS) Lighting_FlushChanges();
+	col = &lighting_columns[lighting_columnsCount++];
+	col->Index = index; col->OldHeight = (Int16)lightH;
+	col->MinY = (UInt16)y; col->MaxY = (UInt16)y;
+	lighting_columnSlots[index] = (UInt16)lighting_columnsCount;
 }
 
 
@@ -322,6 +362,8 @@ static void Lighting_Init(void) {
 
 static void Lighting_Reset(void) {
 	Platform_MemFree(&Lighting_heightmap);
+	Platform_MemFree(&lighting_columnSlots);
+	lighting_columnsCount = 0;
 }
 
 static void Lighting_OnNewMap(void) {
@@ -335,6 +377,12 @@ static void Lighting_OnNewMapLoaded(void) {
 	if (Lighting_heightmap == NULL) {
 		ErrorHandler_Fail("WorldLighting - failed to allocate heightmap");
 	}
+
+	lighting_columnSlots = Platform_MemAlloc(World_Width * World_Length, sizeof(UInt16));
+	if (lighting_columnSlots == NULL) {
+		ErrorHandler_Fail("WorldLighting - failed to allocate changed columns");
+	}
+	Platform_MemSet(lighting_columnSlots, 0, World_Width * World_Length * sizeof(UInt16));
 	Lighting_Refresh();
 }
 
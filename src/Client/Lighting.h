@@ -11,6 +11,10 @@ PackedCol Lighting_Outside;
 PackedCol Lighting_OutsideZSide;
 PackedCol Lighting_OutsideXSide;
 PackedCol Lighting_OutsideYBottom;
+PackedCol Lighting_Shadow;
+PackedCol Lighting_ShadowZSide;
+PackedCol Lighting_ShadowXSide;
+PackedCol Lighting_ShadowYBottom;
 
 IGameComponent Lighting_MakeComponent(void);
 /* Equivalent to (but far more optimised form of)
@@ -18,10 +22,18 @@ IGameComponent Lighting_MakeComponent(void);
 *   for z = startZ; z < startZ + 18; z++
 *      CalcLight(x, maxY, z)                         */
 void Lighting_LightHint(Int32 startX, Int32 startZ);
+/* Copies the light heights of the 18x18 columns starting at the given coordinates into heights.
+Columns outside the map are left untouched. Lighting_LightHint must have been called first.
+NOTE: Used to take a snapshot of lighting that can be safely read on another thread. */
+void Lighting_CopyHeights(Int32 startX, Int32 startZ, Int16* heights);
 
 /* Called when a block is changed, to update the lighting information.
+Changes are accumulated per column, and only applied when Lighting_FlushChanges is called.
 NOTE: Implementations ***MUST*** mark all chunks affected by this lighting changeas needing to be refreshed. */
 void Lighting_OnBlockChanged(Int32 x, Int32 y, Int32 z, BlockID oldBlock, BlockID newBlock);
+/* Calculates new light heights of all columns changed since last call, and marks affected chunks as needing refresh.
+NOTE: Called once per frame before chunks are updated, so many changes to a column only cost one calculation. */
+void Lighting_FlushChanges(void);
 void Lighting_Refresh(void);
 
 /* Returns whether the block at the given coordinates is fully in sunlight.
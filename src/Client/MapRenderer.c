@@ -6,6 +6,8 @@
 #include "World.h"
 #include "Vectors.h"
 #include "ChunkUpdater.h"
+#include "Builder.h"
+#include "VertexStructs.h"
 bool inTranslucent;
 
 ChunkInfo* MapRenderer_GetChunk(Int32 cx, Int32 cy, Int32 cz) {
@@ -16,10 +18,13 @@ void MapRenderer_RefreshChunk(Int32 cx, Int32 cy, Int32 cz) {
 	if (cx < 0 || cy < 0 || cz < 0 || cx >= MapRenderer_ChunksX 
 		|| cy >= MapRenderer_ChunksY || cz >= MapRenderer_ChunksZ) return;
 
-	ChunkInfo* info = &MapRenderer_Chunks[MapRenderer_Pack(cx, cy, cz)];
+	Int32 index = MapRenderer_Pack(cx, cy, cz);
+	ChunkInfo* info = &MapRenderer_Chunks[index];
+	Builder_InvalidateChunk(index);
 	if (info->AllAir) return; /* do not recreate chunks completely air */
 	info->Empty         = false;
 	info->PendingDelete = true;
+	ChunkUpdater_QueueChunk(info);
 }
 
 static void MapRenderer_CheckWeather(Real64 deltaTime) {
@@ -38,6 +43,33 @@ static void MapRenderer_CheckWeather(Real64 deltaTime) {
 	Gfx_SetAlphaBlending(false);
 }
 
+#if CC_BUILD_COMPACTVERTEX
+#define MAPRENDERER_VERTEX_FORMAT VERTEX_FORMAT_P3ST2FC4B
+/* Chunk vertices are scaled integers relative to the chunk's origin, so need to be transformed back */
+static void MapRenderer_LoadChunkMatrix(ChunkInfo* info) {
+	Matrix m = Gfx_View;
+	Real32 x = (Real32)(info->CentreX - 8), y = (Real32)(info->CentreY - 8), z = (Real32)(info->CentreZ - 8);
+	Real32 scale = 1.0f / VERTEXP3ST2FC4B_POS_SCALE;
+
+	/* inlined translation and then scale matrix multiply */
+	m.Row3.X += x * m.Row0.X + y * m.Row1.X + z * m.Row2.X;
+	m.Row3.Y += x * m.Row0.Y + y * m.Row1.Y + z * m.Row2.Y;
+	m.Row3.Z += x * m.Row0.Z + y * m.Row1.Z + z * m.Row2.Z;
+	m.Row3.W += x * m.Row0.W + y * m.Row1.W + z * m.Row2.W;
+	m.Row0.X *= scale; m.Row0.Y *= scale; m.Row0.Z *= scale; m.Row0.W *= scale;
+	m.Row1.X *= scale; m.Row1.Y *= scale; m.Row1.Z *= scale; m.Row1.W *= scale;
+	m.Row2.X *= scale; m.Row2.Y *= scale; m.Row2.Z *= scale; m.Row2.W *= scale;
+	Gfx_LoadMatrix(&m);
+}
+
+/* Restores the view matrix after drawing chunks with their own matrices */
+static void MapRenderer_EndCompact(void) {
+	Gfx_LoadMatrix(&Gfx_View);
+}
+#else
+#define MAPRENDERER_VERTEX_FORMAT VERTEX_FORMAT_P3FT2FC4B
+#endif
+
 static void MapRenderer_RenderNormalBatch(UInt32 batch) {
 	UInt32 i, offset = MapRenderer_ChunksCount * batch;
 	for (i = 0; i < MapRenderer_RenderChunksCount; i++) {
@@ -48,6 +80,9 @@ static void MapRenderer_RenderNormalBatch(UInt32 batch) {
 		if (part.Offset < 0) continue;
 		MapRenderer_HasNormalParts[batch] = true;
 
+#if CC_BUILD_COMPACTVERTEX
+		MapRenderer_LoadChunkMatrix(info);
+#endif
 #if !CC_BUILD_GL11
 		Gfx_BindVb(info->Vb);
 #else
@@ -128,7 +163,7 @@ static void MapRenderer_RenderNormalBatch(UInt32 batch) {
 
 void MapRenderer_RenderNormal(Real64 deltaTime) {
 	if (MapRenderer_Chunks == NULL) return;
-	Gfx_SetBatchFormat(VERTEX_FORMAT_P3FT2FC4B);
+	Gfx_SetBatchFormat(MAPRENDERER_VERTEX_FORMAT);
 	Gfx_SetTexturing(true);
 	Gfx_SetAlphaTest(true);
 
@@ -143,6 +178,9 @@ void MapRenderer_RenderNormal(Real64 deltaTime) {
 		}
 	}
 	Gfx_DisableMipmaps();
+#if CC_BUILD_COMPACTVERTEX
+	MapRenderer_EndCompact();
+#endif
 
 	MapRenderer_CheckWeather(deltaTime);
 	Gfx_SetAlphaTest(false);
@@ -162,6 +200,9 @@ static void MapRenderer_RenderTranslucentBatch(UInt32 batch) {
 		if (part.Offset < 0) continue;
 		MapRenderer_HasTranslucentParts[batch] = true;
 
+#if CC_BUILD_COMPACTVERTEX
+		MapRenderer_LoadChunkMatrix(info);
+#endif
 #if !CC_BUILD_GL11
 		Gfx_BindVb(info->Vb);
 #else
@@ -217,7 +258,7 @@ void MapRenderer_RenderTranslucent(Real64 deltaTime) {
 
 	/* First fill depth buffer */
 	UInt32 vertices = Game_Vertices;
-	Gfx_SetBatchFormat(VERTEX_FORMAT_P3FT2FC4B);
+	Gfx_SetBatchFormat(MAPRENDERER_VERTEX_FORMAT);
 	Gfx_SetTexturing(false);
 	Gfx_SetAlphaBlending(false);
 	Gfx_SetColourWriteMask(false, false, false, false);
@@ -246,6 +287,9 @@ void MapRenderer_RenderTranslucent(Real64 deltaTime) {
 		MapRenderer_RenderTranslucentBatch(batch);
 	}
 	Gfx_DisableMipmaps();
+#if CC_BUILD_COMPACTVERTEX
+	MapRenderer_EndCompact();
+#endif
 
 	Gfx_SetDepthWrite(true);
 	/* If we weren't under water, render weather after to blend properly */
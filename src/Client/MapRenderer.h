@@ -33,9 +33,7 @@ bool MapRenderer_CheckingNormalParts[ATLAS1D_MAX_ATLASES];
 ChunkInfo* MapRenderer_Chunks;
 /* The number of chunks in the world, or ChunksX * ChunksY * ChunksZ */
 Int32 MapRenderer_ChunksCount;
-/* Pointers to render info for all chunks in the world, sorted by distance from the camera. */
-ChunkInfo** MapRenderer_SortedChunks;
-/* Pointers to render info for all chunks in the world, sorted by distance from the camera.
+/* Pointers to render info for chunks near the camera, sorted by distance from the camera.
 Chunks that can be rendered (not empty and are visible) are included in this array. */
 ChunkInfo** MapRenderer_RenderChunks;
 /* The number of actually used pointers in the RenderChunks array.
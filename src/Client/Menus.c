@@ -1369,25 +1369,13 @@ static void SaveLevelScreen_Render(GuiElement* elem, Real64 delta) {
 	if (screen->TextPath.length == 0) return;
 	String path = screen->TextPath;
 
+	/* Previous save might still be writing to this file */
+	Map_WaitSave();
 	void* file;
 	ReturnCode result = Platform_FileCreate(&file, &path);
 	ErrorHandler_CheckOrFail(result, "Saving map - opening file");
-	Stream stream; Stream_FromFile(&stream, file, &path);
-	{
-		String cw = String_FromConst(".cw");
-		if (String_CaselessEnds(&path, &cw)) {
-			Cw_Save(&stream);
-		} else {
-			Schematic_Save(&stream);
-		}
-	}
-	result = stream.Close(&stream);
-	ErrorHandler_CheckOrFail(result, "Saving map - closing file");
-
-	UInt8 msgBuffer[String_BufferSize(STRING_SIZE * 2)];
-	String msg = String_InitAndClearArray(msgBuffer);
-	String_Format1(&msg, "&eSaved map to: %s", &path);
-	Chat_Add(&msg);
+	/* Compressing and writing the map is done in the background, so the game does not freeze */
+	Map_SaveAsync(file, &path);
 
 	Gui_ReplaceActive(PauseScreen_MakeInstance());
 	String_Clear(&path);
@@ -1586,6 +1574,8 @@ static void LoadLevelScreen_SelectEntry(STRING_PURE String* filename, void* obj)
 }
 
 void LoadLevelScreen_LoadMap(STRING_PURE String* path) {
+	/* Map might be the one currently being saved in the background */
+	Map_WaitSave();
 	World_Reset();
 	Event_RaiseVoid(&WorldEvents_NewMap);
 
@@ -1597,10 +1587,15 @@ void LoadLevelScreen_LoadMap(STRING_PURE String* path) {
 	Block_Reset();
 	Inventory_SetDefaultMapping();
 
-	void* file;
-	ReturnCode result = Platform_FileOpen(&file, path);
-	ErrorHandler_CheckOrFail(result, "Loading map - open file");
-	Stream stream; Stream_FromFile(&stream, file, path);
+	/* Memory mapping lets the decompressor read the file's data in place */
+	Stream stream;
+	ReturnCode result = Stream_MapFile(&stream, path);
+	if (result != 0) {
+		void* file;
+		result = Platform_FileOpen(&file, path);
+		ErrorHandler_CheckOrFail(result, "Loading map - open file");
+		Stream_FromFile(&stream, file, path);
+	}
 	{
 		String cw = String_FromConst(".cw");   String lvl = String_FromConst(".lvl");
 		String fcm = String_FromConst(".fcm"); String dat = String_FromConst(".dat");
@@ -2446,6 +2441,11 @@ static void GraphicsOptionsScreen_SetSmooth(STRING_PURE String* v) {
 	ChunkUpdater_Refresh();
 }
 
+static void GraphicsOptionsScreen_GetGreedy(STRING_TRANSIENT String* v) { Menu_GetBool(v, Game_GreedyMeshing); }
+static void GraphicsOptionsScreen_SetGreedy(STRING_PURE String* v) {
+	Game_SetGreedyMeshing(Menu_SetBool(v, OPT_GREEDY_MESHING));
+}
+
 static void GraphicsOptionsScreen_GetNames(STRING_TRANSIENT String* v) { String_AppendConst(v, NameMode_Names[Entities_NameMode]); }
 static void GraphicsOptionsScreen_SetNames(STRING_PURE String* v) {
 	Entities_NameMode = Utils_ParseEnum(v, 0, NameMode_Names, NAME_MODE_COUNT);
@@ -2477,27 +2477,29 @@ static void GraphicsOptionsScreen_ContextRecreated(void* obj) {
 	MenuOptionsScreen* screen = (MenuOptionsScreen*)obj;
 	Widget** widgets = screen->Widgets;
 
-	MenuOptionsScreen_Make(screen, 0, -1, -50, "FPS mode",          MenuOptionsScreen_Enum, 
+	MenuOptionsScreen_Make(screen, 0, -1, -100, "FPS mode",          MenuOptionsScreen_Enum, 
 		MenuOptionsScreen_GetFPS,          MenuOptionsScreen_SetFPS);
-	MenuOptionsScreen_Make(screen, 1, -1,   0, "View distance",     MenuOptionsScreen_Input, 
+	MenuOptionsScreen_Make(screen, 1, -1,  -50, "View distance",     MenuOptionsScreen_Input, 
 		GraphicsOptionsScreen_GetViewDist, GraphicsOptionsScreen_SetViewDist);
-	MenuOptionsScreen_Make(screen, 2, -1,  50, "Advanced lighting", MenuOptionsScreen_Bool,
+	MenuOptionsScreen_Make(screen, 2, -1,    0, "Advanced lighting", MenuOptionsScreen_Bool,
 		GraphicsOptionsScreen_GetSmooth,   GraphicsOptionsScreen_SetSmooth);
+	MenuOptionsScreen_Make(screen, 3, -1,   50, "Greedy meshing",    MenuOptionsScreen_Bool,
+		GraphicsOptionsScreen_GetGreedy,   GraphicsOptionsScreen_SetGreedy);
 
-	MenuOptionsScreen_Make(screen, 3, 1, -50, "Names",   MenuOptionsScreen_Enum, 
+	MenuOptionsScreen_Make(screen, 4, 1, -100, "Names",   MenuOptionsScreen_Enum, 
 		GraphicsOptionsScreen_GetNames,    GraphicsOptionsScreen_SetNames);
-	MenuOptionsScreen_Make(screen, 4, 1,   0, "Shadows", MenuOptionsScreen_Enum, 
+	MenuOptionsScreen_Make(screen, 5, 1,  -50, "Shadows", MenuOptionsScreen_Enum, 
 		GraphicsOptionsScreen_GetShadows, GraphicsOptionsScreen_SetShadows);
-	MenuOptionsScreen_Make(screen, 5, 1,  50, "Mipmaps", MenuOptionsScreen_Bool,
+	MenuOptionsScreen_Make(screen, 6, 1,    0, "Mipmaps", MenuOptionsScreen_Bool,
 		GraphicsOptionsScreen_GetMipmaps, GraphicsOptionsScreen_SetMipmaps);
 
-	Menu_MakeDefaultBack(&screen->Buttons[6], false, &screen->TitleFont, Menu_SwitchOptions);
-	widgets[6] = (Widget*)(&screen->Buttons[6]);
-	widgets[7] = NULL; widgets[8] = NULL; widgets[9] = NULL;
+	Menu_MakeDefaultBack(&screen->Buttons[7], false, &screen->TitleFont, Menu_SwitchOptions);
+	widgets[7] = (Widget*)(&screen->Buttons[7]);
+	widgets[8] = NULL; widgets[9] = NULL; widgets[10] = NULL;
 }
 
 Screen* GraphicsOptionsScreen_MakeInstance(void) {
-	static ButtonWidget buttons[7];
+	static ButtonWidget buttons[8];
 	static MenuInputValidator validators[Array_Elems(buttons)];
 	static const UInt8* defaultValues[Array_Elems(buttons)];
 	static Widget* widgets[Array_Elems(buttons) + 3];
@@ -2505,8 +2507,8 @@ Screen* GraphicsOptionsScreen_MakeInstance(void) {
 	validators[0]    = MenuInputValidator_Enum(FpsLimit_Names, FpsLimit_Count);
 	validators[1]    = MenuInputValidator_Integer(8, 4096);
 	defaultValues[1] = "512";
-	validators[3]    = MenuInputValidator_Enum(NameMode_Names,   NAME_MODE_COUNT);
-	validators[4]    = MenuInputValidator_Enum(ShadowMode_Names, SHADOW_MODE_COUNT);
+	validators[4]    = MenuInputValidator_Enum(NameMode_Names,   NAME_MODE_COUNT);
+	validators[5]    = MenuInputValidator_Enum(ShadowMode_Names, SHADOW_MODE_COUNT);
 	
 	static const UInt8* descs[Array_Elems(buttons)];
 	descs[0] = \
@@ -2516,12 +2518,17 @@ Screen* GraphicsOptionsScreen_MakeInstance(void) {
 		"&cUsing NoLimit mode is discouraged.";
 	descs[2] = "&cNote: &eSmooth lighting is still experimental and can heavily reduce performance.";
 	descs[3] = \
+		"&eMerges faces of chunks into larger rectangles, so chunks have fewer vertices.%" \
+		"&cNote: &eEvery terrain tile then needs its own texture, so chunks are drawn%" \
+		"&ein more parts. This can reduce performance on some GPUs.%" \
+		"&eFaces are not merged on very large maps, as that needs too much memory.";
+	descs[4] = \
 		"&eNone: &fNo names of players are drawn.%" \
 		"&eHovered: &fName of the targeted player is drawn see-through.%" \
 		"&eAll: &fNames of all other players are drawn normally.%" \
 		"&eAllHovered: &fAll names of players are drawn see-through.%" \
 		"&eAllUnscaled: &fAll names of players are drawn see-through without scaling.";
-	descs[4] = \
+	descs[5] = \
 		"&eNone: &fNo entity shadows are drawn.%" \
 		"&eSnapToBlock: &fA square shadow is shown on block you are directly above.%" \
 		"&eCircle: &fA circular shadow is shown across the blocks you are above.%" \
@@ -1233,24 +1233,25 @@ static void BlockModel_DrawParts(bool sprite) {
 		BlockModel_SpriteXQuad(true, false);
 		BlockModel_SpriteXQuad(true, true);
 	} else {
-		Drawer_MinBB = Block_MinBB[BlockModel_block]; Drawer_MinBB.Y = 1.0f - Drawer_MinBB.Y;
-		Drawer_MaxBB = Block_MaxBB[BlockModel_block]; Drawer_MaxBB.Y = 1.0f - Drawer_MaxBB.Y;
+		Drawer drawer;
+		drawer.MinBB = Block_MinBB[BlockModel_block]; drawer.MinBB.Y = 1.0f - drawer.MinBB.Y;
+		drawer.MaxBB = Block_MaxBB[BlockModel_block]; drawer.MaxBB.Y = 1.0f - drawer.MaxBB.Y;
 
 		Vector3 min = Block_RenderMinBB[BlockModel_block];
 		Vector3 max = Block_RenderMaxBB[BlockModel_block];
-		Drawer_X1 = min.X - 0.5f; Drawer_Y1 = min.Y; Drawer_Z1 = min.Z - 0.5f;
-		Drawer_X2 = max.X - 0.5f; Drawer_Y2 = max.Y; Drawer_Z2 = max.Z - 0.5f;
+		drawer.X1 = min.X - 0.5f; drawer.Y1 = min.Y; drawer.Z1 = min.Z - 0.5f;
+		drawer.X2 = max.X - 0.5f; drawer.Y2 = max.Y; drawer.Z2 = max.Z - 0.5f;
 
-		Drawer_Tinted = Block_Tinted[BlockModel_block];
-		Drawer_TintColour = Block_FogCol[BlockModel_block];
+		drawer.Tinted = Block_Tinted[BlockModel_block];
+		drawer.TintColour = Block_FogCol[BlockModel_block];
 
 		VertexP3fT2fC4b* ptr = &ModelCache_Vertices[BlockModel.index];
-		Drawer_YMin(1, IModel_Cols[1], BlockModel_GetTex(FACE_YMIN), &ptr);
-		Drawer_ZMin(1, IModel_Cols[3], BlockModel_GetTex(FACE_ZMIN), &ptr);
-		Drawer_XMax(1, IModel_Cols[5], BlockModel_GetTex(FACE_XMAX), &ptr);
-		Drawer_ZMax(1, IModel_Cols[2], BlockModel_GetTex(FACE_ZMAX), &ptr);
-		Drawer_XMin(1, IModel_Cols[4], BlockModel_GetTex(FACE_XMIN), &ptr);
-		Drawer_YMax(1, IModel_Cols[0], BlockModel_GetTex(FACE_YMAX), &ptr);
+		Drawer_YMin(&drawer, 1, IModel_Cols[1], BlockModel_GetTex(FACE_YMIN), &ptr);
+		Drawer_ZMin(&drawer, 1, IModel_Cols[3], BlockModel_GetTex(FACE_ZMIN), &ptr);
+		Drawer_XMax(&drawer, 1, IModel_Cols[5], BlockModel_GetTex(FACE_XMAX), &ptr);
+		Drawer_ZMax(&drawer, 1, IModel_Cols[2], BlockModel_GetTex(FACE_ZMAX), &ptr);
+		Drawer_XMin(&drawer, 1, IModel_Cols[4], BlockModel_GetTex(FACE_XMIN), &ptr);
+		Drawer_YMax(&drawer, 1, IModel_Cols[0], BlockModel_GetTex(FACE_YMAX), &ptr);
 		BlockModel.index += 4 * FACE_COUNT;
 	}
 }
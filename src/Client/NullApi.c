@@ -0,0 +1,89 @@
+#include "GraphicsAPI.h"
+#include "ErrorHandler.h"
+#include "Platform.h"
+#include "GraphicsCommon.h"
+#include "Funcs.h"
+
+#if CC_BUILD_NULLGFX
+/* Graphics backend that does not render anything, and only hands out resource IDs.
+Used for running the client headless. (e.g. for benchmarking chunk mesh building) */
+Int32 Gfx_strideSizes[3] = GFX_STRIDE_SIZES;
+/* Last resource ID handed out. 0 is never used, as that means 'no resource'. */
+GfxResourceID nullgfx_lastId;
+bool nullgfx_fogEnable;
+
+void Gfx_Init(void) {
+	Gfx_MinZNear = 0.1f;
+	Gfx_MaxTextureDimensions = 4096;
+	Gfx_CustomMipmapsLevels = false;
+	GfxCommon_Init();
+}
+
+void Gfx_Free(void) {
+	GfxCommon_Free();
+}
+
+GfxResourceID Gfx_CreateTexture(Bitmap* bmp, bool managedPool, bool mipmaps) { return ++nullgfx_lastId; }
+void Gfx_UpdateTexturePart(GfxResourceID texId, Int32 x, Int32 y, Bitmap* part, bool mipmaps) { }
+void Gfx_BindTexture(GfxResourceID texId) { }
+void Gfx_DeleteTexture(GfxResourceID* texId) { *texId = 0; }
+void Gfx_SetTexturing(bool enabled) { }
+void Gfx_EnableMipmaps(void) { }
+void Gfx_DisableMipmaps(void) { }
+
+bool Gfx_GetFog(void) { return nullgfx_fogEnable; }
+void Gfx_SetFog(bool enabled) { nullgfx_fogEnable = enabled; }
+void Gfx_SetFogColour(PackedCol col) { }
+void Gfx_SetFogDensity(Real32 value) { }
+void Gfx_SetFogStart(Real32 value) { }
+void Gfx_SetFogEnd(Real32 value) { }
+void Gfx_SetFogMode(Int32 fogMode) { }
+
+void Gfx_SetFaceCulling(bool enabled) { }
+void Gfx_SetAlphaTest(bool enabled) { }
+void Gfx_SetAlphaTestFunc(Int32 compareFunc, Real32 refValue) { }
+void Gfx_SetAlphaBlending(bool enabled) { }
+void Gfx_SetAlphaBlendFunc(Int32 srcBlendFunc, Int32 dstBlendFunc) { }
+void Gfx_SetAlphaArgBlend(bool enabled) { }
+
+void Gfx_Clear(void) { }
+void Gfx_ClearColour(PackedCol col) { }
+void Gfx_SetDepthTest(bool enabled) { }
+void Gfx_SetDepthTestFunc(Int32 compareFunc) { }
+void Gfx_SetColourWriteMask(bool r, bool g, bool b, bool a) { }
+void Gfx_SetDepthWrite(bool enabled) { }
+
+GfxResourceID Gfx_CreateDynamicVb(Int32 vertexFormat, Int32 maxVertices) { return ++nullgfx_lastId; }
+GfxResourceID Gfx_CreateVb(void* vertices, Int32 vertexFormat, Int32 count) { return ++nullgfx_lastId; }
+GfxResourceID Gfx_CreateIb(void* indices, Int32 indicesCount) { return ++nullgfx_lastId; }
+void Gfx_BindVb(GfxResourceID vb) { }
+void Gfx_BindIb(GfxResourceID ib) { }
+void Gfx_DeleteVb(GfxResourceID* vb) { *vb = 0; }
+void Gfx_DeleteIb(GfxResourceID* ib) { *ib = 0; }
+
+void Gfx_SetBatchFormat(Int32 vertexFormat) { }
+void Gfx_SetDynamicVbData(GfxResourceID vb, void* vertices, Int32 vCount) { }
+void Gfx_DrawVb_Lines(Int32 verticesCount) { }
+void Gfx_DrawVb_IndexedTris_Range(Int32 verticesCount, Int32 startVertex) { }
+void Gfx_DrawVb_IndexedTris(Int32 verticesCount) { }
+void Gfx_DrawIndexedVb_TrisT2fC4b(Int32 verticesCount, Int32 startVertex) { }
+
+void Gfx_SetMatrixMode(Int32 matrixType) { }
+void Gfx_LoadMatrix(Matrix* matrix) { }
+void Gfx_LoadIdentityMatrix(void) { }
+void Gfx_CalcOrthoMatrix(Real32 width, Real32 height, Matrix* matrix) {
+	Matrix_OrthographicOffCenter(matrix, 0.0f, width, height, 0.0f, -10000.0f, 10000.0f);
+}
+void Gfx_CalcPerspectiveMatrix(Real32 fov, Real32 aspect, Real32 zNear, Real32 zFar, Matrix* matrix) {
+	Matrix_PerspectiveFieldOfView(matrix, fov, aspect, zNear, zFar);
+}
+
+void Gfx_TakeScreenshot(Bitmap* bmp, Int32 width, Int32 height) {
+	ErrorHandler_Fail("NullGfx - screenshots are not supported");
+}
+bool Gfx_WarnIfNecessary(void) { return false; }
+void Gfx_BeginFrame(void) { }
+void Gfx_EndFrame(void) { }
+void Gfx_SetVSync(bool value) { }
+void Gfx_OnWindowResize(void) { }
+#endif
@@ -13,7 +13,7 @@
 #include <Windows.h>
 #include <GL/gl.h>
 
-#if !CC_BUILD_D3D9
+#if !CC_BUILD_D3D9 && !CC_BUILD_NULLGFX
 /* Extensions from later than OpenGL 1.1 */
 #define GL_TEXTURE_MAX_LEVEL    0x813D
 #define GL_ARRAY_BUFFER         0x8892
@@ -38,7 +38,7 @@ FUNC_GLBUFFERDATA    glBufferData;
 FUNC_GLBUFFERSUBDATA glBufferSubData;
 #endif
 
-Int32 Gfx_strideSizes[2] = GFX_STRIDE_SIZES;
+Int32 Gfx_strideSizes[3] = GFX_STRIDE_SIZES;
 bool gl_vsync;
 
 Int32 gl_blend[6] = { GL_ZERO, GL_ONE, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_DST_ALPHA, GL_ONE_MINUS_DST_ALPHA };
@@ -292,9 +292,15 @@ GfxResourceID Gfx_CreateVb(void* vertices, Int32 vertexFormat, Int32 count) {
 	UInt16 indices[GFX_MAX_INDICES];
 	GfxCommon_MakeIndices(indices, ICOUNT(count));
 
-	Int32 stride = vertexFormat == VERTEX_FORMAT_P3FT2FC4B ? (Int32)sizeof(VertexP3fT2fC4b) : (Int32)sizeof(VertexP3fC4b);
-	glVertexPointer(3, GL_FLOAT, stride, vertices);
-	glColorPointer(4, GL_UNSIGNED_BYTE, stride, (void*)((UInt8*)vertices + 12));
+	Int32 stride = Gfx_strideSizes[vertexFormat];
+	if (vertexFormat == VERTEX_FORMAT_P3ST2FC4B) {
+		glVertexPointer(3, GL_SHORT, stride, vertices);
+		glColorPointer(4, GL_UNSIGNED_BYTE, stride, (void*)((UInt8*)vertices + 8));
+		glTexCoordPointer(2, GL_FLOAT, stride, (void*)((UInt8*)vertices + 12));
+	} else {
+		glVertexPointer(3, GL_FLOAT, stride, vertices);
+		glColorPointer(4, GL_UNSIGNED_BYTE, stride, (void*)((UInt8*)vertices + 12));
+	}
 	if (vertexFormat == VERTEX_FORMAT_P3FT2FC4B) {
 		glTexCoordPointer(2, GL_FLOAT, stride, (void*)((UInt8*)vertices + 16));
 	}
@@ -365,6 +371,12 @@ void GL_SetupVbPos3fTex2fCol4b(void) {
 	glTexCoordPointer(2, GL_FLOAT,      sizeof(VertexP3fT2fC4b), (void*)16);
 }
 
+void GL_SetupVbPos3sTex2fCol4b(void) {
+	glVertexPointer(3, GL_SHORT,        sizeof(VertexP3sT2fC4b), (void*)0);
+	glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(VertexP3sT2fC4b), (void*)8);
+	glTexCoordPointer(2, GL_FLOAT,      sizeof(VertexP3sT2fC4b), (void*)12);
+}
+
 void GL_SetupVbPos3fCol4b_Range(Int32 startVertex) {
 	UInt32 offset = startVertex * (UInt32)sizeof(VertexP3fC4b);
 	glVertexPointer(3, GL_FLOAT,          sizeof(VertexP3fC4b), (void*)(offset));
@@ -378,10 +390,17 @@ void GL_SetupVbPos3fTex2fCol4b_Range(Int32 startVertex) {
 	glTexCoordPointer(2, GL_FLOAT,        sizeof(VertexP3fT2fC4b), (void*)(offset + 16));
 }
 
+void GL_SetupVbPos3sTex2fCol4b_Range(Int32 startVertex) {
+	UInt32 offset = startVertex * (UInt32)sizeof(VertexP3sT2fC4b);
+	glVertexPointer(3, GL_SHORT,          sizeof(VertexP3sT2fC4b), (void*)(offset));
+	glColorPointer(4, GL_UNSIGNED_BYTE,   sizeof(VertexP3sT2fC4b), (void*)(offset + 8));
+	glTexCoordPointer(2, GL_FLOAT,        sizeof(VertexP3sT2fC4b), (void*)(offset + 12));
+}
+
 void Gfx_SetBatchFormat(Int32 vertexFormat) {
 	if (vertexFormat == gl_batchFormat) return;
 
-	if (gl_batchFormat == VERTEX_FORMAT_P3FT2FC4B) {
+	if (gl_batchFormat == VERTEX_FORMAT_P3FT2FC4B || gl_batchFormat == VERTEX_FORMAT_P3ST2FC4B) {
 		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 	}
 	gl_batchFormat = vertexFormat;
@@ -391,6 +410,10 @@ void Gfx_SetBatchFormat(Int32 vertexFormat) {
 		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 		gl_setupVBFunc = GL_SetupVbPos3fTex2fCol4b;
 		gl_setupVBRangeFunc = GL_SetupVbPos3fTex2fCol4b_Range;
+	} else if (vertexFormat == VERTEX_FORMAT_P3ST2FC4B) {
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		gl_setupVBFunc = GL_SetupVbPos3sTex2fCol4b;
+		gl_setupVBRangeFunc = GL_SetupVbPos3sTex2fCol4b_Range;
 	} else {
 		gl_setupVBFunc = GL_SetupVbPos3fCol4b;
 		gl_setupVBRangeFunc = GL_SetupVbPos3fCol4b_Range;
@@ -482,6 +505,12 @@ GfxResourceID gl_lastPartialList;
 void Gfx_DrawIndexedVb_TrisT2fC4b(Int32 verticesCount, Int32 startVertex) {
 	
 #if !CC_BUILD_GL11
+	if (gl_batchFormat == VERTEX_FORMAT_P3ST2FC4B) {
+		GL_SetupVbPos3sTex2fCol4b_Range(startVertex);
+		glDrawElements(GL_TRIANGLES, ICOUNT(verticesCount), GL_UNSIGNED_SHORT, NULL);
+		return;
+	}
+
 	UInt32 offset = startVertex * (UInt32)sizeof(VertexP3fT2fC4b);
 	glVertexPointer(3, GL_FLOAT,          sizeof(VertexP3fT2fC4b), (void*)(offset));
 	glColorPointer(4, GL_UNSIGNED_BYTE,   sizeof(VertexP3fT2fC4b), (void*)(offset + 12));
@@ -515,17 +544,17 @@ void Gfx_CalcPerspectiveMatrix(Real32 fov, Real32 aspect, Real32 zNear, Real32 z
 }
 
 
-void Gfx_TakeScreenshot(Stream* output, Int32 width, Int32 height) {
-	Bitmap bmp; Bitmap_Allocate(&bmp, width, height);
-	glReadPixels(0, 0, width, height, GL_BGRA_EXT, GL_UNSIGNED_BYTE, bmp.Scan0);
+void Gfx_TakeScreenshot(Bitmap* bmp, Int32 width, Int32 height) {
+	Bitmap_Allocate(bmp, width, height);
+	glReadPixels(0, 0, width, height, GL_BGRA_EXT, GL_UNSIGNED_BYTE, bmp->Scan0);
 	UInt8 tmp[PNG_MAX_DIMS * BITMAP_SIZEOF_PIXEL];
 
 	/* flip vertically around y */
 	Int32 x, y;
-	UInt32 stride = (UInt32)(bmp.Width) * BITMAP_SIZEOF_PIXEL;
+	UInt32 stride = (UInt32)(bmp->Width) * BITMAP_SIZEOF_PIXEL;
 	for (y = 0; y < height / 2; y++) {
-		UInt32* src = Bitmap_GetRow(&bmp, y);
-		UInt32* dst = Bitmap_GetRow(&bmp, (height - 1) - y);
+		UInt32* src = Bitmap_GetRow(bmp, y);
+		UInt32* dst = Bitmap_GetRow(bmp, (height - 1) - y);
 
 		Platform_MemCpy(tmp, src, stride);
 		Platform_MemCpy(src, dst, stride);
@@ -534,9 +563,6 @@ void Gfx_TakeScreenshot(Stream* output, Int32 width, Int32 height) {
 			UInt32 temp = dst[x]; dst[x] = src[x]; src[x] = temp;
 		}*/
 	}
-
-	Bitmap_EncodePng(&bmp, output);
-	Platform_MemFree(&bmp.Scan0);
 }
 
 bool Gfx_WarnIfNecessary(void) {
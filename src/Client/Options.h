@@ -29,6 +29,7 @@ extern const UInt8* FpsLimit_Names[FpsLimit_Count];
 #define OPT_ENTITY_SHADOW "entityshadow"
 #define OPT_RENDER_TYPE "normal"
 #define OPT_SMOOTH_LIGHTING "gfx-smoothlighting"
+#define OPT_GREEDY_MESHING "gfx-greedymeshing"
 #define OPT_MIPMAPS "gfx-mipmaps"
 #define OPT_SURVIVAL_MODE "game-survival"
 #define OPT_CHAT_LOGGING "chat-logging"
@@ -68,6 +69,8 @@ extern const UInt8* FpsLimit_Names[FpsLimit_Count];
 #define OPT_ALLOW_CLASSIC_HACKS "nostalgia-hacks"
 #define OPT_CLASSIC_ARM_MODEL "nostalgia-classicarm"
 #define OPT_MAX_CHUNK_UPDATES "gfx-maxchunkupdates"
+/* Path of file all data received from a multiplayer server is written to, for replaying later. Empty to disable. */
+#define OPT_NET_CAPTURE_FILE "net-capturefile"
 
 StringsBuffer Options_Keys;
 StringsBuffer Options_Values;
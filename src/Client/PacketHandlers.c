@@ -21,6 +21,7 @@
 #include "Drawer2D.h"
 #include "ErrorHandler.h"
 #include "TexturePack.h"
+#include "Builder.h"
 
 /*########################################################################################################################*
 *-----------------------------------------------------Common handlers-----------------------------------------------------*
@@ -303,10 +304,10 @@ InflateState mapInflateState;
 Stream mapInflateStream;
 bool mapInflateInited;
 GZipHeader gzHeader;
-Int32 mapSizeIndex, mapIndex, mapVolume;
+Int32 mapSizeIndex;
+volatile Int32 mapIndex, mapVolume;
 UInt8 mapSize[4];
 UInt8* map;
-Stream mapPartStream;
 Screen* prevScreen;
 bool prevCursorVisible, receivedFirstPosition;
 
@@ -370,10 +371,144 @@ static void Classic_Handshake(Stream* stream) {
 
 static void Classic_Ping(Stream* stream) { }
 
+/* Map data is decompressed on a background thread, which LevelDataChunk hands compressed data to through a ring buffer. */
+/* The game thread only writes to mapRingHead, and the decoder thread only to mapRingTail. */
+#define MAP_RING_SIZE (512 * 1024)
+UInt8* mapRing;
+UInt32 mapRingHead, mapRingTail; /* Total number of bytes written to/read from the ring */
+volatile bool mapRingEnded, mapDecodeCancel, mapDecodeDone;
+void* mapRingMutex;
+void* mapDataEvent;  /* Set when data is added to the ring, or decoding should stop */
+void* mapSpaceEvent; /* Set when data is removed from the ring, or decoder finishes */
+void* mapDecodeThread;
+Stream mapRingStream;
+
+static UInt32 Classic_RingUsed(void) {
+	Platform_MutexLock(mapRingMutex);
+	UInt32 used = mapRingHead - mapRingTail;
+	Platform_MutexUnlock(mapRingMutex);
+	return used;
+}
+
+static void Classic_RingWrite(UInt8* data, UInt32 count) {
+	while (count > 0 && !mapDecodeDone) {
+		UInt32 space = MAP_RING_SIZE - Classic_RingUsed();
+		/* Decoder thread has fallen far behind, so have to wait for it */
+		if (space == 0) { Platform_EventWait(mapSpaceEvent); continue; }
+
+		UInt32 index = mapRingHead % MAP_RING_SIZE;
+		UInt32 len = min(count, space);
+		len = min(len, MAP_RING_SIZE - index);
+		Platform_MemCpy(&mapRing[index], data, len);
+
+		Platform_MutexLock(mapRingMutex);
+		mapRingHead += len;
+		Platform_MutexUnlock(mapRingMutex);
+		Platform_EventSet(mapDataEvent);
+		data += len; count -= len;
+	}
+}
+
+/* Waits until there is data in the ring, then reads as much of it as possible */
+static ReturnCode Classic_RingRead(Stream* stream, UInt8* data, UInt32 count, UInt32* modified) {
+	UInt32 used;
+	*modified = 0;
+	for (;;) {
+		if (mapDecodeCancel) return 0;
+		bool ended = mapRingEnded;
+		used = Classic_RingUsed();
+
+		if (used > 0) break;
+		if (ended) return 0;
+		Platform_EventWait(mapDataEvent);
+	}
+
+	UInt32 index = mapRingTail % MAP_RING_SIZE;
+	UInt32 len = min(count, used);
+	len = min(len, MAP_RING_SIZE - index);
+	Platform_MemCpy(data, &mapRing[index], len);
+
+	Platform_MutexLock(mapRingMutex);
+	mapRingTail += len;
+	Platform_MutexUnlock(mapRingMutex);
+	Platform_EventSet(mapSpaceEvent);
+	*modified = len;
+	return 0;
+}
+
+static void Classic_DecodeMapBlocks(void) {
+	UInt32 modified;
+	if (!gzHeader.Done) { GZipHeader_Read(&mapRingStream, &gzHeader); }
+	if (!gzHeader.Done) return;
+
+	while (mapSizeIndex < sizeof(UInt32)) {
+		UInt8* src = mapSize + mapSizeIndex;
+		mapInflateStream.Read(&mapInflateStream, src, sizeof(UInt32) - mapSizeIndex, &modified);
+		if (modified == 0) return;
+		mapSizeIndex += modified;
+	}
+
+	if (map == NULL) {
+		mapVolume = (mapSize[0] << 24) | (mapSize[1] << 16) | (mapSize[2] << 8) | mapSize[3];
+		map = Platform_MemAlloc(mapVolume, sizeof(BlockID));
+		if (map == NULL) ErrorHandler_Fail("Failed to allocate memory for map");
+	}
+	/* Decompress straight into map, which is then used as history instead of the window */
+	Inflate_SetFlatOutput(&mapInflateState, map);
+
+	while (mapIndex < mapVolume) {
+		mapInflateStream.Read(&mapInflateStream, map + mapIndex, mapVolume - mapIndex, &modified);
+		if (modified == 0) return;
+		mapIndex += modified;
+	}
+}
+
+static void Classic_DecodeMapFunc(void) {
+	Classic_DecodeMapBlocks();
+	mapDecodeDone = true;
+	Platform_EventSet(mapSpaceEvent);
+}
+
+static void Classic_StartDecode(void) {
+	if (mapRing == NULL) {
+		mapRing = Platform_MemAlloc(MAP_RING_SIZE, sizeof(UInt8));
+		if (mapRing == NULL) ErrorHandler_Fail("Failed to allocate map data ring buffer");
+	}
+
+	mapRingHead = 0; mapRingTail = 0;
+	mapRingEnded = false; mapDecodeCancel = false; mapDecodeDone = false;
+	if (mapRingMutex == NULL) mapRingMutex = Platform_MutexCreate();
+	mapDataEvent  = Platform_EventCreate();
+	mapSpaceEvent = Platform_EventCreate();
+	mapDecodeThread = Platform_ThreadStart(Classic_DecodeMapFunc);
+}
+
+/* Waits for the decoder thread to decompress the remaining data in the ring, or to stop early if cancel is true. */
+static void Classic_StopDecode(bool cancel) {
+	if (mapDecodeThread == NULL) return;
+	mapRingEnded = true;
+	mapDecodeCancel = cancel;
+	Platform_EventSet(mapDataEvent);
+
+	Platform_ThreadJoin(mapDecodeThread);
+	Platform_ThreadFreeHandle(mapDecodeThread);
+	mapDecodeThread = NULL;
+
+	Platform_EventFree(mapDataEvent);
+	Platform_EventFree(mapSpaceEvent);
+}
+
 static void Classic_StartLoading(Stream* stream) {
 	World_Reset();
 	Event_RaiseVoid(&WorldEvents_NewMap);
-	mapPartStream = *stream;
+	/* Discard partially downloaded previous map */
+	Classic_StopDecode(true);
+	if (map != NULL) Platform_MemFree(&map);
+
+	String name = String_FromConst("map data");
+	Stream_SetName(&mapRingStream, &name);
+	Stream_SetDefaultOps(&mapRingStream);
+	mapRingStream.Read = Classic_RingRead;
 
 	prevScreen = Gui_Active;
 	if (prevScreen == LoadingScreen_UNSAFE_RawPointer) {
@@ -388,11 +523,12 @@ static void Classic_StartLoading(Stream* stream) {
 	receivedFirstPosition = false;
 	GZipHeader_Init(&gzHeader);
 
-	Inflate_MakeStream(&mapInflateStream, &mapInflateState, &mapPartStream);
+	Inflate_MakeStream(&mapInflateStream, &mapInflateState, &mapRingStream);
 	mapInflateInited = true;
 
 	mapSizeIndex = 0;
 	mapIndex = 0;
+	mapVolume = 0;
 	Platform_CurrentUTCTime(&mapReceiveStart);
 }
 
@@ -414,42 +550,21 @@ static void Classic_LevelDataChunk(Stream* stream) {
 	if (!mapInflateInited) Classic_StartLoading(stream);
 
 	Int32 usedLength = Stream_ReadU16_BE(stream);
-	mapPartStream.Meta_Mem_Cur    = stream->Meta_Mem_Cur;
-	mapPartStream.Meta_Mem_Base   = stream->Meta_Mem_Cur;
-	mapPartStream.Meta_Mem_Left   = usedLength;
-	mapPartStream.Meta_Mem_Length = usedLength;
+	if (mapDecodeThread == NULL) Classic_StartDecode();
+	Classic_RingWrite(stream->Meta_Mem_Cur, min(usedLength, 1024));
 
 	Stream_Skip(stream, 1024);
 	UInt8 value = Stream_ReadU8(stream); /* progress in original classic, but we ignore it */
 
-	if (!gzHeader.Done) { GZipHeader_Read(&mapPartStream, &gzHeader); }
-	if (gzHeader.Done) {
-		if (mapSizeIndex < sizeof(UInt32)) {
-			UInt8* src = mapSize + mapSizeIndex;
-			UInt32 count = sizeof(UInt32) - mapSizeIndex, modified = 0;
-			mapInflateStream.Read(&mapInflateStream, src, count, &modified);
-			mapSizeIndex += modified;
-		}
-
-		if (mapSizeIndex == sizeof(UInt32)) {
-			if (map == NULL) {
-				mapVolume = (mapSize[0] << 24) | (mapSize[1] << 16) | (mapSize[2] << 8) | mapSize[3];
-				map = Platform_MemAlloc(mapVolume, sizeof(BlockID));
-				if (map == NULL) ErrorHandler_Fail("Failed to allocate memory for map");
-			}
-
-			UInt8* src = map + mapIndex;
-			UInt32 count = mapVolume - mapIndex, modified = 0;
-			mapInflateStream.Read(&mapInflateStream, src, count, &modified);
-			mapIndex += modified;
-		}
-	}
-
-	Real32 progress = map == NULL ? 0.0f : (Real32)mapIndex / mapVolume;
+	/* Decoder thread may be partway through allocating the map */
+	Int32 volume = mapVolume;
+	Real32 progress = volume == 0 ? 0.0f : (Real32)mapIndex / volume;
 	Event_RaiseReal(&WorldEvents_Loading, progress);
 }
 
 static void Classic_LevelFinalise(Stream* stream) {
+	/* Decoder thread has usually kept up with the download, so only the last few chunks are left */
+	Classic_StopDecode(false);
 	Gui_ReplaceActive(NULL);
 	Gui_Active = prevScreen;
 	if (prevScreen != NULL && prevCursorVisible != Game_GetCursorVisible()) {
@@ -474,11 +589,12 @@ static void Classic_LevelFinalise(Stream* stream) {
 }
 
 static void Classic_SetBlock(Stream* stream) {
-	Int32 x = Stream_ReadU16_BE(stream);
-	Int32 y = Stream_ReadU16_BE(stream);
-	Int32 z = Stream_ReadU16_BE(stream);
+	UInt8* data = Stream_UNSAFE_ReadMemory(stream, 7);
+	Int32 x = Stream_GetU16_BE(&data[0]);
+	Int32 y = Stream_GetU16_BE(&data[2]);
+	Int32 z = Stream_GetU16_BE(&data[4]);
 
-	BlockID block = Handlers_ReadBlock(stream);
+	BlockID block = data[6];
 	if (World_IsValidPos(x, y, z)) {
 		Game_UpdateBlock(x, y, z, block);
 	}
@@ -507,33 +623,36 @@ static void Classic_EntityTeleport(Stream* stream) {
 }
 
 static void Classic_RelPosAndOrientationUpdate(Stream* stream) {
-	EntityID id = Stream_ReadU8(stream);
+	UInt8* data = Stream_UNSAFE_ReadMemory(stream, 6);
+	EntityID id = data[0];
 	Vector3 pos;
-	pos.X = Stream_ReadI8(stream) / 32.0f;
-	pos.Y = Stream_ReadI8(stream) / 32.0f;
-	pos.Z = Stream_ReadI8(stream) / 32.0f;
+	pos.X = (Int8)data[1] / 32.0f;
+	pos.Y = (Int8)data[2] / 32.0f;
+	pos.Z = (Int8)data[3] / 32.0f;
 
-	Real32 rotY  = Math_Packed2Deg(Stream_ReadU8(stream));
-	Real32 headX = Math_Packed2Deg(Stream_ReadU8(stream));
+	Real32 rotY  = Math_Packed2Deg(data[4]);
+	Real32 headX = Math_Packed2Deg(data[5]);
 	LocationUpdate update; LocationUpdate_MakePosAndOri(&update, pos, rotY, headX, true);
 	Handlers_UpdateLocation(id, &update, true);
 }
 
 static void Classic_RelPositionUpdate(Stream* stream) {
-	EntityID id = Stream_ReadU8(stream);
+	UInt8* data = Stream_UNSAFE_ReadMemory(stream, 4);
+	EntityID id = data[0];
 	Vector3 pos;
-	pos.X = Stream_ReadI8(stream) / 32.0f;
-	pos.Y = Stream_ReadI8(stream) / 32.0f;
-	pos.Z = Stream_ReadI8(stream) / 32.0f;
+	pos.X = (Int8)data[1] / 32.0f;
+	pos.Y = (Int8)data[2] / 32.0f;
+	pos.Z = (Int8)data[3] / 32.0f;
 
 	LocationUpdate update; LocationUpdate_MakePos(&update, pos, true);
 	Handlers_UpdateLocation(id, &update, true);
 }
 
 static void Classic_OrientationUpdate(Stream* stream) {
-	EntityID id = Stream_ReadU8(stream);
-	Real32 rotY  = Math_Packed2Deg(Stream_ReadU8(stream));
-	Real32 headX = Math_Packed2Deg(Stream_ReadU8(stream));
+	UInt8* data = Stream_UNSAFE_ReadMemory(stream, 3);
+	EntityID id = data[0];
+	Real32 rotY  = Math_Packed2Deg(data[1]);
+	Real32 headX = Math_Packed2Deg(data[2]);
 
 	LocationUpdate update; LocationUpdate_MakeOri(&update, rotY, headX);
 	Handlers_UpdateLocation(id, &update, true);
@@ -587,18 +706,23 @@ static void Classic_SetPermission(Stream* stream) {
 
 static void Classic_ReadAbsoluteLocation(Stream* stream, EntityID id, bool interpolate) {
 	Int32 x, y, z;
+	UInt8* data;
 	if (cpe_extEntityPos) {
-		x = Stream_ReadI32_BE(stream); y = Stream_ReadI32_BE(stream); z = Stream_ReadI32_BE(stream);
+		data = Stream_UNSAFE_ReadMemory(stream, 14);
+		x = Stream_GetI32_BE(&data[0]); y = Stream_GetI32_BE(&data[4]); z = Stream_GetI32_BE(&data[8]);
+		data += 12;
 	} else {
-		x = Stream_ReadI16_BE(stream); y = Stream_ReadI16_BE(stream); z = Stream_ReadI16_BE(stream);
+		data = Stream_UNSAFE_ReadMemory(stream, 8);
+		x = Stream_GetI16_BE(&data[0]); y = Stream_GetI16_BE(&data[2]); z = Stream_GetI16_BE(&data[4]);
+		data += 6;
 	}
 
 	y -= 51; /* Convert to feet position */
 	if (id == ENTITIES_SELF_ID) y += 22;
 
 	Vector3 pos  = VECTOR3_CONST(x / 32.0f, y / 32.0f, z / 32.0f);
-	Real32 rotY  = Math_Packed2Deg(Stream_ReadU8(stream));
-	Real32 headX = Math_Packed2Deg(Stream_ReadU8(stream));
+	Real32 rotY  = Math_Packed2Deg(data[0]);
+	Real32 headX = Math_Packed2Deg(data[1]);
 
 	if (id == ENTITIES_SELF_ID) receivedFirstPosition = true;
 	LocationUpdate update; LocationUpdate_MakePosAndOri(&update, pos, rotY, headX, false);
@@ -606,6 +730,8 @@ static void Classic_ReadAbsoluteLocation(Stream* stream, EntityID id, bool inter
 }
 
 static void Classic_Reset(void) {
+	Classic_StopDecode(true);
+	if (map != NULL) Platform_MemFree(&map);
 	mapInflateInited = false;
 	receivedFirstPosition = false;
 
@@ -644,14 +770,19 @@ Int32 cpe_serverExtensionsCount, cpe_pingTicks;
 Int32 cpe_envMapVer = 2, cpe_blockDefsExtVer = 2;
 bool cpe_twoWayPing;
 
-const UInt8* cpe_clientExtensions[28] = {
+const UInt8* cpe_clientExtensions[29] = {
 	"ClickDistance", "CustomBlocks", "HeldBlock", "EmoteFix", "TextHotKey", "ExtPlayerList",
 	"EnvColors", "SelectionCuboid", "BlockPermissions", "ChangeModel", "EnvMapAppearance",
 	"EnvWeatherType", "MessageTypes", "HackControl", "PlayerClick", "FullCP437", "LongerMessages",
 	"BlockDefinitions", "BlockDefinitionsExt", "BulkBlockUpdate", "TextColors", "EnvMapAspect",
 	"EntityProperty", "ExtEntityPositions", "TwoWayPing", "InventoryOrder", "InstantMOTD", "FastMap",
+	"BulkEntityUpdate",
 };
 static void CPE_SetMapEnvUrl(Stream* stream);
+static void CPE_BulkEntityUpdate(Stream* stream);
+#define BULK_MAX_ENTITIES 64
+#define BULK_ENTITY_SIZE 5
+#define BULK_ENTITY_PACKET_SIZE (2 + BULK_MAX_ENTITIES * BULK_ENTITY_SIZE)
 
 #define Ext_Deg2Packed(x) ((Int16)((x) * 65536.0f / 360.0f))
 void CPE_WritePlayerClick(Stream* stream, MouseButton button, bool buttonDown, UInt8 targetId, PickedPos* pos) {
@@ -792,6 +923,9 @@ static void CPE_ExtEntry(Stream* stream) {
 	} else if (String_CaselessEqualsConst(&ext, "FastMap")) {
 		Net_PacketSizes[OPCODE_LEVEL_INIT] += 4;
 		cpe_fastMap = true;
+	} else if (String_CaselessEqualsConst(&ext, "BulkEntityUpdate")) {
+		/* Not part of standard CPE, so only accept the packet from servers that declare support for it */
+		Net_Set(OPCODE_CPE_BULK_ENTITY_UPDATE, CPE_BulkEntityUpdate, BULK_ENTITY_PACKET_SIZE);
 	}
 }
 
@@ -999,22 +1133,14 @@ static void CPE_ExtAddEntity2(Stream* stream) {
 
 #define BULK_MAX_BLOCKS 256
 static void CPE_BulkBlockUpdate(Stream* stream) {
-	Int32 i, count = Stream_ReadU8(stream) + 1;
-
-	Int32 indices[BULK_MAX_BLOCKS];
-	for (i = 0; i < count; i++) {
-		indices[i] = Stream_ReadI32_BE(stream);
-	}
-	Stream_Skip(stream, (BULK_MAX_BLOCKS - count) * (UInt32)sizeof(Int32));
-
-	BlockID blocks[BULK_MAX_BLOCKS];
-	UInt8* recvBuffer = stream->Meta_Mem_Cur;
-	for (i = 0; i < count; i++) { blocks[i] = recvBuffer[i]; }
-	Stream_Skip(stream, BULK_MAX_BLOCKS);
+	UInt8* data    = Stream_UNSAFE_ReadMemory(stream, 1 + BULK_MAX_BLOCKS * sizeof(Int32) + BULK_MAX_BLOCKS);
+	UInt8* indices = &data[1];
+	UInt8* blocks  = &data[1 + BULK_MAX_BLOCKS * sizeof(Int32)];
+	Int32 i, count = data[0] + 1;
 
 	Int32 x, y, z;
 	for (i = 0; i < count; i++) {
-		Int32 index = indices[i];
+		Int32 index = Stream_GetI32_BE(&indices[i * sizeof(Int32)]);
 		if (index < 0 || index >= World_BlocksSize) continue;
 		World_Unpack(index, x, y, z);
 
@@ -1150,12 +1276,41 @@ static void CPE_SetInventoryOrder(Stream* stream) {
 	}
 }
 
+/* Sign extends a 6 bit position delta */
+#define BULK_ENTITY_DELTA(bits, shift) (((Int32)(((bits) >> (shift)) & 0x3F) ^ 0x20) - 0x20)
+/* Each entity is packed into 40 bits: entity ID (8 bits), X/Y/Z position deltas in 1/32 of a block (6 bits each),
+   then yaw and pitch as the top 7 bits of a packed angle (7 bits each). Servers fall back to the classic
+   relative/absolute position packets for entities that moved further than this can represent. */
+static void CPE_BulkEntityUpdate(Stream* stream) {
+	UInt8* data = Stream_UNSAFE_ReadMemory(stream, BULK_ENTITY_PACKET_SIZE - 1);
+	Int32 i, count = min(data[0] + 1, BULK_MAX_ENTITIES);
+	data++;
+
+	for (i = 0; i < count; i++, data += BULK_ENTITY_SIZE) {
+		UInt64 bits = ((UInt64)Stream_GetU32_BE(data) << 8) | data[4];
+		EntityID id = (EntityID)(bits >> 32);
+
+		Vector3 pos;
+		pos.X = BULK_ENTITY_DELTA(bits, 26) / 32.0f;
+		pos.Y = BULK_ENTITY_DELTA(bits, 20) / 32.0f;
+		pos.Z = BULK_ENTITY_DELTA(bits, 14) / 32.0f;
+
+		Real32 rotY  = Math_Packed2Deg((Int32)((bits >> 7) & 0x7F) << 1);
+		Real32 headX = Math_Packed2Deg((Int32)(bits & 0x7F) << 1);
+		LocationUpdate update; LocationUpdate_MakePosAndOri(&update, pos, rotY, headX, true);
+
+		Handlers_UpdateLocation(id, &update, true);
+	}
+}
+
 static void CPE_Reset(void) {
 	cpe_serverExtensionsCount = 0; cpe_pingTicks = 0;
 	cpe_sendHeldBlock = false; cpe_useMessageTypes = false;
 	cpe_envMapVer = 2; cpe_blockDefsExtVer = 2;
 	cpe_needD3Fix = false; cpe_extEntityPos = false; cpe_twoWayPing = false; cpe_fastMap = false;
 	Game_UseCPEBlocks = false;
+	/* Only accepted after the server declares support for BulkEntityUpdate in CPE_ExtEntry */
+	Net_Set(OPCODE_CPE_BULK_ENTITY_UPDATE, NULL, 0);
 	if (!Game_UseCPE) return;
 
 	Net_Set(OPCODE_CPE_EXT_INFO, CPE_ExtInfo, 67);
@@ -1208,6 +1363,7 @@ static void BlockDefs_OnBlockUpdated(BlockID block, bool didBlockLight) {
 }
 
 static BlockID BlockDefs_DefineBlockCommonStart(Stream* stream, bool uniqueSideTexs) {
+	Builder_CancelAll();
 	BlockID block = Handlers_ReadBlock(stream);
 	bool didBlockLight = Block_BlocksLight[block];
 	Block_ResetProps(block);
@@ -1278,6 +1434,7 @@ static void BlockDefs_DefineBlock(Stream* stream) {
 }
 
 static void BlockDefs_UndefineBlock(Stream* stream) {
+	Builder_CancelAll();
 	BlockID block = Handlers_ReadBlock(stream);
 	bool didBlockLight = Block_BlocksLight[block];
 
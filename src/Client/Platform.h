@@ -27,6 +27,12 @@ void Platform_Free(void);
 void Platform_Exit(ReturnCode code);
 STRING_PURE String Platform_GetCommandLineArgs(void);
 
+#if CC_BUILD_BENCHMARK
+/* Number of calls to Platform_MemAlloc/Platform_MemRealloc so far on the main thread. Only tracked in benchmark builds. */
+extern UInt32 Platform_AllocCount;
+/* Number of calls to Platform_MemAlloc/Platform_MemRealloc so far on all other threads (e.g. map decoding). */
+extern UInt32 Platform_BackgroundAllocCount;
+#endif
 void* Platform_MemAlloc(UInt32 numElems, UInt32 elemsSize);
 void* Platform_MemRealloc(void* mem, UInt32 numElems, UInt32 elemsSize);
 void Platform_MemFree(void** mem);
@@ -58,6 +64,9 @@ ReturnCode Platform_FileClose(void* file);
 ReturnCode Platform_FileSeek(void* file, Int32 offset, Int32 seekType);
 ReturnCode Platform_FilePosition(void* file, UInt32* position);
 ReturnCode Platform_FileLength(void* file, UInt32* length);
+/* Maps the entire contents of a file into memory for reading. (fails for empty files) */
+ReturnCode Platform_FileMap(void** data, UInt32* length, STRING_PURE String* path);
+ReturnCode Platform_FileUnmap(void* data);
 
 void Platform_ThreadSleep(UInt32 milliseconds);
 typedef void Platform_ThreadFunc(void);
@@ -65,6 +74,8 @@ void* Platform_ThreadStart(Platform_ThreadFunc* func);
 void Platform_ThreadJoin(void* handle);
 /* Frees handle to thread - NOT THE THREAD ITSELF */
 void Platform_ThreadFreeHandle(void* handle);
+/* Returns the number of logical processors available to the process. */
+Int32 Platform_ProcessorsCount(void);
 
 void* Platform_MutexCreate(void);
 void Platform_MutexFree(void* handle);
@@ -11,10 +11,21 @@
 #include "Game.h"
 #include "Funcs.h"
 #include "AsyncDownloader.h"
+#include "Benchmark.h"
 
 int main(void) {
 	ErrorHandler_Init("client.log");
 	Platform_Init();
+#if CC_BUILD_BENCHMARK
+	String capture = Platform_GetCommandLineArgs();
+	if (capture.length > 0) {
+		Benchmark_Replay(&capture);
+	} else {
+		Benchmark_Run();
+	}
+	Platform_Exit(0);
+	return 0;
+#endif
 
 	/*Platform_HttpInit();
 	AsyncRequest req = { 0 };
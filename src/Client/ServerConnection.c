@@ -20,6 +20,7 @@
 #include "PacketHandlers.h"
 #include "Inventory.h"
 #include "Platform.h"
+#include "Options.h"
 
 /*########################################################################################################################*
 *-----------------------------------------------------Common handlers-----------------------------------------------------*
@@ -265,8 +266,24 @@ void ServerConnection_InitSingleplayer(void) {
 void* net_socket;
 Stream net_readStream;
 Stream net_writeStream;
-UInt8 net_readBuffer[4096 * 5];
-UInt8 net_writeBuffer[131];
+
+#define NET_WRITE_MIN_CAPACITY (8 * 1024)
+#define NET_WRITE_MAX_CAPACITY (1024 * 1024)
+/* Some packets are queued without checking for room (e.g. in Handlers_Tick), so always keep room for a few */
+#define NET_WRITE_RESERVE 1024
+/* Queue of outgoing packets, which are sent together in one write at the end of each tick.
+   net_writeSent is how many queued bytes the socket has already accepted. */
+UInt8* net_writeBuffer;
+UInt32 net_writeCapacity, net_writeSent;
+
+/* Every packet must fit in the mirrored region, so that it can always be read contiguously */
+#define NET_MAX_PACKET_SIZE 2048
+#define NET_READ_MIN_CAPACITY (64 * 1024)
+#define NET_READ_MAX_CAPACITY (4 * 1024 * 1024)
+/* Ring buffer of received data, followed by a copy of its first NET_MAX_PACKET_SIZE bytes.
+   A packet that wraps around the end of the ring can then still be read in place. */
+UInt8* net_readBuffer;
+UInt32 net_readCapacity, net_readHead, net_readCount;
 
 Int32 net_maxHandledPacket;
 bool net_writeFailed;
@@ -278,6 +295,8 @@ Real64 net_discAccumulator;
 bool net_connecting;
 Int64 net_connectTimeout;
 #define NET_TIMEOUT_MS (15 * 1000)
+/* File that received data is recorded to, NULL if not capturing */
+void* net_captureFile;
 
 static void MPConnection_BlockChanged(void* obj, Vector3I coords, BlockID oldBlock, BlockID block) {
 	Vector3I p = coords;
@@ -290,18 +309,76 @@ static void MPConnection_BlockChanged(void* obj, Vector3I coords, BlockID oldBlo
 	Net_SendPacket();
 }
 
+static void MPConnection_StopCapture(void) {
+	if (net_captureFile == NULL) return;
+	ReturnCode result = Platform_FileClose(net_captureFile);
+	ErrorHandler_CheckOrFail(result, "Closing network capture file");
+	net_captureFile = NULL;
+}
+
+static void MPConnection_StartCapture(void) {
+	UInt8 pathBuffer[String_BufferSize(FILENAME_SIZE)];
+	String path = String_InitAndClearArray(pathBuffer);
+	Options_Get(OPT_NET_CAPTURE_FILE, &path, "");
+
+	MPConnection_StopCapture();
+	if (path.length == 0) return;
+	ReturnCode result = Platform_FileCreate(&net_captureFile, &path);
+	if (result == 0) return;
+
+	UInt8 msgBuffer[String_BufferSize(STRING_SIZE * 2)];
+	String msg = String_InitAndClearArray(msgBuffer);
+	String_Format2(&msg, "Error creating network capture file %s: %i", &path, &result);
+	ErrorHandler_Log(&msg);
+	net_captureFile = NULL;
+}
+
+static void MPConnection_Capture(UInt8* data, UInt32 count) {
+	UInt32 modified = 0;
+	while (count > 0) {
+		ReturnCode result = Platform_FileWrite(net_captureFile, data, count, &modified);
+		/* Losing the capture isn't worth disconnecting over */
+		if (result != 0 || modified == 0) {
+			UInt8 msgBuffer[String_BufferSize(STRING_SIZE)];
+			String msg = String_InitAndClearArray(msgBuffer);
+			String_Format1(&msg, "Error writing network capture file: %i", &result);
+			ErrorHandler_Log(&msg);
+			MPConnection_StopCapture(); return;
+		}
+		data += modified; count -= modified;
+	}
+}
+
+static void MPConnection_ResetBuffers(void) {
+	String streamName = String_FromConst("network socket");
+	Stream_ReadonlyMemory(&net_readStream, NULL, 0, &streamName); /* initally no memory to read */
+
+	/* Don't hold onto a large read buffer from a previous busy server */
+	if (net_readCapacity != NET_READ_MIN_CAPACITY) {
+		Platform_MemFree(&net_readBuffer);
+		net_readCapacity = NET_READ_MIN_CAPACITY;
+		net_readBuffer   = Platform_MemAlloc(net_readCapacity + NET_MAX_PACKET_SIZE, sizeof(UInt8));
+		if (net_readBuffer == NULL) ErrorHandler_Fail("Failed to allocate network read buffer");
+	}
+	net_readHead = 0; net_readCount = 0;
+
+	if (net_writeCapacity != NET_WRITE_MIN_CAPACITY) {
+		Platform_MemFree(&net_writeBuffer);
+		net_writeCapacity = NET_WRITE_MIN_CAPACITY;
+		net_writeBuffer   = Platform_MemAlloc(net_writeCapacity, sizeof(UInt8));
+		if (net_writeBuffer == NULL) ErrorHandler_Fail("Failed to allocate network write buffer");
+	}
+	Stream_WriteonlyMemory(&net_writeStream, net_writeBuffer, net_writeCapacity, &streamName);
+	net_writeSent = 0;
+}
+
 static void ServerConnection_Free(void);
 static void MPConnection_FinishConnect(void) {
 	net_connecting = false;
 	Event_RaiseReal(&WorldEvents_Loading, 0.0f);
 
-	String streamName = String_FromConst("network socket");
-	Stream_ReadonlyMemory(&net_readStream, net_readBuffer, sizeof(net_readBuffer), &streamName);
-	Stream_WriteonlyMemory(&net_writeStream, net_writeBuffer, sizeof(net_writeBuffer), &streamName);
-
-	net_readStream.Meta_Mem_Left   = 0; /* initally no memory to read */
-	net_readStream.Meta_Mem_Length = 0;
-
+	MPConnection_ResetBuffers();
+	MPConnection_StartCapture();
 	Handlers_Reset();
 	Classic_WriteLogin(&net_writeStream, &Game_Username, &Game_Mppass);
 	Net_SendPacket();
@@ -410,6 +487,115 @@ static void MPConnection_CheckDisconnection(Real64 delta) {
 	}
 }
 
+static void MPConnection_GrowReadBuffer(UInt32 required) {
+	UInt32 capacity = net_readCapacity;
+	while (capacity < required && capacity < NET_READ_MAX_CAPACITY) { capacity *= 2; }
+	if (capacity == net_readCapacity) return;
+
+	UInt8* buffer = Platform_MemAlloc(capacity + NET_MAX_PACKET_SIZE, sizeof(UInt8));
+	if (buffer == NULL) ErrorHandler_Fail("Failed to grow network read buffer");
+
+	/* Unread data is unwrapped to start of the new buffer */
+	UInt32 first = min(net_readCount, net_readCapacity - net_readHead);
+	Platform_MemCpy(buffer, &net_readBuffer[net_readHead], first);
+	Platform_MemCpy(&buffer[first], net_readBuffer, net_readCount - first);
+
+	Platform_MemFree(&net_readBuffer);
+	net_readBuffer   = buffer;
+	net_readCapacity = capacity;
+	net_readHead     = 0;
+}
+
+/* Reads everything the socket has received so far into the read buffer, without blocking */
+static ReturnCode MPConnection_ReadSocket(void) {
+	for (;;) {
+		UInt32 available = 0, modified = 0;
+		ReturnCode result = Platform_SocketAvailable(net_socket, &available);
+		if (result != 0 || available == 0) return result;
+
+		if (net_readCount + available > net_readCapacity) {
+			MPConnection_GrowReadBuffer(net_readCount + available);
+		}
+		UInt32 tail = (net_readHead + net_readCount) % net_readCapacity;
+		UInt32 room = min(net_readCapacity - net_readCount, net_readCapacity - tail);
+		/* Buffer is at its largest and full, so process what was received first */
+		if (room == 0) return 0;
+
+		result = Platform_SocketRead(net_socket, &net_readBuffer[tail], min(available, room), &modified);
+		if (result != 0 || modified == 0) return result;
+		if (net_captureFile != NULL) MPConnection_Capture(&net_readBuffer[tail], modified);
+
+		if (tail < NET_MAX_PACKET_SIZE) {
+			UInt32 mirrored = min(modified, NET_MAX_PACKET_SIZE - tail);
+			Platform_MemCpy(&net_readBuffer[net_readCapacity + tail], &net_readBuffer[tail], mirrored);
+		}
+		net_readCount += modified;
+	}
+}
+
+/* Points the read stream at the unread data, which is at least one whole packet if enough data has been received */
+static UInt8* MPConnection_BeginPacket(void) {
+	UInt8* packet = &net_readBuffer[net_readHead];
+	UInt32 left   = min(net_readCount, net_readCapacity + NET_MAX_PACKET_SIZE - net_readHead);
+
+	net_readStream.Meta_Mem_Base   = packet;
+	net_readStream.Meta_Mem_Cur    = packet;
+	net_readStream.Meta_Mem_Left   = left;
+	net_readStream.Meta_Mem_Length = left;
+	return packet;
+}
+
+static void MPConnection_EndPacket(UInt8* packet) {
+	UInt32 read = (UInt32)(net_readStream.Meta_Mem_Cur - packet);
+	net_readHead += read;
+	if (net_readHead >= net_readCapacity) net_readHead -= net_readCapacity;
+	net_readCount -= read;
+}
+
+static void MPConnection_GrowWriteBuffer(void) {
+	UInt32 capacity = net_writeCapacity * 2;
+	UInt8* buffer = Platform_MemAlloc(capacity, sizeof(UInt8));
+	if (buffer == NULL) ErrorHandler_Fail("Failed to grow network write buffer");
+
+	/* Unsent data is moved to start of the new buffer */
+	UInt32 queued = (UInt32)(net_writeStream.Meta_Mem_Cur - net_writeBuffer) - net_writeSent;
+	Platform_MemCpy(buffer, &net_writeBuffer[net_writeSent], queued);
+	Platform_MemFree(&net_writeBuffer);
+
+	net_writeBuffer   = buffer;
+	net_writeCapacity = capacity;
+	net_writeSent     = 0;
+	net_writeStream.Meta_Mem_Base   = buffer;
+	net_writeStream.Meta_Mem_Cur    = buffer + queued;
+	net_writeStream.Meta_Mem_Left   = capacity - queued;
+	net_writeStream.Meta_Mem_Length = capacity;
+}
+
+/* Sends all queued packets. If block is false, stops early when the socket can't currently accept more data. */
+static void MPConnection_FlushWrites(bool block) {
+	UInt32 end = (UInt32)(net_writeStream.Meta_Mem_Cur - net_writeBuffer);
+	if (ServerConnection_Disconnected) net_writeSent = end;
+
+	while (net_writeSent < end) {
+		if (!block) {
+			bool writable = false;
+			Platform_SocketSelect(net_socket, SOCKET_SELECT_WRITE, &writable);
+			/* Rest is sent on a later tick, once the server has caught up */
+			if (!writable) return;
+		}
+
+		UInt32 modified = 0;
+		ReturnCode result = Platform_SocketWrite(net_socket, &net_writeBuffer[net_writeSent], end - net_writeSent, &modified);
+		/* NOTE: Not immediately disconnecting here, as otherwise we sometimes miss out on kick messages */
+		if (result != 0 || modified == 0) { net_writeFailed = true; break; }
+		net_writeSent += modified;
+	}
+
+	net_writeSent = 0;
+	net_writeStream.Meta_Mem_Cur  = net_writeStream.Meta_Mem_Base;
+	net_writeStream.Meta_Mem_Left = net_writeStream.Meta_Mem_Length;
+}
+
 static void MPConnection_Tick(ScheduledTask* task) {
 	if (ServerConnection_Disconnected) return;
 	if (net_connecting) { MPConnection_TickConnect(); return; }
@@ -420,16 +606,7 @@ static void MPConnection_Tick(ScheduledTask* task) {
 	}
 	if (ServerConnection_Disconnected) return;
 
-	UInt32 modified = 0;
-	ReturnCode recvResult = Platform_SocketAvailable(net_socket, &modified);
-	if (recvResult == 0 && modified > 0) {
-		/* NOTE: Always using a read call that is a multiple of 4096 (appears to?) improve read performance */
-		UInt8* src = net_readBuffer + net_readStream.Meta_Mem_Left;
-		recvResult = Platform_SocketRead(net_socket, src, 4096 * 4, &modified);
-		net_readStream.Meta_Mem_Left   += modified;
-		net_readStream.Meta_Mem_Length += modified;
-	}
-
+	ReturnCode recvResult = MPConnection_ReadSocket();
 	if (recvResult != 0) {
 		UInt8 msgBuffer[String_BufferSize(STRING_SIZE * 2)];
 		String msg = String_InitAndClearArray(msgBuffer);
@@ -442,71 +619,65 @@ static void MPConnection_Tick(ScheduledTask* task) {
 		return;
 	}
 
-	while (net_readStream.Meta_Mem_Left > 0) {
-		UInt8 opcode = net_readStream.Meta_Mem_Cur[0];
-		/* Workaround for older D3 servers which wrote one byte too many for HackControl packets */
-		if (cpe_needD3Fix && net_lastOpcode == OPCODE_CPE_HACK_CONTROL && (opcode == 0x00 || opcode == 0xFF)) {
-			Platform_LogConst("Skipping invalid HackControl byte from D3 server");
-			Stream_Skip(&net_readStream, 1);
-
-			LocalPlayer* p = &LocalPlayer_Instance;
-			p->Physics.JumpVel = 0.42f; /* assume default jump height */
-			p->Physics.ServerJumpVel = p->Physics.JumpVel;
-			continue;
-		}
-
-		if (opcode > net_maxHandledPacket) { ErrorHandler_Fail("Invalid opcode"); }
-		if (net_readStream.Meta_Mem_Left < Net_PacketSizes[opcode]) break;
-
-		Stream_Skip(&net_readStream, 1); /* remove opcode */
-		net_lastOpcode = opcode;
-		Net_Handler handler = Net_Handlers[opcode];
-		Platform_CurrentUTCTime(&net_lastPacket);
-
-		if (handler == NULL) { ErrorHandler_Fail("Unsupported opcode"); }
-		handler(&net_readStream);
+	while (net_readCount > 0) {
+		UInt8* packet = MPConnection_BeginPacket();
+		if (!Net_HandlePacket(&net_readStream)) break;
+		MPConnection_EndPacket(packet);
 	}
 
-	/* Keep last few unprocessed bytes, don't care about rest since they'll be overwritten on socket read */
-	Int32 i;
-	for (i = 0; i < net_readStream.Meta_Mem_Left; i++) {
-		net_readBuffer[i] = net_readStream.Meta_Mem_Cur[i];
-	}
-	net_readStream.Meta_Mem_Cur    = net_readStream.Meta_Mem_Base;
-	net_readStream.Meta_Mem_Length = net_readStream.Meta_Mem_Left;
-
 	/* Network is ticked 60 times a second. We only send position updates 20 times a second */
 	if ((net_ticks % 3) == 0) {
 		ServerConnection_CheckAsyncResources();
 		Handlers_Tick();
-		/* Have any packets been written? */
-		if (net_writeStream.Meta_Mem_Cur != net_writeStream.Meta_Mem_Base) {
-			Net_SendPacket();
-		}
 	}
+	MPConnection_FlushWrites(false);
 	net_ticks++;
 }
 
+bool Net_HandlePacket(Stream* stream) {
+	UInt8 opcode = stream->Meta_Mem_Cur[0];
+	/* Workaround for older D3 servers which wrote one byte too many for HackControl packets */
+	if (cpe_needD3Fix && net_lastOpcode == OPCODE_CPE_HACK_CONTROL && (opcode == 0x00 || opcode == 0xFF)) {
+		Platform_LogConst("Skipping invalid HackControl byte from D3 server");
+		Stream_Skip(stream, 1);
+
+		LocalPlayer* p = &LocalPlayer_Instance;
+		p->Physics.JumpVel = 0.42f; /* assume default jump height */
+		p->Physics.ServerJumpVel = p->Physics.JumpVel;
+		return true;
+	}
+
+	if (opcode > net_maxHandledPacket) { ErrorHandler_Fail("Invalid opcode"); }
+	/* Whole packet is received before handling it, so handlers can decode it in place with Stream_UNSAFE_ReadMemory */
+	if (stream->Meta_Mem_Left < Net_PacketSizes[opcode]) return false;
+
+	Stream_Skip(stream, 1); /* remove opcode */
+	net_lastOpcode = opcode;
+	Net_Handler handler = Net_Handlers[opcode];
+	Platform_CurrentUTCTime(&net_lastPacket);
+
+	if (handler == NULL) { ErrorHandler_Fail("Unsupported opcode"); }
+	handler(stream);
+	return true;
+}
+
 void Net_Set(UInt8 opcode, Net_Handler handler, UInt16 packetSize) {
+	if (packetSize > NET_MAX_PACKET_SIZE) ErrorHandler_Fail("Packet too large for network read buffer");
 	Net_Handlers[opcode] = handler;
 	Net_PacketSizes[opcode] = packetSize;
 	net_maxHandledPacket = max(opcode, net_maxHandledPacket);
 }
 
 void Net_SendPacket(void) {
-	if (!ServerConnection_Disconnected) {
-		/* NOTE: Not immediately disconnecting here, as otherwise we sometimes miss out on kick messages */
-		UInt32 count = (UInt32)(net_writeStream.Meta_Mem_Cur - net_writeStream.Meta_Mem_Base), modified = 0;
+	/* Packet stays queued, and is actually sent at the end of the tick */
+	if (net_writeStream.Meta_Mem_Left >= NET_WRITE_RESERVE) return;
 
-		while (count > 0) {
-			ReturnCode result = Platform_SocketWrite(net_socket, net_writeBuffer, count, &modified);
-			if (result != 0 || modified == 0) { net_writeFailed = true; break; }
-			count -= modified;
-		}
+	if (net_writeCapacity < NET_WRITE_MAX_CAPACITY) {
+		MPConnection_GrowWriteBuffer();
+	} else {
+		/* Server isn't keeping up with what is being sent, so have to wait for it */
+		MPConnection_FlushWrites(true);
 	}
-	
-	net_writeStream.Meta_Mem_Cur   = net_writeStream.Meta_Mem_Base;
-	net_writeStream.Meta_Mem_Left = net_writeStream.Meta_Mem_Length;
 }
 
 static Stream* MPConnection_ReadStream(void)  { return &net_readStream; }
@@ -525,6 +696,14 @@ void ServerConnection_InitMultiplayer(void) {
 	ServerConnection_WriteStream = MPConnection_WriteStream;
 }
 
+void ServerConnection_InitReplay(void) {
+	ServerConnection_InitMultiplayer();
+	MPConnection_ResetBuffers();
+	Handlers_Reset();
+	/* There is no socket, so anything sent to the server is just discarded */
+	ServerConnection_Disconnected = true;
+}
+
 
 static void MPConnection_OnNewMap(void) {
 	if (ServerConnection_IsSinglePlayer) return;
@@ -553,6 +732,7 @@ static void ServerConnection_Free(void) {
 	if (ServerConnection_IsSinglePlayer) {
 		Physics_Free();
 	} else {
+		MPConnection_StopCapture();
 		if (ServerConnection_Disconnected) return;
 		Event_UnregisterBlock(&UserEvents_BlockChanged, NULL, MPConnection_BlockChanged);
 		Platform_SocketClose(net_socket);
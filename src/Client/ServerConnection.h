@@ -54,6 +54,7 @@ enum OPCODE_ {
 	OPCODE_CPE_SET_ENTITY_PROPERTY,
 	OPCODE_CPE_TWO_WAY_PING,
 	OPCODE_CPE_SET_INVENTORY_ORDER,
+	OPCODE_CPE_BULK_ENTITY_UPDATE,
 };
 
 typedef struct PickedPos_ PickedPos;
@@ -91,12 +92,19 @@ void ServerConnection_RetrieveTexturePack(STRING_PURE String* url);
 void ServerConnection_DownloadTexturePack(STRING_PURE String* url);
 void ServerConnection_InitSingleplayer(void);
 void ServerConnection_InitMultiplayer(void);
+/* Sets up a multiplayer connection without a socket, for handling packets from a capture. (see OPT_NET_CAPTURE_FILE)
+   Packets are handled by passing a readonly memory stream over the captured data to Net_HandlePacket. */
+void ServerConnection_InitReplay(void);
 IGameComponent ServerConnection_MakeComponent(void);
 
 typedef void (*Net_Handler)(Stream* stream);
-#define OPCODE_COUNT 45
+#define OPCODE_COUNT 46
 UInt16 Net_PacketSizes[OPCODE_COUNT];
 Net_Handler Net_Handlers[OPCODE_COUNT];
 void Net_Set(UInt8 opcode, Net_Handler handler, UInt16 size);
+/* Handles the next packet in the given readonly memory stream.
+   Returns false, without reading anything, if the stream does not contain all of the packet. */
+bool Net_HandlePacket(Stream* stream);
+/* Queues the packet(s) written to the write stream. Queued packets are sent together at the end of each network tick. */
 void Net_SendPacket(void);
 #endif
\ No newline at end of file
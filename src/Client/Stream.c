@@ -211,7 +211,7 @@ static ReturnCode Stream_MemorySeek(Stream* stream, Int32 offset, Int32 seekType
 	default: return 2;
 	}
 
-	if (pos < 0 || pos >= stream->Meta_Mem_Length) return 1;
+	if (pos < 0 || pos > stream->Meta_Mem_Length) return 1;
 	stream->Meta_Mem_Cur  = stream->Meta_Mem_Base   + pos;
 	stream->Meta_Mem_Left = stream->Meta_Mem_Length - pos;
 	return 0;
@@ -238,6 +238,40 @@ void Stream_WriteonlyMemory(Stream* stream, void* data, UInt32 len, STRING_PURE
 	stream->Write = Stream_MemoryWrite;
 }
 
+static ReturnCode Stream_MappedClose(Stream* stream) {
+	ReturnCode code = Platform_FileUnmap(stream->Meta_Mem_Base);
+	stream->Meta_Mem_Base = NULL;
+	return code;
+}
+
+ReturnCode Stream_MapFile(Stream* stream, STRING_PURE String* path) {
+	void* data;
+	UInt32 length;
+	ReturnCode code = Platform_FileMap(&data, &length, path);
+	if (code != 0) return code;
+
+	Stream_ReadonlyMemory(stream, data, length, path);
+	stream->Close = Stream_MappedClose;
+	return 0;
+}
+
+UInt8* Stream_UNSAFE_GetMemory(Stream* stream, UInt32* left) {
+	if (stream->Read != Stream_MemoryRead) return NULL;
+	*left = stream->Meta_Mem_Left;
+	return stream->Meta_Mem_Cur;
+}
+
+UInt8* Stream_UNSAFE_ReadMemory(Stream* stream, UInt32 count) {
+	if (stream->Read != Stream_MemoryRead || stream->Meta_Mem_Left < count) {
+		Stream_Fail(stream, ReturnCode_NotSupported, "reading memory from");
+	}
+
+	UInt8* data = stream->Meta_Mem_Cur;
+	stream->Meta_Mem_Cur  += count;
+	stream->Meta_Mem_Left -= count;
+	return data;
+}
+
 
 /*########################################################################################################################*
 *----------------------------------------------------BufferedStream-------------------------------------------------------*
@@ -288,7 +322,7 @@ UInt16 Stream_ReadU16_LE(Stream* stream) {
 UInt16 Stream_ReadU16_BE(Stream* stream) {
 	UInt8 buffer[sizeof(UInt16)];
 	Stream_Read(stream, buffer, sizeof(UInt16));
-	return (UInt16)((buffer[0] << 8) | buffer[1]);
+	return Stream_GetU16_BE(buffer);
 }
 
 UInt32 Stream_ReadU32_LE(Stream* stream) {
@@ -302,9 +336,7 @@ UInt32 Stream_ReadU32_LE(Stream* stream) {
 UInt32 Stream_ReadU32_BE(Stream* stream) {
 	UInt8 buffer[sizeof(UInt32)];
 	Stream_Read(stream, buffer, sizeof(UInt32));
-	return (UInt32)(
-		((UInt32)buffer[0] << 24) | ((UInt32)buffer[1] << 16) |
-		((UInt32)buffer[2] << 8)  | (UInt32)buffer[3]);
+	return Stream_GetU32_BE(buffer);
 }
 
 UInt64 Stream_ReadU64_BE(Stream* stream) {
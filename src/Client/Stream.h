@@ -43,11 +43,19 @@ ReturnCode Stream_Skip(Stream* stream, UInt32 count);
 void Stream_SetDefaultOps(Stream* stream);
 
 void Stream_FromFile(Stream* stream, void* file, STRING_PURE String* name);
+/* Readonly memory Stream over a memory mapped file. Closing the stream unmaps the file. */
+ReturnCode Stream_MapFile(Stream* stream, STRING_PURE String* path);
 /* Readonly Stream wrapping another Stream, only allows reading up to 'len' bytes from the wrapped stream. */
 void Stream_ReadonlyPortion(Stream* stream, Stream* source, UInt32 len);
 void Stream_ReadonlyMemory(Stream* stream, void* data, UInt32 len, STRING_PURE String* name);
 void Stream_WriteonlyMemory(Stream* stream, void* data, UInt32 len, STRING_PURE String* name);
 void Stream_ReadonlyBuffered(Stream* stream, Stream* source, void* data, UInt32 size);
+/* Returns pointer to remaining data of a readonly memory stream, or NULL if the stream is not one.
+   Lets data be used in place instead of copied out, after which it should be skipped over using Stream_Skip. */
+UInt8* Stream_UNSAFE_GetMemory(Stream* stream, UInt32* left);
+/* Returns pointer to the next 'count' bytes of a readonly memory stream, then skips over them.
+   Lets fixed size data (e.g. network packets) be decoded directly with Stream_GetXYZ, instead of one Stream_ReadXYZ per field. */
+UInt8* Stream_UNSAFE_ReadMemory(Stream* stream, UInt32 count);
 
 
 UInt8 Stream_ReadU8(Stream* stream);
@@ -63,6 +71,12 @@ UInt32 Stream_ReadU32_BE(Stream* stream);
 UInt64 Stream_ReadU64_BE(Stream* stream);
 #define Stream_ReadI64_BE(stream) ((Int64)Stream_ReadU64_BE(stream))
 
+/* Decodes big endian integers from the given bytes. Caller must ensure enough bytes are available. */
+#define Stream_GetU16_BE(data) ((UInt16)(((data)[0] << 8) | (data)[1]))
+#define Stream_GetI16_BE(data) ((Int16)Stream_GetU16_BE(data))
+#define Stream_GetU32_BE(data) (((UInt32)(data)[0] << 24) | ((UInt32)(data)[1] << 16) | ((UInt32)(data)[2] << 8) | (UInt32)(data)[3])
+#define Stream_GetI32_BE(data) ((Int32)Stream_GetU32_BE(data))
+
 void Stream_WriteU8(Stream* stream, UInt8 value);
 #define Stream_WriteI8(stream, value) Stream_WriteU8(stream, (UInt8)(value))
 void Stream_WriteU16_LE(Stream* stream, UInt16 value);
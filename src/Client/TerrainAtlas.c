@@ -90,6 +90,7 @@ void Atlas1D_UpdateState(void) {
 	Int32 maxTiles = ATLAS2D_ROWS_COUNT * ATLAS2D_TILES_PER_ROW;
 
 	Atlas1D_TilesPerAtlas = min(maxTilesPerAtlas, maxTiles);
+	if (Atlas1D_SingleTile) Atlas1D_TilesPerAtlas = 1;
 	Int32 atlasesCount = Math_CeilDiv(maxTiles, Atlas1D_TilesPerAtlas);
 	Int32 atlasHeight = Atlas1D_TilesPerAtlas * Atlas2D_TileSize;
 
@@ -24,6 +24,9 @@ void Atlas2D_Free(void);
 Int32 Atlas1D_TilesPerAtlas;
 /* Size of a texture V coord V for an tile in a 1D atlas. */
 Real32 Atlas1D_InvTileSize;
+/* Whether each 1D atlas holds only a single tile, so tiles can also be repeated along V axis.
+NOTE: This greatly increases the number of 1D atlases, and hence texture switches when rendering. */
+bool Atlas1D_SingleTile;
 /* Native texture ID for each 1D atlas. */
 GfxResourceID Atlas1D_TexIds[ATLAS1D_MAX_ATLASES];
 /* Number of 1D atlases that actually have textures / are used. */
@@ -13,6 +13,8 @@
 #include "Platform.h"
 #include "Deflate.h"
 #include "Stream.h"
+#include "Funcs.h"
+#include "ModelCache.h"
 
 /*########################################################################################################################*
 *--------------------------------------------------------ZipEntry---------------------------------------------------------*
@@ -304,11 +306,14 @@ static void TextureCache_MakePath(STRING_TRANSIENT String* path, STRING_PURE Str
 
 bool TextureCache_HasUrl(STRING_PURE String* url) {
 	String path; TexCache_InitAndMakePath(url);
+	/* Cached images are written out in the background, so the file may still be only partially written */
+	Bitmap_WaitEncodePngs();
 	return Platform_FileExists(&path);
 }
 
 bool TextureCache_GetStream(STRING_PURE String* url, Stream* stream) {
 	String path; TexCache_InitAndMakePath(url);
+	Bitmap_WaitEncodePngs();
 
 	void* file;
 	ReturnCode result = Platform_FileOpen(&file, &path);
@@ -344,6 +349,7 @@ void TextureCache_GetLastModified(STRING_PURE String* url, DateTime* time) {
 		DateTime_FromTotalMs(time, ticks / TEXCACHE_TICKS_PER_MS);
 	} else {
 		String path; TexCache_InitAndMakePath(url);
+		Bitmap_WaitEncodePngs();
 		ReturnCode result = Platform_FileGetWriteTime(&path, time);
 		ErrorHandler_CheckOrFail(result, "TextureCache - get file last modified time")
 	}
@@ -354,6 +360,8 @@ void TextureCache_GetETag(STRING_PURE String* url, STRING_PURE String* etag) {
 }
 
 static void* TextureCache_CreateFile(STRING_PURE String* path) {
+	/* Don't truncate a file that an earlier image is still being encoded into */
+	Bitmap_WaitEncodePngs();
 	String folder = String_FromConst(TEXCACHE_FOLDER);
 	if (!Platform_DirectoryExists(&folder)) {
 		ReturnCode dirResult = Platform_DirectoryCreate(&folder);
@@ -370,12 +378,14 @@ static void* TextureCache_CreateFile(STRING_PURE String* path) {
 void TextureCache_AddImage(STRING_PURE String* url, Bitmap* bmp) {
 	String path; TexCache_InitAndMakePath(url);
 	void* file = TextureCache_CreateFile(&path);
-	Stream stream; Stream_FromFile(&stream, file, &path);
-	{
-		Bitmap_EncodePng(bmp, &stream);
+
+	/* Caller keeps using the bitmap (e.g. as the terrain atlas), so encode a copy in the background */
+	Bitmap copy; Bitmap_Allocate(&copy, bmp->Width, bmp->Height);
+	Int32 y;
+	for (y = 0; y < bmp->Height; y++) {
+		Platform_MemCpy(Bitmap_GetRow(&copy, y), Bitmap_GetRow(bmp, y), copy.Stride);
 	}
-	ReturnCode result = stream.Close(&stream);
-	ErrorHandler_CheckOrFail(result, "TextureCache_AddImage - close file");
+	Bitmap_EncodePngAsync(&copy, file, &path);
 }
 
 void TextureCache_AddData(STRING_PURE String* url, UInt8* data, UInt32 length) {
@@ -425,7 +435,12 @@ void TextureCache_AddLastModified(STRING_PURE String* url, DateTime* lastModifie
 /*########################################################################################################################*
 *-------------------------------------------------------TexturePack-------------------------------------------------------*
 *#########################################################################################################################*/
-static void TexturePack_ProcessZipEntry(STRING_TRANSIENT String* path, Stream* stream, ZipEntry* entry) {
+/* Entries are read into memory first, so that all the PNG images in them can be decoded at the same time */
+UInt8* texpack_data[ZIP_MAX_ENTRIES];
+UInt32 texpack_sizes[ZIP_MAX_ENTRIES];
+StringsBuffer texpack_names;
+
+static void TexturePack_ReadZipEntry(STRING_TRANSIENT String* path, Stream* stream, ZipEntry* entry) {
 	/* Ignore directories: convert x/name to name and x\name to name. */
 	String_MakeLowercase(path);
 	String name = *path;
@@ -436,8 +451,29 @@ static void TexturePack_ProcessZipEntry(STRING_TRANSIENT String* path, Stream* s
 	i = String_LastIndexOf(&name, '/');
 	if (i >= 0) { name = String_UNSAFE_SubstringAt(&name, i + 1); }
 
-	String_Set(&stream->Name, &name);
-	Event_RaiseStream(&TextureEvents_FileChanged, stream);
+	UInt32 size = entry->UncompressedDataSize;
+	UInt8* data = Platform_MemAlloc(max(size, 1), sizeof(UInt8));
+	if (data == NULL) ErrorHandler_Fail("TexturePack - failed to allocate entry data");
+	Stream_Read(stream, data, size);
+
+	i = texpack_names.Count;
+	texpack_data[i] = data; texpack_sizes[i] = size;
+	StringsBuffer_Add(&texpack_names, &name);
+}
+
+/* Images that are decoded by TextureEvents_FileChanged handlers. Other images in the pack (e.g. pack.png) may not
+   even be decodable, so must not be predecoded, as Bitmap_DecodePng fails on invalid or unsupported images. */
+const UInt8* texpack_usedPngs[] = {
+	"terrain.png", "default.png", "animations.png", "animation.png", "cloud.png", "clouds.png", "gui.png",
+	"gui_classic.png", "icons.png", "particles.png", "skybox.png", "snow.png", "rain.png",
+};
+
+static bool TexturePack_IsUsedPng(STRING_PURE String* name) {
+	Int32 i;
+	for (i = 0; i < Array_Elems(texpack_usedPngs); i++) {
+		if (String_CaselessEqualsConst(name, texpack_usedPngs[i])) return true;
+	}
+	return ModelCache_GetTextureIndex(name) >= 0;
 }
 
 static void TexturePack_ExtractZip(Stream* stream) {
@@ -446,8 +482,30 @@ static void TexturePack_ExtractZip(Stream* stream) {
 
 	ZipState state;
 	Zip_Init(&state, stream);
-	state.ProcessEntry = TexturePack_ProcessZipEntry;
+	state.ProcessEntry = TexturePack_ReadZipEntry;
+	StringsBuffer_Init(&texpack_names);
 	Zip_Extract(&state);
+
+	UInt8* pngData[ZIP_MAX_ENTRIES];
+	UInt32 pngSizes[ZIP_MAX_ENTRIES];
+	Int32 i, pngsCount = 0, count = texpack_names.Count;
+	for (i = 0; i < count; i++) {
+		String name = StringsBuffer_UNSAFE_Get(&texpack_names, i);
+		if (!TexturePack_IsUsedPng(&name)) continue;
+		pngData[pngsCount] = texpack_data[i]; pngSizes[pngsCount] = texpack_sizes[i]; pngsCount++;
+	}
+	Bitmap_PredecodePngs(pngData, pngSizes, pngsCount);
+
+	for (i = 0; i < count; i++) {
+		String name = StringsBuffer_UNSAFE_Get(&texpack_names, i);
+		Stream entry; Stream_ReadonlyMemory(&entry, texpack_data[i], texpack_sizes[i], &name);
+		Event_RaiseStream(&TextureEvents_FileChanged, &entry);
+	}
+
+	/* Freed afterwards, so a freed entry's address can't be reused and mistaken for a predecoded image */
+	for (i = 0; i < count; i++) { Platform_MemFree(&texpack_data[i]); }
+	Bitmap_FreePredecodedPngs();
+	StringsBuffer_Free(&texpack_names);
 }
 
 void TexturePack_ExtractZip_File(STRING_PURE String* filename) {
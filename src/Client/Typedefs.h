@@ -59,6 +59,21 @@ typedef struct FontDesc_ { void* Handle; UInt16 Size, Style; } FontDesc;
 
 #define CC_BUILD_GL11 false
 #define CC_BUILD_D3D9 false
+/* Uses a graphics backend that renders nothing, for running headless. */
+#ifndef CC_BUILD_NULLGFX
+#define CC_BUILD_NULLGFX false
+#endif
+/* Runs the chunk mesh building benchmark instead of the game. Best used with CC_BUILD_NULLGFX. */
+/* The Benchmark configuration in Client.vcxproj defines both of these. */
+#ifndef CC_BUILD_BENCHMARK
+#define CC_BUILD_BENCHMARK false
+#endif
+/* Uploads chunk meshes using the smaller VertexP3sT2fC4b format. Only supported by the OpenGL backend. */
+#define CC_BUILD_COMPACTVERTEX false
+
+#if CC_BUILD_COMPACTVERTEX && CC_BUILD_D3D9
+#error "CC_BUILD_COMPACTVERTEX is only supported by the OpenGL backend."
+#endif
 
 #if CC_BUILD_D3D9
 typedef void* GfxResourceID;
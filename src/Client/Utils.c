@@ -139,13 +139,41 @@ UInt8 Utils_GetSkinType(Bitmap* bmp) {
 	return alpha >= 127 ? SKIN_TYPE_64x64 : SKIN_TYPE_64x64_SLIM;
 }
 
-UInt32 Utils_CRC32(UInt8* data, UInt32 length) {
-	UInt32 crc = 0xffffffffUL;
-	Int32 i;
-	for (i = 0; i < length; i++) {
-		crc = Utils_Crc32Table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+/* Slice-by-8 tables, where crc32_tables[n][i] is CRC of byte i followed by n zero bytes */
+UInt32 crc32_tables[8][256];
+bool crc32_tablesInited;
+
+static void Utils_InitCrc32Tables(void) {
+	Int32 i, j;
+	for (i = 0; i < 256; i++) { crc32_tables[0][i] = Utils_Crc32Table[i]; }
+	for (j = 1; j < 8; j++) {
+		for (i = 0; i < 256; i++) {
+			UInt32 crc = crc32_tables[j - 1][i];
+			crc32_tables[j][i] = Utils_Crc32Table[crc & 0xFF] ^ (crc >> 8);
+		}
 	}
-	return crc ^ 0xffffffffUL;
+	crc32_tablesInited = true;
+}
+
+UInt32 Utils_Crc32Update(UInt32 crc, UInt8* data, UInt32 length) {
+	if (!crc32_tablesInited) Utils_InitCrc32Tables();
+
+	/* Process 8 bytes at a time, using a separate table lookup for each byte */
+	for (; length >= 8; length -= 8, data += 8) {
+		UInt32 lo = crc ^ (data[0] | (data[1] << 8) | (data[2] << 16) | ((UInt32)data[3] << 24));
+		UInt32 hi = data[4] | (data[5] << 8) | (data[6] << 16) | ((UInt32)data[7] << 24);
+
+		crc = crc32_tables[7][lo & 0xFF] ^ crc32_tables[6][(lo >> 8) & 0xFF] ^ crc32_tables[5][(lo >> 16) & 0xFF] ^ crc32_tables[4][lo >> 24]
+			^ crc32_tables[3][hi & 0xFF] ^ crc32_tables[2][(hi >> 8) & 0xFF] ^ crc32_tables[1][(hi >> 16) & 0xFF] ^ crc32_tables[0][hi >> 24];
+	}
+	for (; length > 0; length--, data++) {
+		crc = Utils_Crc32Table[(crc ^ *data) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+UInt32 Utils_CRC32(UInt8* data, UInt32 length) {
+	return Utils_Crc32Update(0xffffffffUL, data, length) ^ 0xffffffffUL;
 }
 
 UInt32 Utils_Crc32Table[256] = {
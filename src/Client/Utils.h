@@ -32,5 +32,7 @@ Int32 Utils_AccumulateWheelDelta(Real32* accmulator, Real32 delta);
 
 UInt8 Utils_GetSkinType(Bitmap* bmp);
 UInt32 Utils_CRC32(UInt8* data, UInt32 length);
+/* Updates a running CRC32 (before its final inversion) with the given data, 8 bytes at a time. */
+UInt32 Utils_Crc32Update(UInt32 crc, UInt8* data, UInt32 length);
 extern UInt32 Utils_Crc32Table[256];
 #endif
\ No newline at end of file
@@ -9,4 +9,11 @@
 typedef struct VertexP3fC4b_ { Real32 X, Y, Z; PackedCol Col; } VertexP3fC4b;
 /* 3 floats for position (XYZ), 2 floats for texture coordinates (UV), 4 bytes for colour. */
 typedef struct VertexP3fT2fC4b_ { Real32 X, Y, Z; PackedCol Col; Real32 U, V; } VertexP3fT2fC4b;
+/* 3 shorts for position (XYZ), 4 bytes for colour, 2 floats for texture coordinates (UV).
+Used for chunk meshes, with position relative to the chunk's origin and scaled by the factor below.
+Texture coordinates stay floats, as shorts cannot hold V precisely enough for a 1D atlas of up to 256 tiles. */
+typedef struct VertexP3sT2fC4b_ { Int16 X, Y, Z, Pad; PackedCol Col; Real32 U, V; } VertexP3sT2fC4b;
+
+/* Position is in units of 1/1024 of a block. (chunk vertices are within -32 to 32 of chunk origin) */
+#define VERTEXP3ST2FC4B_POS_SCALE 1024.0f
 #endif
\ No newline at end of file
@@ -19,6 +19,9 @@ HDC hdc;
 HANDLE heap;
 bool stopwatch_highResolution;
 LARGE_INTEGER stopwatch_freq;
+#if CC_BUILD_BENCHMARK
+DWORD platform_mainThreadId; /* Allocations on other threads are counted separately */
+#endif
 
 UInt8* Platform_NewLine = "\r\n";
 UInt8 Platform_DirectorySeparator = '\\';
@@ -30,6 +33,9 @@ ReturnCode ReturnCode_SocketWouldBlock = WSAEWOULDBLOCK;
 
 void Platform_Init(void) {
 	heap = GetProcessHeap(); /* TODO: HeapCreate instead? probably not */
+#if CC_BUILD_BENCHMARK
+	platform_mainThreadId = GetCurrentThreadId();
+#endif
 	hdc = CreateCompatibleDC(NULL);
 	if (hdc == NULL) ErrorHandler_Fail("Failed to get screen DC");
 
@@ -114,13 +120,30 @@ STRING_PURE String Platform_GetCommandLineArgs(void) {
 	return args;
 }
 
+#if CC_BUILD_BENCHMARK
+UInt32 Platform_AllocCount, Platform_BackgroundAllocCount;
+
+static void Platform_CountAlloc(void) {
+	if (GetCurrentThreadId() == platform_mainThreadId) {
+		Platform_AllocCount++;
+	} else {
+		InterlockedIncrement((volatile LONG*)&Platform_BackgroundAllocCount);
+	}
+}
+#endif
 void* Platform_MemAlloc(UInt32 numElems, UInt32 elemsSize) {
 	UInt32 numBytes = numElems * elemsSize; /* TODO: avoid overflow here */
+#if CC_BUILD_BENCHMARK
+	Platform_CountAlloc();
+#endif
 	return HeapAlloc(heap, 0, numBytes);
 }
 
 void* Platform_MemRealloc(void* mem, UInt32 numElems, UInt32 elemsSize) {
 	UInt32 numBytes = numElems * elemsSize; /* TODO: avoid overflow here */
+#if CC_BUILD_BENCHMARK
+	Platform_CountAlloc();
+#endif
 	return HeapReAlloc(heap, 0, mem, numBytes);
 }
 
@@ -331,6 +354,33 @@ ReturnCode Platform_FileLength(void* file, UInt32* length) {
 	return *length == INVALID_FILE_SIZE ? GetLastError() : 0;
 }
 
+ReturnCode Platform_FileMap(void** data, UInt32* length, STRING_PURE String* path) {
+	*data = NULL;
+	void* file;
+	ReturnCode result = Platform_FileOpen(&file, path);
+	if (result != 0) return result;
+
+	result = Platform_FileLength(file, length);
+	if (result != 0) { Platform_FileClose(file); return result; }
+
+	/* The view keeps the mapping open, which keeps the file open */
+	HANDLE mapping = CreateFileMappingW((HANDLE)file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping != NULL) {
+		*data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (*data == NULL) result = GetLastError();
+		CloseHandle(mapping);
+	} else {
+		result = GetLastError();
+	}
+
+	Platform_FileClose(file);
+	return result;
+}
+
+ReturnCode Platform_FileUnmap(void* data) {
+	return UnmapViewOfFile(data) ? 0 : GetLastError();
+}
+
 
 void Platform_ThreadSleep(UInt32 milliseconds) {
 	Sleep(milliseconds);
@@ -361,21 +411,22 @@ void Platform_ThreadFreeHandle(void* handle) {
 	}
 }
 
-CRITICAL_SECTION mutexList[3];
-Int32 mutexIndex;
+Int32 Platform_ProcessorsCount(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (Int32)info.dwNumberOfProcessors;
+}
+
 void* Platform_MutexCreate(void) {
-	if (mutexIndex == Array_Elems(mutexList)) { 
-		ErrorHandler_Fail("Cannot allocate another mutex");
-		return NULL;
-	} else {
-		CRITICAL_SECTION* ptr = &mutexList[mutexIndex];
-		InitializeCriticalSection(ptr); mutexIndex++;
-		return ptr;
-	}
+	CRITICAL_SECTION* ptr = Platform_MemAlloc(1, sizeof(CRITICAL_SECTION));
+	if (ptr == NULL) ErrorHandler_Fail("Failed to allocate mutex");
+	InitializeCriticalSection(ptr);
+	return ptr;
 }
 
 void Platform_MutexFree(void* handle) {
 	DeleteCriticalSection((CRITICAL_SECTION*)handle);
+	Platform_MemFree(&handle);
 }
 
 void Platform_MutexLock(void* handle) {
@@ -9,8 +9,11 @@
 #include "Entity.h"
 #include "ExtMath.h"
 #include "Physics.h"
+#include "Funcs.h"
 
+static void World_DetachSnapshot(void);
 void World_Reset(void) {
+	World_DetachSnapshot();
 	Platform_MemFree(&World_Blocks);
 	World_Width = 0; World_Height = 0; World_Length = 0;
 	World_MaxX = 0;  World_MaxY = 0;   World_MaxZ = 0;
@@ -76,6 +79,102 @@ bool World_IsValidPos_3I(Vector3I p) {
 }
 
 
+/*########################################################################################################################*
+*-----------------------------------------------------World snapshot------------------------------------------------------*
+*#########################################################################################################################*/
+#define WORLD_SNAPSHOT_REGION_SIZE (64 * 1024)
+typedef struct WorldSnapshotRegion_ {
+	BlockID* Copy; /* Blocks at time of snapshot, NULL if region has not been modified since */
+	UInt32 Left;   /* Number of blocks in region not yet read by World_ReadSnapshot */
+} WorldSnapshotRegion;
+
+WorldSnapshotRegion* world_snapshot;
+Int32 world_snapshotCount, world_snapshotSize;
+BlockID* world_snapshotBlocks;
+void* world_snapshotMutex;
+
+void World_BeginSnapshot(void) {
+	Int32 i, count = (World_BlocksSize + (WORLD_SNAPSHOT_REGION_SIZE - 1)) / WORLD_SNAPSHOT_REGION_SIZE;
+	world_snapshot = Platform_MemAlloc(max(count, 1), sizeof(WorldSnapshotRegion));
+	if (world_snapshot == NULL) ErrorHandler_Fail("Failed to allocate world snapshot");
+
+	for (i = 0; i < count; i++) {
+		world_snapshot[i].Copy = NULL;
+		world_snapshot[i].Left = min(WORLD_SNAPSHOT_REGION_SIZE, World_BlocksSize - i * WORLD_SNAPSHOT_REGION_SIZE);
+	}
+	world_snapshotCount  = count;
+	world_snapshotSize   = World_BlocksSize;
+	world_snapshotBlocks = World_Blocks;
+	if (world_snapshotMutex == NULL) world_snapshotMutex = Platform_MutexCreate();
+	World_Snapshotting   = true;
+}
+
+static void World_CopyRegion(Int32 i) {
+	WorldSnapshotRegion* region = &world_snapshot[i];
+	/* Regions which have been completely read are never read again, so don't need to be kept */
+	if (region->Copy != NULL || region->Left == 0) return;
+
+	UInt32 offset = i * WORLD_SNAPSHOT_REGION_SIZE;
+	UInt32 size   = min(WORLD_SNAPSHOT_REGION_SIZE, world_snapshotSize - offset);
+	region->Copy  = Platform_MemAlloc(size, sizeof(BlockID));
+	if (region->Copy == NULL) ErrorHandler_Fail("Failed to copy world snapshot region");
+	Platform_MemCpy(region->Copy, &world_snapshotBlocks[offset], size);
+}
+
+void World_CopyOnWrite(Int32 index) {
+	Int32 i = index / WORLD_SNAPSHOT_REGION_SIZE;
+	/* Only the main thread assigns Copy, so checking it without the lock is fine */
+	if (world_snapshot[i].Copy != NULL) return;
+
+	Platform_MutexLock(world_snapshotMutex);
+	World_CopyRegion(i);
+	Platform_MutexUnlock(world_snapshotMutex);
+}
+
+/* Copies all remaining regions, so the blocks array can be freed or replaced while the snapshot is still being read */
+static void World_DetachSnapshot(void) {
+	if (!World_Snapshotting) return;
+	Int32 i;
+
+	Platform_MutexLock(world_snapshotMutex);
+	for (i = 0; i < world_snapshotCount; i++) { World_CopyRegion(i); }
+	world_snapshotBlocks = NULL;
+	Platform_MutexUnlock(world_snapshotMutex);
+	World_Snapshotting = false;
+}
+
+void World_ReadSnapshot(BlockID* dst, UInt32 offset, UInt32 count) {
+	while (count > 0) {
+		Int32 i = offset / WORLD_SNAPSHOT_REGION_SIZE;
+		UInt32 regionOffset = offset % WORLD_SNAPSHOT_REGION_SIZE;
+		UInt32 part = min(count, WORLD_SNAPSHOT_REGION_SIZE - regionOffset);
+		WorldSnapshotRegion* region = &world_snapshot[i];
+
+		/* Lock prevents the main thread from modifying this region while it is being copied */
+		Platform_MutexLock(world_snapshotMutex);
+		BlockID* src = region->Copy != NULL ? &region->Copy[regionOffset] : &world_snapshotBlocks[offset];
+		Platform_MemCpy(dst, src, part);
+		region->Left -= part;
+		Platform_MutexUnlock(world_snapshotMutex);
+
+		dst += part; offset += part; count -= part;
+	}
+}
+
+void World_EndSnapshot(void) {
+	Int32 i;
+	for (i = 0; i < world_snapshotCount; i++) {
+		Platform_MemFree(&world_snapshot[i].Copy);
+	}
+	Platform_MemFree(&world_snapshot);
+
+	world_snapshotCount  = 0;
+	world_snapshotSize   = 0;
+	world_snapshotBlocks = NULL;
+	World_Snapshotting   = false;
+}
+
+
 #define WorldEnv_Set(src, dst, var) \
 if (src != dst) { dst = src; Event_RaiseInt(&WorldEvents_EnvVarChanged, var); }
 
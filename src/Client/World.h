@@ -31,6 +31,18 @@ BlockID World_SafeGetBlock_3I(Vector3I p);
 bool World_IsValidPos(Int32 x, Int32 y, Int32 z);
 bool World_IsValidPos_3I(Vector3I p);
 
+/* Whether blocks must be passed to World_CopyOnWrite before being modified. */
+bool World_Snapshotting;
+/* Begins a snapshot of the blocks array, which can then be read from another thread through World_ReadSnapshot.
+   The game can keep modifying the world, as regions are only copied just before they are first modified. */
+void World_BeginSnapshot(void);
+/* Copies the snapshot region containing the given block index, if it has not been read or copied yet. */
+void World_CopyOnWrite(Int32 index);
+/* Copies the given range of blocks from the snapshot. Each block in the snapshot should only be read once. */
+void World_ReadSnapshot(BlockID* dst, UInt32 offset, UInt32 count);
+/* Frees the snapshot. Must only be called after the thread reading the snapshot has finished. */
+void World_EndSnapshot(void);
+
 enum ENV_VAR {
 	ENV_VAR_EDGE_BLOCK, ENV_VAR_SIDES_BLOCK, ENV_VAR_EDGE_HEIGHT, ENV_VAR_SIDES_OFFSET,
 	ENV_VAR_CLOUDS_HEIGHT, ENV_VAR_CLOUDS_SPEED, ENV_VAR_WEATHER_SPEED, ENV_VAR_WEATHER_FADE,